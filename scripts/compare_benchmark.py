@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Compare an Engine --benchmark JSON file against a stored baseline.
+
+Timing metrics regress when they grow by more than the relative threshold and by more than the
+absolute noise floor. Draw calls and triangles come from a deterministic camera path, so any
+change there is reported as a behaviour change. Exits with 1 when something regressed.
+
+    python3 scripts/compare_benchmark.py baseline.json benchmark.json --threshold 0.05
+"""
+
+import argparse
+import json
+import sys
+
+TIMING_METRICS = ["frame_time_ms", "gpu_time_ms"]
+TIMING_STATS = ["mean", "p50", "p95", "p99"]
+COUNT_METRICS = ["draw_calls", "triangles"]
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def relative_change(baseline, current):
+    if baseline == 0:
+        return 0.0 if current == 0 else float("inf")
+    return (current - baseline) / baseline
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.05, help="relative increase counted as a regression (default 0.05)")
+    parser.add_argument("--noise-ms", type=float, default=0.05, help="timing increases below this many ms are ignored (default 0.05)")
+    parser.add_argument("--memory-threshold", type=float, default=0.10, help="relative increase of used device memory (default 0.10)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = []
+
+    for key in ["scene", "device", "threads", "measured_frames", "timestep"]:
+        if baseline.get(key) != current.get(key):
+            print(f"warning: {key} differs, baseline {baseline.get(key)!r}, current {current.get(key)!r}")
+
+    for metric in TIMING_METRICS:
+        if baseline.get(metric) is None or current.get(metric) is None:
+            if baseline.get(metric) != current.get(metric):
+                print(f"{metric}: only in one of the runs, skipped")
+            continue
+        for stat in TIMING_STATS:
+            old = baseline[metric][stat]
+            new = current[metric][stat]
+            change = relative_change(old, new)
+            flagged = change > args.threshold and new - old > args.noise_ms
+            print(f"{metric + '.' + stat:<18} {old:10.3f} -> {new:10.3f} ms  {change:+7.1%}{'  REGRESSION' if flagged else ''}")
+            if flagged:
+                regressions.append(f"{metric}.{stat}")
+
+    for metric in COUNT_METRICS:
+        old = baseline[metric]["mean"]
+        new = current[metric]["mean"]
+        if old != new:
+            print(f"{metric}: mean {old} -> {new}, the scene or culling output changed")
+            regressions.append(metric)
+
+    old_memory = baseline["memory"]["used_bytes"] + baseline["memory"]["dedicated_bytes"]
+    new_memory = current["memory"]["used_bytes"] + current["memory"]["dedicated_bytes"]
+    memory_change = relative_change(old_memory, new_memory)
+    memory_flagged = memory_change > args.memory_threshold
+    print(f"{'device memory':<18} {old_memory / 2**20:10.2f} -> {new_memory / 2**20:10.2f} MB  {memory_change:+7.1%}"
+          f"{'  REGRESSION' if memory_flagged else ''}")
+    if memory_flagged:
+        regressions.append("memory")
+
+    if regressions:
+        print(f"{len(regressions)} regression(s): {', '.join(regressions)}")
+        return 1
+    print("no regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,17 +1,22 @@
 #version 450
 
 layout (location = 0) in vec2 fragOffset;
+layout (location = 1) in vec4 fragColour;
 layout (location = 0) out vec4 outColour;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionView;
     vec4 ambientLightColour;
-	vec3 lightPosition;
-	vec4 lightColour;
     mat4 view;
+    vec4 clusterParameters;
 } ubo;
 
+const float PI = 3.14159265;
+
 void main()
 {
-    outColour = vec4(ubo.lightColour.xyz, 1.0);
-}
\ No newline at end of file
+    // round glow, opaque in the centre and fading out at the billboard's edge
+    float distanceSquared = dot(fragOffset, fragOffset);
+    if (distanceSquared >= 1.0) discard;
+    outColour = vec4(fragColour.xyz, 0.5 * (cos(distanceSquared * PI) + 1.0));
+}
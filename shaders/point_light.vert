@@ -9,26 +9,35 @@ const vec2 OFFSETS[6] = vec2[](
     vec2(1.0, 1.0)
 );
 
+struct Billboard {
+    vec4 position; // world space xyz, w billboard radius
+    vec4 colour;   // rgb, w intensity
+};
+
 layout (location = 0) out vec2 fragOffset;
+layout (location = 1) out vec4 fragColour;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionView;
     vec4 ambientLightColour;
-	vec3 lightPosition;
-	vec4 lightColour;
     mat4 view;
+    vec4 clusterParameters;
 } ubo;
 
-const float LIGHT_RADIUS = 0.1;
+layout(std430, set = 1, binding = 0) readonly buffer BillboardBuffer {
+    Billboard billboards[];
+};
 
 void main() {
+    Billboard billboard = billboards[gl_InstanceIndex];
     fragOffset = OFFSETS[gl_VertexIndex];
+    fragColour = billboard.colour;
     vec3 cameraRightWorld = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
-    vec3 cameraUpWorld    = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
+    vec3 cameraUpWorld    = {ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]};
 
-    vec3 positionWorld = ubo.lightPosition.xyz
-        + LIGHT_RADIUS * fragOffset.x * cameraRightWorld;
-        + LIGHT_RADIUS * fragOffset.y * cameraUpWorld;
+    vec3 positionWorld = billboard.position.xyz
+        + billboard.position.w * fragOffset.x * cameraRightWorld
+        + billboard.position.w * fragOffset.y * cameraUpWorld;
 
     gl_Position = ubo.projectionView * vec4(positionWorld, 1.0);
-}
\ No newline at end of file
+}
@@ -6,28 +6,59 @@ layout (location = 2) in vec3 fragNormalWorld;
 
 layout (location = 0) out vec4 outColour;
 
+// Matches engine_clustered_lighting.h
+const uint CLUSTER_GRID_X = 16;
+const uint CLUSTER_GRID_Y = 9;
+const uint CLUSTER_GRID_Z = 24;
+
+struct PointLight {
+    vec4 position; // world space xyz, w radius
+    vec4 colour;   // rgb, w intensity
+};
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionView;
     vec4 ambientLightColour;
-	vec3 lightPosition;
-	vec4 lightColour;
     mat4 view;
+    vec4 clusterParameters; // framebuffer width, height, slice scale, slice bias
 } ubo;
 
-layout(push_constant) uniform Push {
-    mat4 meshMatrix; // projection * view * mesh
-    mat4 normalMatrix;
-} push;
+layout(std430, set = 0, binding = 1) readonly buffer LightBuffer {
+    PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer ClusterBuffer {
+    uvec2 clusters[]; // offset into indices, light count
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer LightIndexBuffer {
+    uint indexCount;
+    uint indices[];
+};
 
 
 void main() {
-    vec3 directionToLight = ubo.lightPosition - fragPositionWorld;
-    float attenuation = 1.0 / dot(directionToLight, directionToLight);
+    vec3 normal = normalize(fragNormalWorld);
+    float viewDepth = (ubo.view * vec4(fragPositionWorld, 1.0)).z;
+
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / ubo.clusterParameters.xy * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    uint slice = uint(clamp(floor(log(max(viewDepth, 1e-4)) * ubo.clusterParameters.z - ubo.clusterParameters.w), 0.0, float(CLUSTER_GRID_Z - 1)));
+    uvec2 cluster = clusters[tile.x + CLUSTER_GRID_X * (tile.y + CLUSTER_GRID_Y * slice)];
+
+    vec3 diffuseLight = ubo.ambientLightColour.xyz * ubo.ambientLightColour.w;
+    for (uint i = 0; i < cluster.y; i++) {
+        PointLight light = lights[indices[cluster.x + i]];
+        vec3 directionToLight = light.position.xyz - fragPositionWorld;
+        float distanceSquared = dot(directionToLight, directionToLight);
+
+        // Inverse square falloff, windowed to reach zero at the light's radius
+        float ratio = distanceSquared / (light.position.w * light.position.w);
+        float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+        float attenuation = window * window / max(distanceSquared, 1e-4);
 
-    vec3 lightColour = ubo.lightColour.xyz * ubo.lightColour.w;
-    vec3 ambientLight = ubo.ambientLightColour.xyz * ubo.ambientLightColour.w;
-    vec3 diffuseLight = lightColour * max(dot(normalize(fragNormalWorld), normalize(directionToLight)), 0);
+        float cosAngle = max(dot(normal, directionToLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+        diffuseLight += light.colour.xyz * light.colour.w * attenuation * cosAngle;
+    }
 
-	outColour = vec4((diffuseLight + ambientLight) * fragColour, 1.0);
-}
\ No newline at end of file
+	outColour = vec4(diffuseLight * fragColour, 1.0);
+}
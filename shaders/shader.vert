@@ -13,23 +13,28 @@ layout(location = 2) out vec3 fragNormalWorld;
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionView;
     vec4 ambientLightColour;
-	vec3 lightPosition;
-	vec4 lightColour;
     mat4 view;
+    vec4 clusterParameters;
 } ubo;
 
 
-layout(push_constant) uniform Push {
-    mat4 meshMatrix; // projection * view * mesh
+struct InstanceData {
+    mat4 meshMatrix;
     mat4 normalMatrix;
-} push;
+};
+
+// gl_InstanceIndex includes the firstInstance of the draw, so each mesh batch indexes its own range
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
 
 
 void main() {
-    vec4 positionWorld = push.meshMatrix * vec4(position, 1.0);
+    InstanceData instance = instances[gl_InstanceIndex];
+    vec4 positionWorld = instance.meshMatrix * vec4(position, 1.0);
     gl_Position = ubo.projectionView * positionWorld;
 
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
     fragPosWorld = positionWorld.xyz;
     fragColour = colour;
 }
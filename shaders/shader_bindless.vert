@@ -0,0 +1,48 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// shader.vert reading its instances through a handle into the bindless buffer table (engine_bindless.h)
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 colour;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColour;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projectionView;
+    vec4 ambientLightColour;
+    mat4 view;
+    vec4 clusterParameters;
+} ubo;
+
+
+struct InstanceData {
+    mat4 meshMatrix;
+    mat4 normalMatrix;
+};
+
+// gl_InstanceIndex includes the firstInstance of the draw, so each mesh batch indexes its own range
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+} buffers[];
+
+// handle of this draw's instance buffer, the same for the whole draw
+layout(push_constant) uniform Push {
+    uint instanceBuffer;
+} push;
+
+
+void main() {
+    InstanceData instance = buffers[push.instanceBuffer].instances[gl_InstanceIndex];
+    vec4 positionWorld = instance.meshMatrix * vec4(position, 1.0);
+    gl_Position = ubo.projectionView * positionWorld;
+
+    fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
+    fragPosWorld = positionWorld.xyz;
+    fragColour = colour;
+}
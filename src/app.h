@@ -12,11 +12,21 @@
 #include "engine_mesh.h"
 #include "engine_game_object.h"
 #include "engine_render_system.h"
+#include "engine_gpu_culling_system.h"
 #include "engine_point_light_system.h"
+#include "engine_clustered_lighting.h"
 #include "engine_camera.h"
 #include "engine_buffer.h"
 #include "engine_descriptor.h"
+#include "engine_layout_cache.h"
+#include "engine_bindless.h"
 #include "engine_input_system.h"
+#include "engine_upload_manager.h"
+#include "engine_job_system.h"
+#include "engine_command_recorder.h"
+#include "engine_profiler.h"
+#include "engine_gpu_profiler.h"
+#include "engine_benchmark.h"
 
 #include <memory>
 #include <vector>
@@ -24,30 +34,59 @@
 #include <stdexcept>
 #include <array>
 #include <chrono>
+#include <string>
+#include <random>
 
 namespace Engine{
 
 struct GlobalUbo {
 	glm::mat4 projectionView{1.0f};
 	glm::vec4 ambientLightColour{0.69f, 0.84f, 0.89f, 0.4f};
-	glm::vec4 lightPosition {2.0f};
-	alignas(16) glm::vec4 lightColour {1.0f};
 	glm::mat4 view{1.0f};
+	glm::vec4 clusterParameters{0.0f};   // see ClusteredLightingSystem::getClusterParameters
+};
+
+struct AppOptions {
+	bool stressScene = false;   // 50k instances of 10 procedural meshes instead of the model scene
+	bool gpuCulling = false;    // cull and build indirect draws in a compute pass
+	bool validateCulling = false; // compare GPU visible counts against the CPU reference
+	bool bindless = false;      // render systems read their buffers through handles into one bindless descriptor set
+	uint32_t workerThreads = 0; // job system threads including the main thread, 0 for one per hardware thread
+	bool gpuProfiler = false;   // GPU timestamps and pipeline statistics around the render pass and systems
+	bool headless = false;      // no window or surface, frames go to offscreen images
+	uint32_t frameLimit = 0;    // exit after this many frames, 0 to run until the window closes
+	std::string capturePath;    // headless only, the last frame is written here as a PNG
+
+	bool benchmark = false;     // fixed timestep camera path, warmup then measured frames, JSON summary
+	uint32_t warmupFrames = 120;
+	uint32_t measuredFrames = 600;
+	std::string benchmarkOutput = "benchmark.json";
+	std::string cameraPath;     // benchmark path to play back, a generated path for the scene otherwise
+	std::string recordPath;     // saves the flown camera path on exit, for later playback
+	uint32_t lightCount = 0;    // point lights, 0 for the scene default (1 for the car, 4096 for the stress scene)
 };
 
 class Application{
 public:
 	static constexpr int width = 800;
 	static constexpr int height = 600;
-
-	Application() {
-		// Descriptor set pool
-		globalPool = EngineDescriptorPool::Builder(engineDevice)
-		.setMaxSets(EngineSwapChain::MAX_FRAMES_IN_FLIGHT)
-		.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, EngineSwapChain::MAX_FRAMES_IN_FLIGHT)
-		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, EngineSwapChain::MAX_FRAMES_IN_FLIGHT)
-		.build();
-		loadGameObjects();
+	static constexpr VkDeviceSize stagingRingSize = 32ull * 1024 * 1024;
+	static constexpr const char *profilePath = "profile.json";
+
+	const char *getSceneName() const {return options.stressScene ? "stress" : "car";}
+
+	Application(const AppOptions &options = AppOptions{}) : options{options} {
+		if (options.stressScene) loadStressScene();
+		else loadGameObjects();
+		loadLights();
+		transformStore.updateWorldMatrices(&jobSystem);
+		uploadManager.submit();
+
+		EngineAllocatorStats memoryStats = engineDevice.allocator().getStats();
+		std::cout << "Device memory: " << memoryStats.allocationCount << " allocations in "
+			<< memoryStats.blockCount << " blocks + " << memoryStats.dedicatedAllocationCount << " dedicated, "
+			<< memoryStats.usedBytes / (1024.0 * 1024.0) << " / " << memoryStats.blockBytes / (1024.0 * 1024.0) << " MB used, "
+			<< "fragmentation " << memoryStats.fragmentation << std::endl;
 	}
 
 	~Application() {}
@@ -71,39 +110,85 @@ public:
 			uboBuffers[i]->map();
 		}
 
-		// Descriptor sets
-		auto globalSetLayout = EngineDescriptorSetLayout::Builder(engineDevice)
-		.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
-		.build();
+		// Point lights, binned into clusters by a compute pass every frame
+		ClusteredLightingSystem lightingSystem{engineDevice, layoutCache, descriptorAllocator, static_cast<uint32_t>(pointLights.size())};
 
-		std::vector<VkDescriptorSet> globalDescriptorSets(EngineSwapChain::MAX_FRAMES_IN_FLIGHT);
-		for (int i = 0; i < globalDescriptorSets.size(); ++i){
-			auto bufferInfo = uboBuffers[i]->descriptorInfo();
-			EngineDescriptorWriter(*globalSetLayout, *globalPool)
-			.writeBuffer(0, &bufferInfo)
-			.build(globalDescriptorSets[i]);
+		// Global set layout, the set holds everything the graphics shaders declare in set 0 and is written every frame
+		EngineShaderReflection graphicsShaders = EnginePipeline::reflect({
+			RenderSystem::VERT_SHADER_PATH, RenderSystem::FRAG_SHADER_PATH,
+			PointLightSystem::VERT_SHADER_PATH, PointLightSystem::FRAG_SHADER_PATH});
+		const EngineShaderBinding *uboBinding = graphicsShaders.findBinding(0, 0);
+		if (!uboBinding || uboBinding->blockSize != sizeof(GlobalUbo)){
+			throw std::runtime_error("GlobalUbo in the shaders does not match the C++ struct");
 		}
+		EngineDescriptorSetLayout &globalSetLayout = layoutCache.getSetLayout(graphicsShaders, 0);
 
 
 	    // internal
 	    float aspect = renderer.getAspectRatio();
 	    auto currentTime = std::chrono::high_resolution_clock::now();
 	    float frameTime;
+	    float statsTime = 0.0f;
+	    uint32_t statsFrames = 0;
+	    uint32_t frameCount = 0;
+	    float lightTime = 0.0f;
 
 
 	    // SCRIPTABLE ZONE //////////////////////////////////////////////////
 	    Camera camera{};
-		InputSystem input{window.getGLFWwindow()};
-		input.SetMouseMode(MouseMode::Play);
+		std::unique_ptr<InputSystem> input;   // headless runs keep the starting camera
+		if (!options.headless){
+			input = std::make_unique<InputSystem>(window.getGLFWwindow());
+			input->SetMouseMode(MouseMode::Play);
+		}
 	    camera.setPerspectiveProjection(aspect);
 
 	    // RENDER SYSTEMS SETUP ///////////////////////////////
-	    RenderSystem renderSystem{engineDevice, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()}; // Game Object Render System
-		PointLightSystem pointLightSystem{engineDevice, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()}; // Point Light Render System
+		std::unique_ptr<EngineBindlessTable> bindlessTable;
+		if (options.bindless && !EngineBindlessTable::isSupported(engineDevice)){
+			std::cerr << "bindless resources need descriptor indexing (Vulkan 1.2), using per system descriptor sets" << std::endl;
+		}
+		else if (options.bindless){
+			bindlessTable = std::make_unique<EngineBindlessTable>(engineDevice);
+		}
+
+	    RenderSystem renderSystem{engineDevice, renderer.getSwapChainRenderPass(), globalSetLayout.getDescriptorSetLayout(), layoutCache, descriptorAllocator, bindlessTable.get()}; // Game Object Render System
+		PointLightSystem pointLightSystem{engineDevice, renderer.getSwapChainRenderPass(), globalSetLayout.getDescriptorSetLayout(), layoutCache, descriptorAllocator, bindlessTable.get()}; // Point Light Render System
+
+		std::unique_ptr<GpuCullingSystem> gpuCullingSystem;
+		if (options.gpuCulling && !GpuCullingSystem::isSupported(engineDevice)){
+			std::cerr << "GPU culling needs drawIndirectFirstInstance, using CPU instancing" << std::endl;
+		}
+		else if (options.gpuCulling){
+			gpuCullingSystem = std::make_unique<GpuCullingSystem>(engineDevice, uploadManager, layoutCache, descriptorAllocator, options.validateCulling, bindlessTable.get());
+			gpuCullingSystem->setObjects(gameObjects, transformStore);
+		}
+		std::cout << "Layouts: " << layoutCache.getSetLayoutCount() << " descriptor set layouts and " << layoutCache.getPipelineLayoutCount()
+			<< " pipeline layouts for " << layoutCache.getRequestCount() << " requests" << std::endl;
+		if (bindlessTable){
+			std::cout << "Bindless: " << bindlessTable->getBufferCount() << " of " << bindlessTable->getBufferCapacity() << " buffer slots, "
+				<< bindlessTable->getImageCapacity() << " image slots" << std::endl;
+		}
+
+		std::unique_ptr<EngineBenchmark> benchmark;
+		if (options.benchmark){
+			benchmark = std::make_unique<EngineBenchmark>(getSceneName(), createBenchmarkPath(), options.warmupFrames, options.measuredFrames);
+		}
+		EngineCameraPath recordedPath;
+		float recordedTime = 0.0f;
+
+		// benchmarks take GPU frame times from the timestamps, statistics only on request
+		std::unique_ptr<EngineGpuProfiler> gpuProfiler;
+		if (options.gpuProfiler || benchmark){
+			gpuProfiler = std::make_unique<EngineGpuProfiler>(engineDevice, options.gpuProfiler);
+			commandRecorder.setInheritedPipelineStatistics(gpuProfiler->inheritedPipelineStatistics());
+		}
 		
 		// INTERNAL LOOP RUNS ONCE PER FRAME ///////////////////////////////
-	    while (!window.shouldClose()) {
-	        glfwPollEvents();
+	    while (!window.shouldClose() && (options.frameLimit == 0 || frameCount < options.frameLimit) && !(benchmark && benchmark->isFinished())) {
+	    	ENGINE_PROFILE_FRAME();
+	    	ENGINE_PROFILE_ZONE("frame");
+	        if (!options.headless) glfwPollEvents();
 
 	        // calculates time elapsed since last frame
 	        auto newTime = std::chrono::high_resolution_clock::now();
@@ -111,76 +196,336 @@ public:
 	        currentTime = newTime;
 
 
-			// Update input system state
-    		input.UpdateInputs();
+			// Update input system state, fly the camera and handle key presses
+			if (benchmark) benchmark->updateCamera(camera);
+			else if (input){
+	    		input->UpdateInputs();
+
+				float speed = 2.0f;
 
-			float speed = 2.0f;
+				glm::vec2 moveInput = input->Movement() * speed * frameTime;
+				glm::vec2 mouseLook = input->MouseLook() * 0.00045f;
+				glm::vec3 move = moveInput.x * camera.Right() + glm::vec3(0.0f, input->MovementY() * speed * frameTime, 0.0f) + moveInput.y * camera.Forward();
+				glm::vec3 rot{mouseLook.y, -mouseLook.x, 0.0f};
 
-			glm::vec2 moveInput = input.Movement() * speed * frameTime;
-			glm::vec2 mouseLook = input.MouseLook() * 0.00045f;
-			glm::vec3 move = moveInput.x * camera.Right() + glm::vec3(0.0f, input.MovementY() * speed * frameTime, 0.0f) + moveInput.y * camera.Forward();
-			glm::vec3 rot{mouseLook.y, -mouseLook.x, 0.0f};
 
+				camera.position += move;
+				camera.rotation += rot;
+				camera.rotation.x = glm::clamp(camera.rotation.x, -glm::pi<float>() * 0.5f, glm::pi<float>() * 0.5f); // clamp
 
-			camera.position += move;
-			camera.rotation += rot;
-			camera.rotation.x = glm::clamp(camera.rotation.x, -glm::pi<float>() * 0.5f, glm::pi<float>() * 0.5f); // clamp
+				if (input->GetKeyDown(InputSystem::KeyCode::Escape))
+				{
+					if (input->GetMouseMode() == MouseMode::Play) input->SetMouseMode(MouseMode::Normal);
+					else input->SetMouseMode(MouseMode::Play);
+				} 
+
+				// dump the profiler's last frames (ENGINE_ENABLE_PROFILER builds only)
+				if (input->GetKeyDown(InputSystem::KeyCode::P)) ENGINE_PROFILE_DUMP(profilePath);
+
+				if (!options.recordPath.empty()){
+					recordedPath.addKey(recordedTime, camera.position, camera.rotation);
+					recordedTime += frameTime;
+				}
+			}
 
 			// set camera view
 			camera.setView();
 			camera.setPerspectiveProjection(aspect);
 
-			if (input.GetKeyDown(InputSystem::KeyCode::Escape))
-			{
-				if (input.GetMouseMode() == MouseMode::Play) input.SetMouseMode(MouseMode::Normal);
-				else input.SetMouseMode(MouseMode::Play);
-			} 
 
+	        // world and normal matrices of the transforms changed since the last frame, read by culling and the instance writes
+	        transformStore.updateWorldMatrices(&jobSystem);
+
+	        // submit queued mesh uploads and retire finished ones
+	        uploadManager.update();
 
 	        if (auto commandBuffer = renderer.beginFrame()) {
 	        	int frameIndex = renderer.getFrameIndex();
+	        	if (bindlessTable) bindlessTable->beginFrame();
+
+	        	// the frame's fence has signalled, its descriptor sets from last time are released in one go
+	        	descriptorAllocator.beginFrame(frameIndex);
+	        	auto bufferInfo = uboBuffers[frameIndex]->descriptorInfo();
+	        	auto lightInfo = lightingSystem.getLightBufferInfo(frameIndex);
+	        	auto clusterInfo = lightingSystem.getClusterBufferInfo(frameIndex);
+	        	auto lightIndexInfo = lightingSystem.getLightIndexBufferInfo(frameIndex);
+	        	VkDescriptorSet globalDescriptorSet = EngineDescriptorWriter(globalSetLayout)
+	        	.writeBuffer(0, &bufferInfo)
+	        	.writeBuffer(1, &lightInfo)
+	        	.writeBuffer(2, &clusterInfo)
+	        	.writeBuffer(3, &lightIndexInfo)
+	        	.build(descriptorAllocator, frameIndex);
+
 	        	FrameInfo frameInfo{
 	        		frameIndex,
-	        		frameTime,
+	        		benchmark ? benchmark->getTimestep() : frameTime,   // simulation step, fixed while benchmarking
 	        		commandBuffer,
 	        		camera,
-	        		globalDescriptorSets[frameIndex]
+	        		globalDescriptorSet
 	        	};
 
 	        	// update
 	        	GlobalUbo ubo{};
 				ubo.projectionView = camera.getProjection() * camera.getView();
 				ubo.view = camera.getView();
+				ubo.clusterParameters = lightingSystem.getClusterParameters(camera, renderer.getSwapChainExtent());
 	        	uboBuffers[frameIndex]->writeToBuffer(&ubo);
 	        	uboBuffers[frameIndex]->flush();
 
-	        	// render
-	            renderer.beginSwapChainRenderPass(commandBuffer);
-	            renderSystem.renderGameObjects(frameInfo, gameObjects);
-				pointLightSystem.render(frameInfo);
+	        	// lights move with the simulation step, so benchmark runs see the same lights every time
+	        	lightTime += frameInfo.frameTime;
+	        	if (options.stressScene) animateLights(lightTime);
+	        	lightingSystem.writeLights(frameIndex, pointLights);
+
+	        	// reads back this frame's previous queries and resets them, outside the render pass
+	        	if (gpuProfiler) gpuProfiler->beginFrame(frameIndex, commandBuffer);
+
+	        	// cull before the render pass, compute can not run inside it
+	        	uint32_t cullScope = gpuProfiler && gpuCullingSystem ? gpuProfiler->beginScope(commandBuffer, "GpuCullingSystem") : 0;
+	        	bool gpuCulled = gpuCullingSystem && gpuCullingSystem->cull(frameInfo);
+	        	if (gpuProfiler && gpuCullingSystem) gpuProfiler->endScope(commandBuffer, cullScope);
+
+	        	uint32_t clusterScope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, "ClusteredLightingSystem") : 0;
+	        	lightingSystem.cluster(frameInfo);
+	        	if (gpuProfiler) gpuProfiler->endScope(commandBuffer, clusterScope);
+
+	        	// render, the pass is recorded into the recorder's secondary command buffers
+	        	commandRecorder.beginFrame(frameIndex, renderer.getSwapChainRenderPass(), renderer.getCurrentFramebuffer(), renderer.getSwapChainExtent());
+	        	FrameInfo secondaryFrameInfo = frameInfo;
+	        	secondaryFrameInfo.commandBuffer = commandRecorder.getCommandBuffer(commandRecorder.getSlotCount() - 1);
+
+	        	// slots execute in order, so the render system spans the first slot's start to the last slot's end
+	        	uint32_t renderScope = gpuProfiler ? gpuProfiler->beginScope(commandRecorder.getCommandBuffer(0), "RenderSystem") : 0;
+	            if (gpuCulled && bindlessTable){
+	            	renderSystem.renderIndirect(
+	            		secondaryFrameInfo,
+	            		gpuCullingSystem->getMeshes(),
+	            		gpuCullingSystem->getDrawBuffer(frameIndex),
+	            		gpuCullingSystem->getInstanceBufferHandle(frameIndex));
+	            }
+	            else if (gpuCulled){
+	            	renderSystem.renderIndirect(
+	            		secondaryFrameInfo,
+	            		gpuCullingSystem->getMeshes(),
+	            		gpuCullingSystem->getDrawBuffer(frameIndex),
+	            		gpuCullingSystem->getInstanceDescriptorSet());
+	            }
+	            else renderSystem.renderGameObjects(frameInfo, gameObjects, transformStore, commandRecorder);
+	            if (gpuProfiler) gpuProfiler->endScope(secondaryFrameInfo.commandBuffer, renderScope);
+
+	            uint32_t pointLightScope = gpuProfiler ? gpuProfiler->beginScope(secondaryFrameInfo.commandBuffer, "PointLightSystem") : 0;
+				pointLightSystem.render(secondaryFrameInfo, pointLights);
+	            if (gpuProfiler) gpuProfiler->endScope(secondaryFrameInfo.commandBuffer, pointLightScope);
+
+	            uint32_t passScope = 0;
+	            if (gpuProfiler){
+	            	passScope = gpuProfiler->beginScope(commandBuffer, "render pass");
+	            	gpuProfiler->beginStatistics(commandBuffer);
+	            }
+	            renderer.beginSwapChainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	            commandRecorder.execute(commandBuffer);
 	            renderer.endSwapChainRenderPass(commandBuffer);
+	            if (gpuProfiler){
+	            	gpuProfiler->endStatistics(commandBuffer);
+	            	gpuProfiler->endScope(commandBuffer, passScope);
+	            }
 	            renderer.endFrame();
+	            frameCount++;
+
+	            if (benchmark){
+	            	EngineBenchmarkSample sample{};
+	            	sample.frameMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(
+	            		std::chrono::high_resolution_clock::now() - newTime).count();
+	            	sample.gpuMilliseconds = gpuProfiler->hasTimestamps() ? static_cast<float>(gpuProfiler->getFrameMilliseconds()) : -1.0f;
+	            	sample.drawCalls = renderSystem.getDrawCallCount();
+	            	sample.triangles = renderSystem.getTriangleCount();
+	            	benchmark->endFrame(sample);
+	            }
+
+	            statsTime += frameTime;
+	            statsFrames++;
+	            if (statsTime >= 2.0f){
+	            	std::cout << statsFrames / statsTime << " fps, " << 1000.0f * statsTime / statsFrames << " ms/frame, "
+	            		<< renderSystem.getDrawCallCount() << " draw calls for " << renderSystem.getInstanceCount() << " instances ("
+	            		<< renderSystem.getCulledCount() << " culled), recorded in " << commandRecorder.getRecordTime()
+	            		<< " ms on " << jobSystem.getThreadCount() << " threads" << std::endl;
+	            	if (gpuProfiler) logGpuProfile(*gpuProfiler);
+	            	statsTime = 0.0f;
+	            	statsFrames = 0;
+	            }
+
+	            if (!firstFrameLogged){
+	            	firstFrameLogged = true;
+	            	float startupTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+	            		std::chrono::high_resolution_clock::now() - startTime).count();
+	            	std::cout << "Startup to first frame: " << startupTime << " ms ("
+	            		<< uploadManager.getCopyCount() << " uploads in " << uploadManager.getSubmitCount() << " submits)" << std::endl;
+	            }
 	        }
 	    }
 	    vkDeviceWaitIdle(engineDevice.device());
+	    ENGINE_PROFILE_DUMP(profilePath);
+
+	    if (benchmark && !benchmark->writeJson(options.benchmarkOutput, engineDevice.properties.deviceName,
+	    	jobSystem.getThreadCount(), engineDevice.allocator().getStats())){
+	    	std::cerr << "failed to write " << options.benchmarkOutput << std::endl;
+	    }
+	    if (!options.recordPath.empty() && !recordedPath.empty()){
+	    	if (recordedPath.save(options.recordPath)) std::cout << "Saved camera path to " << options.recordPath << std::endl;
+	    	else std::cerr << "failed to write " << options.recordPath << std::endl;
+	    }
+
+	    if (options.headless && !options.capturePath.empty() && frameCount > 0){
+	    	if (renderer.captureFrame(options.capturePath)) std::cout << "Wrote frame " << frameCount << " to " << options.capturePath << std::endl;
+	    	else std::cerr << "failed to write " << options.capturePath << std::endl;
+	    }
+
+	    EngineStagingRingStats stagingStats = uploadManager.getStagingStats();
+	    std::cout << "Staging ring: peak " << stagingStats.peakUsedBytes / (1024.0 * 1024.0) << " / "
+	    	<< stagingStats.capacity / (1024.0 * 1024.0) << " MB, " << stagingStats.allocationCount << " regions, "
+	    	<< stagingStats.wrapCount << " wraps, " << stagingStats.stallCount << " stalls" << std::endl;
+	    std::cout << "Descriptor sets: " << descriptorAllocator.getAllocationCount() << " allocated from "
+	    	<< descriptorAllocator.getPoolCount() << " pools, " << descriptorAllocator.getCacheHitCount() << " cache hits" << std::endl;
 	}
 
 private:
+	void logGpuProfile(const EngineGpuProfiler &gpuProfiler){
+		if (gpuProfiler.getScopeResults().empty() && !gpuProfiler.hasPipelineStatistics()) return;
+		std::cout << "GPU:";
+		for (const auto &scope : gpuProfiler.getScopeResults()) std::cout << " " << scope.name << " " << scope.milliseconds << " ms,";
+		if (gpuProfiler.hasPipelineStatistics()){
+			const EngineGpuPipelineStatistics &statistics = gpuProfiler.getPipelineStatistics();
+			std::cout << " " << statistics.vertexShaderInvocations << " vertex / " << statistics.fragmentShaderInvocations
+				<< " fragment invocations, " << statistics.clippingPrimitives << " primitives clipped";
+		}
+		std::cout << std::endl;
+	}
+
+	// One pass over the run: an orbit around the car, a flythrough over the stress grid
+	EngineCameraPath createBenchmarkPath(){
+		if (!options.cameraPath.empty()) return EngineCameraPath::load(options.cameraPath);
+		float duration = (options.warmupFrames + options.measuredFrames) * EngineBenchmark::DEFAULT_TIMESTEP;
+		if (options.stressScene) return EngineCameraPath::flythrough({0.0f, -1.5f, -2.0f}, {0.0f, -1.5f, 100.0f}, 0.6f, duration);
+		return EngineCameraPath::orbit({0.0f, 0.0f, 0.2f}, 2.0f, 0.8f, duration);
+	}
+
 	void loadGameObjects(){
-		std::shared_ptr<EngineMesh> model = EngineMesh::createMeshFromFile(engineDevice, "../models/car.obj");
-        auto obj = EngineGameObject::createGameObject();
+		std::shared_ptr<EngineMesh> model = EngineMesh::createMeshFromFile(engineDevice, uploadManager, "../models/car.obj", &jobSystem);
+        TransformComponent transform{};
+        transform.translation = {0.0f, 0.0f, 0.2f};
+        transform.scale = {0.5f, 0.5f, 0.5f};
+        auto obj = EngineGameObject::createGameObject(transformStore, transform);
         obj.mesh = model;
-        obj.transform.translation = {0.0f, 0.0f, 0.2f};
-        obj.transform.scale = {0.5f, 0.5f, 0.5f};
         gameObjects.push_back(std::move(obj));
     }
 
-	EngineWindow window{width, height, "World"};
+	// Grid of 50k objects sharing 10 meshes, for measuring the instanced path
+	void loadStressScene(){
+		constexpr uint32_t meshCount = 10;
+		constexpr uint32_t gridWidth = 250;
+		constexpr uint32_t gridDepth = 200;
+
+		std::vector<std::shared_ptr<EngineMesh>> meshes;
+		for (uint32_t i = 0; i < meshCount; i++){
+			glm::vec3 colour{0.3f + 0.07f * i, 0.8f - 0.05f * i, 0.5f};
+			meshes.push_back(createSphereMesh(4 + i, 6 + 2 * i, colour));
+		}
+
+		transformStore.reserve(gridWidth * gridDepth);
+		gameObjects.reserve(gridWidth * gridDepth);
+		for (uint32_t z = 0; z < gridDepth; z++){
+			for (uint32_t x = 0; x < gridWidth; x++){
+				TransformComponent transform{};
+				transform.translation = {(x - gridWidth * 0.5f) * 0.5f, 1.0f, z * 0.5f + 2.0f};
+				transform.scale = glm::vec3{0.2f};
+				auto obj = EngineGameObject::createGameObject(transformStore, transform);
+				obj.mesh = meshes[(x + z) % meshCount];
+				gameObjects.push_back(std::move(obj));
+			}
+		}
+	}
+
+	// The car gets one light off to its side, extra lights go around it. The stress scene spreads its
+	// lights over the object grid, just above the spheres.
+	void loadLights(){
+		uint32_t count = options.lightCount ? options.lightCount : (options.stressScene ? 4096 : 1);
+		std::mt19937 random{42};
+		std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+		pointLights.resize(count);
+		lightOrigins.resize(count);
+		for (uint32_t i = 0; i < count; i++){
+			PointLight &light = pointLights[i];
+			if (options.stressScene){
+				light.position = {unit(random) * 124.0f - 62.0f, unit(random) * 0.5f + 0.3f, unit(random) * 100.0f + 2.0f, 1.0f + unit(random) * 1.5f};
+				light.colour = {unit(random), unit(random), unit(random), 2.0f};
+			}
+			else if (i == 0){
+				light.position = {2.0f, 2.0f, 2.0f, 20.0f};
+				light.colour = {1.0f, 1.0f, 1.0f, 10.0f};
+			}
+			else{
+				light.position = {unit(random) * 6.0f - 3.0f, unit(random) * 3.0f - 2.0f, unit(random) * 6.0f - 2.8f, 1.0f + unit(random)};
+				light.colour = {unit(random), unit(random), unit(random), 1.0f};
+			}
+			lightOrigins[i] = glm::vec3{light.position};
+		}
+	}
+
+	// Small circles around each light's origin, phase and speed vary per light
+	void animateLights(float time){
+		for (size_t i = 0; i < pointLights.size(); i++){
+			float angle = time * (0.5f + 0.1f * (i % 7)) + 0.37f * i;
+			pointLights[i].position.x = lightOrigins[i].x + 0.75f * glm::cos(angle);
+			pointLights[i].position.z = lightOrigins[i].z + 0.75f * glm::sin(angle);
+		}
+	}
+
+	// UV sphere, so the stress scene does not depend on model files
+	std::shared_ptr<EngineMesh> createSphereMesh(uint32_t rings, uint32_t segments, glm::vec3 colour){
+		EngineMesh::Builder builder{};
+		for (uint32_t ring = 0; ring <= rings; ring++){
+			float phi = glm::pi<float>() * ring / rings;
+			for (uint32_t segment = 0; segment <= segments; segment++){
+				float theta = glm::two_pi<float>() * segment / segments;
+
+				EngineMesh::Vertex vertex{};
+				vertex.normal = {glm::sin(phi) * glm::cos(theta), glm::cos(phi), glm::sin(phi) * glm::sin(theta)};
+				vertex.position = vertex.normal;
+				vertex.colour = colour;
+				vertex.uv = {static_cast<float>(segment) / segments, static_cast<float>(ring) / rings};
+				builder.vertices.push_back(vertex);
+			}
+		}
+		for (uint32_t ring = 0; ring < rings; ring++){
+			for (uint32_t segment = 0; segment < segments; segment++){
+				uint32_t current = ring * (segments + 1) + segment;
+				uint32_t below = current + segments + 1;
+				builder.indices.insert(builder.indices.end(), {current, current + 1, below, current + 1, below + 1, below});
+			}
+		}
+		builder.submeshes.push_back({0, static_cast<uint32_t>(builder.indices.size())});
+		builder.computeBounds();
+		return std::make_shared<EngineMesh>(engineDevice, uploadManager, builder);
+	}
+
+	AppOptions options;
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+	bool firstFrameLogged = false;
+
+	EngineWindow window{width, height, "World", options.headless};
     EngineDevice engineDevice{window};
     Renderer renderer{window, engineDevice};
+    EngineUploadManager uploadManager{engineDevice, stagingRingSize};
+    EngineJobSystem jobSystem{options.workerThreads};
+    EngineCommandRecorder commandRecorder{engineDevice, jobSystem};
 
-    std::unique_ptr<EngineDescriptorPool> globalPool{};
+    EngineLayoutCache layoutCache{engineDevice};
+    EngineDescriptorAllocator descriptorAllocator{engineDevice};
+    EngineTransformStore transformStore;
     std::vector<EngineGameObject> gameObjects;
+    std::vector<PointLight> pointLights;
+    std::vector<glm::vec3> lightOrigins;
 };
 } // namespace
 #endif
\ No newline at end of file
@@ -0,0 +1,543 @@
+#ifndef ENGINE_ALLOCATOR_H
+#define ENGINE_ALLOCATOR_H
+
+/*
+ * Block based device memory sub-allocator
+ *
+ * Memory is allocated in large blocks per memory type and split between buffers with a buddy
+ * allocator, so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+ * Host visible blocks are mapped once for their whole lifetime and every allocation gets a
+ * pointer into that mapping.
+ *
+ * Only buffers are placed in blocks, images keep dedicated allocations, so linear and optimal
+ * resources never share a block and bufferImageGranularity cannot be violated.
+ *
+ * EngineBuddyAllocator does the placement without touching Vulkan. EngineMemoryAllocator takes the
+ * memory type table as a plain struct and gets device memory through EngineMemoryFunctions, so both
+ * can be driven by a mocked device (see testMemoryAllocator).
+ */
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <unordered_map>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+namespace Engine{
+
+class EngineBuddyAllocator{
+public:
+	static constexpr VkDeviceSize MIN_BLOCK_SIZE = 256;
+
+	// size must be a power of two and a multiple of MIN_BLOCK_SIZE
+	EngineBuddyAllocator(VkDeviceSize size) : size{size}, freeBytes{size} {
+		assert(size >= MIN_BLOCK_SIZE && (size & (size - 1)) == 0 && "Buddy allocator size must be a power of two");
+		uint32_t orderCount = orderOf(size) + 1;
+		freeLists.resize(orderCount);
+		freeLists[orderCount - 1].insert(0);
+	}
+
+	// Returns false when no free range is large enough. Buddy ranges are naturally aligned to their
+	// own size, so any power of two alignment up to the rounded size is satisfied for free.
+	bool allocate(VkDeviceSize requestSize, VkDeviceSize alignment, VkDeviceSize &offset, uint32_t &order){
+		order = orderOf(std::max(requestSize, alignment));
+		if (order >= freeLists.size()) return false;
+
+		uint32_t available = order;
+		while (available < freeLists.size() && freeLists[available].empty()) available++;
+		if (available == freeLists.size()) return false;
+
+		offset = *freeLists[available].begin();
+		freeLists[available].erase(freeLists[available].begin());
+
+		// Split down to the requested order, the upper halves go back on the free lists
+		while (available > order){
+			available--;
+			freeLists[available].insert(offset + blockSize(available));
+		}
+
+		freeBytes -= blockSize(order);
+		allocationCount++;
+		return true;
+	}
+
+	void free(VkDeviceSize offset, uint32_t order){
+		freeBytes += blockSize(order);
+		allocationCount--;
+
+		// Merge with the buddy for as long as it is free as well
+		while (order + 1 < freeLists.size()){
+			VkDeviceSize buddy = offset ^ blockSize(order);
+			auto it = freeLists[order].find(buddy);
+			if (it == freeLists[order].end()) break;
+
+			freeLists[order].erase(it);
+			offset = std::min(offset, buddy);
+			order++;
+		}
+		freeLists[order].insert(offset);
+	}
+
+	VkDeviceSize getSize() const {return size;}
+	VkDeviceSize getUsedBytes() const {return size - freeBytes;}
+	VkDeviceSize getFreeBytes() const {return freeBytes;}
+	uint32_t getAllocationCount() const {return allocationCount;}
+	bool isEmpty() const {return allocationCount == 0;}
+
+	VkDeviceSize largestFreeRange() const {
+		for (size_t order = freeLists.size(); order-- > 0;){
+			if (!freeLists[order].empty()) return blockSize(static_cast<uint32_t>(order));
+		}
+		return 0;
+	}
+
+	static VkDeviceSize blockSize(uint32_t order) {return MIN_BLOCK_SIZE << order;}
+
+	// Smallest order whose block holds size bytes
+	static uint32_t orderOf(VkDeviceSize size){
+		uint32_t order = 0;
+		while (blockSize(order) < size) order++;
+		return order;
+	}
+
+private:
+	VkDeviceSize size;
+	VkDeviceSize freeBytes;
+	uint32_t allocationCount = 0;
+	std::vector<std::set<VkDeviceSize>> freeLists; // free range offsets per order
+};
+
+
+
+struct EngineAllocation{
+	static constexpr uint32_t DEDICATED = UINT32_MAX;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;          // offset of this allocation inside memory
+	VkDeviceSize size = 0;
+	void *mapped = nullptr;           // host pointer to offset, host visible memory only
+	uint32_t memoryTypeIndex = 0;
+	uint32_t blockIndex = DEDICATED;
+	uint32_t order = 0;
+};
+
+struct EngineAllocatorStats{
+	uint32_t blockCount = 0;
+	uint32_t dedicatedAllocationCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize blockBytes = 0;        // device memory reserved by blocks
+	VkDeviceSize usedBytes = 0;         // bytes handed out from blocks, including buddy rounding
+	VkDeviceSize dedicatedBytes = 0;
+	float fragmentation = 0.0f;         // 1 - largest free range / free bytes, summed over blocks
+};
+
+
+
+// Where EngineMemoryAllocator gets its device memory from, vulkan() for a real device
+struct EngineMemoryFunctions{
+	std::function<VkResult(const VkMemoryAllocateInfo &allocInfo, VkDeviceMemory &memory)> allocate;
+	std::function<VkResult(VkDeviceMemory memory, void *&mapped)> map;    // whole range, once per memory
+	std::function<void(VkDeviceMemory memory, bool mapped)> free;         // unmaps first when mapped
+
+	static EngineMemoryFunctions vulkan(VkDevice device){
+		EngineMemoryFunctions functions{};
+		functions.allocate = [device](const VkMemoryAllocateInfo &allocInfo, VkDeviceMemory &memory) {
+			return vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+		};
+		functions.map = [device](VkDeviceMemory memory, void *&mapped) {
+			return vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		};
+		functions.free = [device](VkDeviceMemory memory, bool mapped) {
+			if (mapped) vkUnmapMemory(device, memory);
+			vkFreeMemory(device, memory, nullptr);
+		};
+		return functions;
+	}
+};
+
+class EngineMemoryAllocator{
+public:
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	EngineMemoryAllocator(
+		VkDevice device,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		VkDeviceSize nonCoherentAtomSize,
+		VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE)
+	: EngineMemoryAllocator{EngineMemoryFunctions::vulkan(device), memoryProperties, nonCoherentAtomSize, preferredBlockSize} {}
+
+	EngineMemoryAllocator(
+		EngineMemoryFunctions functions,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		VkDeviceSize nonCoherentAtomSize,
+		VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE)
+	: functions{std::move(functions)}, memoryProperties{memoryProperties}, nonCoherentAtomSize{std::max<VkDeviceSize>(nonCoherentAtomSize, 1)}
+	{
+		// Small heaps (e.g. 256MB BAR memory) get proportionally smaller blocks
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++){
+			VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+			VkDeviceSize blockSize = preferredBlockSize;
+			while (blockSize > EngineBuddyAllocator::MIN_BLOCK_SIZE * 1024 && blockSize > heapSize / 8) blockSize >>= 1;
+			blockSizes[i] = blockSize;
+		}
+	}
+
+	~EngineMemoryAllocator(){
+		for (auto &block : blocks){
+			if (block) releaseBlock(*block);
+		}
+	}
+
+	EngineMemoryAllocator(const EngineMemoryAllocator &) = delete;
+	EngineMemoryAllocator &operator=(const EngineMemoryAllocator &) = delete;
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+		return findMemoryType(memoryProperties, typeFilter, properties);
+	}
+
+	static uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties &memProperties, uint32_t typeFilter, VkMemoryPropertyFlags properties){
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if ((typeFilter & (1 << i)) &&
+				(memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	EngineAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties){
+		std::lock_guard<std::mutex> lock{mutex};
+
+		EngineAllocation allocation{};
+		allocation.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+		allocation.size = requirements.size;
+
+		// Anything bigger than half a block would waste most of it, give it its own memory
+		VkDeviceSize blockSize = blockSizes[allocation.memoryTypeIndex];
+		if (std::max(requirements.size, requirements.alignment) > blockSize / 2){
+			allocateDedicated(allocation);
+			return allocation;
+		}
+
+		for (uint32_t i = 0; i < blocks.size(); i++){
+			if (!blocks[i] || blocks[i]->memoryTypeIndex != allocation.memoryTypeIndex) continue;
+			if (placeInBlock(i, requirements, allocation)) return allocation;
+		}
+
+		uint32_t blockIndex = createBlock(allocation.memoryTypeIndex, blockSize);
+		if (!placeInBlock(blockIndex, requirements, allocation)){
+			throw std::runtime_error("failed to sub-allocate from a new memory block!");
+		}
+		return allocation;
+	}
+
+	void free(EngineAllocation &allocation){
+		if (allocation.memory == VK_NULL_HANDLE) return;
+		std::lock_guard<std::mutex> lock{mutex};
+
+		if (allocation.blockIndex == EngineAllocation::DEDICATED){
+			functions.free(allocation.memory, allocation.mapped != nullptr);
+			dedicatedAllocationCount--;
+			dedicatedBytes -= allocation.size;
+		}
+		else {
+			Block &block = *blocks[allocation.blockIndex];
+			block.buddy.free(allocation.offset, allocation.order);
+
+			// Keep one empty block per memory type around to avoid allocation churn
+			if (block.buddy.isEmpty() && emptyBlockCount(block.memoryTypeIndex) > 1){
+				releaseBlock(block);
+				blocks[allocation.blockIndex].reset();
+			}
+		}
+		allocation = EngineAllocation{};
+	}
+
+	// Flush/invalidate ranges relative to the allocation, widened to nonCoherentAtomSize
+	VkMappedMemoryRange mappedRange(const EngineAllocation &allocation, VkDeviceSize size, VkDeviceSize offset) const {
+		VkDeviceSize begin = allocation.offset + offset;
+		VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+		begin = begin / nonCoherentAtomSize * nonCoherentAtomSize;
+		end = (end + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = begin;
+		range.size = end - begin;
+
+		// Dedicated allocations end exactly at the allocation size, which may not be atom aligned
+		if (allocation.blockIndex == EngineAllocation::DEDICATED && end > allocation.size) range.size = VK_WHOLE_SIZE;
+		return range;
+	}
+
+	EngineAllocatorStats getStats() const {
+		std::lock_guard<std::mutex> lock{mutex};
+
+		EngineAllocatorStats stats{};
+		stats.dedicatedAllocationCount = dedicatedAllocationCount;
+		stats.dedicatedBytes = dedicatedBytes;
+		stats.allocationCount = dedicatedAllocationCount;
+
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeBytes = 0;
+		for (const auto &block : blocks){
+			if (!block) continue;
+			stats.blockCount++;
+			stats.blockBytes += block->buddy.getSize();
+			stats.usedBytes += block->buddy.getUsedBytes();
+			stats.allocationCount += block->buddy.getAllocationCount();
+			freeBytes += block->buddy.getFreeBytes();
+			largestFreeBytes += block->buddy.largestFreeRange();
+		}
+		if (freeBytes > 0) stats.fragmentation = 1.0f - static_cast<float>(largestFreeBytes) / static_cast<float>(freeBytes);
+		return stats;
+	}
+
+	const VkPhysicalDeviceMemoryProperties &getMemoryProperties() const {return memoryProperties;}
+
+private:
+	struct Block{
+		Block(VkDeviceSize size) : buddy{size} {}
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		uint32_t memoryTypeIndex = 0;
+		void *mapped = nullptr;
+		EngineBuddyAllocator buddy;
+	};
+
+	bool isHostVisible(uint32_t memoryTypeIndex) const {
+		return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+
+	bool placeInBlock(uint32_t blockIndex, const VkMemoryRequirements &requirements, EngineAllocation &allocation){
+		Block &block = *blocks[blockIndex];
+		VkDeviceSize offset;
+		uint32_t order;
+		if (!block.buddy.allocate(requirements.size, requirements.alignment, offset, order)) return false;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.blockIndex = blockIndex;
+		allocation.order = order;
+		allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr;
+		return true;
+	}
+
+	uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size){
+		auto block = std::make_unique<Block>(size);
+		block->memoryTypeIndex = memoryTypeIndex;
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		if (functions.allocate(allocInfo, block->memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate memory block!");
+		}
+
+		// Persistently mapped, vkMapMemory can only be called once per VkDeviceMemory
+		if (isHostVisible(memoryTypeIndex) && functions.map(block->memory, block->mapped) != VK_SUCCESS) {
+			functions.free(block->memory, false);
+			throw std::runtime_error("failed to map memory block!");
+		}
+
+		for (uint32_t i = 0; i < blocks.size(); i++){
+			if (!blocks[i]) {blocks[i] = std::move(block); return i;}
+		}
+		blocks.push_back(std::move(block));
+		return static_cast<uint32_t>(blocks.size() - 1);
+	}
+
+	void releaseBlock(Block &block){
+		functions.free(block.memory, block.mapped != nullptr);
+	}
+
+	void allocateDedicated(EngineAllocation &allocation){
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = allocation.size;
+		allocInfo.memoryTypeIndex = allocation.memoryTypeIndex;
+
+		if (functions.allocate(allocInfo, allocation.memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate buffer memory!");
+		}
+		if (isHostVisible(allocation.memoryTypeIndex) && functions.map(allocation.memory, allocation.mapped) != VK_SUCCESS) {
+			functions.free(allocation.memory, false);
+			throw std::runtime_error("failed to map buffer memory!");
+		}
+
+		allocation.offset = 0;
+		allocation.blockIndex = EngineAllocation::DEDICATED;
+		dedicatedAllocationCount++;
+		dedicatedBytes += allocation.size;
+	}
+
+	uint32_t emptyBlockCount(uint32_t memoryTypeIndex) const {
+		uint32_t count = 0;
+		for (const auto &block : blocks){
+			if (block && block->memoryTypeIndex == memoryTypeIndex && block->buddy.isEmpty()) count++;
+		}
+		return count;
+	}
+
+	EngineMemoryFunctions functions;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize nonCoherentAtomSize;
+	VkDeviceSize blockSizes[VK_MAX_MEMORY_TYPES]{};
+
+	std::vector<std::unique_ptr<Block>> blocks;
+	uint32_t dedicatedAllocationCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	mutable std::mutex mutex;
+};
+
+// Drives EngineMemoryAllocator with a mocked desktop memory table (device local, 256MB BAR, host cached):
+// memory type selection, block placement and alignment, mapped pointers, the dedicated fallback, flush
+// range widening, stats and fragmentation, and that every mocked allocation is freed again
+inline bool testMemoryAllocator(){
+	VkPhysicalDeviceMemoryProperties properties{};
+	properties.memoryTypeCount = 3;
+	properties.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+	properties.memoryTypes[1] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1};
+	properties.memoryTypes[2] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 2};
+	properties.memoryHeapCount = 3;
+	properties.memoryHeaps[0] = {8ull << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+	properties.memoryHeaps[1] = {256ull << 20, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+	properties.memoryHeaps[2] = {16ull << 30, 0};
+
+	// Fake handles, host visible memory is backed by a host buffer so mapped pointers can be checked
+	struct MockMemory{VkDeviceSize size; uint32_t memoryTypeIndex; std::unique_ptr<char[]> host;};
+	std::unordered_map<uint64_t, MockMemory> live;
+	uint64_t nextHandle = 1;
+	uint32_t allocateCalls = 0;
+	bool failAllocations = false;
+	bool correct = true;
+	auto check = [&](bool condition, const char *what) {
+		if (!condition) std::cerr << "Allocator check failed: " << what << std::endl;
+		correct &= condition;
+	};
+
+	EngineMemoryFunctions functions{};
+	functions.allocate = [&](const VkMemoryAllocateInfo &allocInfo, VkDeviceMemory &memory) {
+		if (failAllocations) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		allocateCalls++;
+		uint64_t handle = nextHandle++;
+		live[handle] = {allocInfo.allocationSize, allocInfo.memoryTypeIndex, nullptr};
+		memory = reinterpret_cast<VkDeviceMemory>(handle);
+		return VK_SUCCESS;
+	};
+	functions.map = [&](VkDeviceMemory memory, void *&mapped) {
+		MockMemory &mock = live.at(reinterpret_cast<uint64_t>(memory));
+		if (mock.host) return VK_ERROR_MEMORY_MAP_FAILED; // mapped twice
+		mock.host.reset(new char[mock.size]);
+		mapped = mock.host.get();
+		return VK_SUCCESS;
+	};
+	functions.free = [&](VkDeviceMemory memory, bool mapped) {
+		auto it = live.find(reinterpret_cast<uint64_t>(memory));
+		check(it != live.end(), "free of unknown memory");
+		if (it == live.end()) return;
+		check(mapped == (it->second.host != nullptr), "unmap matches map");
+		live.erase(it);
+	};
+
+	{
+		EngineMemoryAllocator allocator{functions, properties, 64};
+		constexpr VkDeviceSize BLOCK_SIZE = EngineMemoryAllocator::DEFAULT_BLOCK_SIZE;
+
+		// Memory type selection
+		check(allocator.findMemoryType(0x7, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0, "device local type");
+		check(allocator.findMemoryType(0x7, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 1, "first host visible type");
+		check(allocator.findMemoryType(0x5, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 2, "type filter respected");
+		bool threw = false;
+		try {allocator.findMemoryType(0x1, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);} catch (const std::runtime_error &) {threw = true;}
+		check(threw, "no matching type throws");
+
+		// Placement: buddy ranges of a fresh block are handed out in address order and never overlap
+		EngineAllocation small[4];
+		for (auto &allocation : small) allocation = allocator.allocate({200, 16, 0x1}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		check(allocateCalls == 1, "small allocations share one block");
+		for (uint32_t i = 0; i < 4; i++){
+			check(small[i].memory == small[0].memory && small[i].blockIndex == small[0].blockIndex, "same block");
+			check(small[i].offset == i * EngineBuddyAllocator::MIN_BLOCK_SIZE && small[i].order == 0, "address ordered placement");
+			check(small[i].mapped == nullptr, "device local memory is not mapped");
+		}
+
+		EngineAllocation aligned = allocator.allocate({300, 4096, 0x1}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		check(aligned.offset % 4096 == 0 && aligned.offset >= 4 * EngineBuddyAllocator::MIN_BLOCK_SIZE, "alignment above the request size");
+
+		// Stats and fragmentation: freeing 0 and 2 leaves two holes the largest range cannot cover
+		allocator.free(small[0]);
+		allocator.free(small[2]);
+		check(small[0].memory == VK_NULL_HANDLE, "free resets the allocation");
+		EngineAllocatorStats stats = allocator.getStats();
+		VkDeviceSize used = 2 * EngineBuddyAllocator::MIN_BLOCK_SIZE + 4096;
+		check(stats.blockCount == 1 && stats.allocationCount == 3 && stats.dedicatedAllocationCount == 0, "stats counts");
+		check(stats.blockBytes == BLOCK_SIZE && stats.usedBytes == used, "stats bytes");
+		float fragmentation = 1.0f - static_cast<float>(BLOCK_SIZE / 2) / static_cast<float>(BLOCK_SIZE - used);
+		check(std::abs(stats.fragmentation - fragmentation) < 1e-6f, "fragmentation");
+
+		// Host visible: pointer into the persistent block mapping, small heap gets a smaller block
+		EngineAllocation upload = allocator.allocate({1000, 256, 0x2}, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		EngineAllocation upload2 = allocator.allocate({1000, 256, 0x2}, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		check(upload.memoryTypeIndex == 1 && live.at(reinterpret_cast<uint64_t>(upload.memory)).size == (256ull << 20) / 8, "BAR heap block size");
+		check(upload.mapped != nullptr && static_cast<char *>(upload2.mapped) - static_cast<char *>(upload.mapped) ==
+			static_cast<std::ptrdiff_t>(upload2.offset - upload.offset), "mapped pointers follow offsets");
+
+		// Flush ranges widen to nonCoherentAtomSize (64)
+		VkMappedMemoryRange range = allocator.mappedRange(upload2, 10, 70);
+		check(range.offset == upload2.offset + 64 && range.size == 64, "flush range widened to atoms");
+
+		// Dedicated fallback above half a block, mapped on its own
+		uint32_t callsBefore = allocateCalls;
+		EngineAllocation large = allocator.allocate({BLOCK_SIZE / 2 + 1, 256, 0x4}, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		check(large.blockIndex == EngineAllocation::DEDICATED && large.offset == 0 && large.mapped != nullptr, "dedicated allocation");
+		check(allocateCalls == callsBefore + 1 && live.at(reinterpret_cast<uint64_t>(large.memory)).size == large.size, "dedicated size");
+		stats = allocator.getStats();
+		check(stats.dedicatedAllocationCount == 1 && stats.dedicatedBytes == large.size && stats.allocationCount == 6, "dedicated stats");
+		allocator.free(large);
+		check(allocator.getStats().dedicatedAllocationCount == 0 && live.size() == 2, "dedicated memory freed");
+
+		// The first half block fills the free upper half, the second spills into a new block.
+		// Emptying blocks keeps one empty block per type.
+		EngineAllocation halves[2];
+		for (auto &half : halves) half = allocator.allocate({BLOCK_SIZE / 2, 256, 0x1}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		check(halves[0].memory == small[1].memory && halves[0].offset == BLOCK_SIZE / 2, "half block fills the free half");
+		check(halves[1].memory != small[1].memory && halves[1].offset == 0, "full block spills into a new block");
+		for (auto &half : halves) allocator.free(half);
+		check(allocator.getStats().blockCount == 3, "one empty block is kept");
+		allocator.free(small[1]);
+		allocator.free(small[3]);
+		allocator.free(aligned);
+		check(allocator.getStats().blockCount == 2 && live.size() == 2, "second empty block is released");
+
+		// Allocation failures surface as exceptions and leave nothing behind
+		failAllocations = true;
+		threw = false;
+		try {allocator.allocate({BLOCK_SIZE, 256, 0x1}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);} catch (const std::runtime_error &) {threw = true;}
+		check(threw && allocator.getStats().dedicatedAllocationCount == 0, "failed allocation throws");
+		failAllocations = false;
+
+		allocator.free(upload);
+		allocator.free(upload2);
+	}
+	check(live.empty(), "destructor frees every block");
+
+	std::cout << "Allocator checks " << (correct ? "passed" : "FAILED") << " (" << allocateCalls << " mocked allocations)" << std::endl;
+	return correct;
+}
+} // namespace
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef ENGINE_BENCHMARK_H
+#define ENGINE_BENCHMARK_H
+
+/*
+ * Deterministic benchmark runs
+ *
+ * EngineCameraPath is a list of timed camera poses, either recorded from a flown session
+ * (save/load, one "time px py pz rx ry rz" line per key) or generated (orbit, flythrough), and
+ * sampled with linear interpolation. EngineBenchmark advances a simulated clock by a fixed
+ * timestep every frame, so frame N always sees the same camera no matter how long frames take,
+ * skips the warmup frames and collects one sample per measured frame. writeJson() summarises the
+ * samples as mean/p50/p95/p99/max; scripts/compare_benchmark.py compares two such files.
+ */
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "engine_camera.h"
+#include "engine_allocator.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Engine{
+
+struct EngineCameraKey{
+	float time;
+	glm::vec3 position;
+	glm::vec3 rotation;   // Camera::rotation, radians
+};
+
+class EngineCameraPath{
+public:
+
+	void addKey(float time, glm::vec3 position, glm::vec3 rotation) {keys.push_back({time, position, rotation});}
+	bool empty() const {return keys.empty();}
+	float getDuration() const {return keys.empty() ? 0.0f : keys.back().time;}
+
+	// Rotation looking from position at target, matching Camera::setView (y points down)
+	static glm::vec3 lookAtRotation(glm::vec3 position, glm::vec3 target){
+		glm::vec3 direction = glm::normalize(target - position);
+		return {std::asin(-direction.y), std::atan2(direction.x, direction.z), 0.0f};
+	}
+
+	// One revolution around centre in duration seconds, camera height above the centre
+	static EngineCameraPath orbit(glm::vec3 centre, float radius, float height, float duration, uint32_t keyCount = 64){
+		EngineCameraPath path;
+		for (uint32_t i = 0; i <= keyCount; i++){
+			float t = static_cast<float>(i) / keyCount;
+			float angle = glm::two_pi<float>() * t;
+			glm::vec3 position = centre + glm::vec3{radius * std::sin(angle), -height, -radius * std::cos(angle)};
+			glm::vec3 rotation = lookAtRotation(position, centre);
+
+			// keep the yaw continuous so interpolation never spins the long way round
+			if (!path.keys.empty()){
+				float previousYaw = path.keys.back().rotation.y;
+				rotation.y = previousYaw + std::remainder(rotation.y - previousYaw, glm::two_pi<float>());
+			}
+			path.addKey(t * duration, position, rotation);
+		}
+		return path;
+	}
+
+	// Straight line from start to end while the view sweeps yawAmplitude to either side
+	static EngineCameraPath flythrough(glm::vec3 start, glm::vec3 end, float yawAmplitude, float duration, uint32_t keyCount = 64){
+		EngineCameraPath path;
+		glm::vec3 forward = lookAtRotation(start, end);
+		for (uint32_t i = 0; i <= keyCount; i++){
+			float t = static_cast<float>(i) / keyCount;
+			glm::vec3 rotation = forward + glm::vec3{0.0f, yawAmplitude * std::sin(glm::two_pi<float>() * t), 0.0f};
+			path.addKey(t * duration, glm::mix(start, end, t), rotation);
+		}
+		return path;
+	}
+
+	// Holds the last key past the end
+	void sample(float time, glm::vec3 &position, glm::vec3 &rotation) const {
+		if (keys.empty()) return;
+		auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const EngineCameraKey &key) {return t < key.time;});
+		if (next == keys.begin()) {position = keys.front().position; rotation = keys.front().rotation; return;}
+		if (next == keys.end()) {position = keys.back().position; rotation = keys.back().rotation; return;}
+
+		const EngineCameraKey &previous = *(next - 1);
+		float span = next->time - previous.time;
+		float blend = span > 0.0f ? (time - previous.time) / span : 0.0f;
+		position = glm::mix(previous.position, next->position, blend);
+		rotation = glm::mix(previous.rotation, next->rotation, blend);
+	}
+
+	bool save(const std::string &path) const {
+		std::ofstream out{path, std::ios::trunc};
+		if (!out.is_open()) return false;
+		out << "# time px py pz rx ry rz\n";
+		for (const auto &key : keys){
+			out << key.time << " " << key.position.x << " " << key.position.y << " " << key.position.z << " "
+				<< key.rotation.x << " " << key.rotation.y << " " << key.rotation.z << "\n";
+		}
+		return out.good();
+	}
+
+	static EngineCameraPath load(const std::string &path){
+		std::ifstream in{path};
+		if (!in.is_open()) throw std::runtime_error("failed to open camera path: " + path);
+
+		EngineCameraPath cameraPath;
+		std::string line;
+		while (std::getline(in, line)){
+			if (line.empty() || line[0] == '#') continue;
+			std::istringstream fields{line};
+			EngineCameraKey key{};
+			if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z
+				>> key.rotation.x >> key.rotation.y >> key.rotation.z)){
+				throw std::runtime_error("malformed camera path line: " + line);
+			}
+			if (!cameraPath.keys.empty() && key.time < cameraPath.keys.back().time){
+				throw std::runtime_error("camera path keys must be in time order: " + path);
+			}
+			cameraPath.keys.push_back(key);
+		}
+		if (cameraPath.keys.empty()) throw std::runtime_error("camera path has no keys: " + path);
+		return cameraPath;
+	}
+
+private:
+	std::vector<EngineCameraKey> keys;
+};
+
+struct EngineBenchmarkSample{
+	float frameMilliseconds;    // wall time from the start of the frame to endFrame returning
+	float gpuMilliseconds;      // negative without GPU timestamps
+	uint32_t drawCalls;
+	uint64_t triangles;
+};
+
+struct EngineBenchmarkSummary{
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+
+	// Nearest rank percentiles
+	static EngineBenchmarkSummary of(std::vector<double> values){
+		EngineBenchmarkSummary summary{};
+		if (values.empty()) return summary;
+		std::sort(values.begin(), values.end());
+		auto percentile = [&](double p) {
+			size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+			return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+		};
+		double sum = 0.0;
+		for (double value : values) sum += value;
+		summary.mean = sum / values.size();
+		summary.p50 = percentile(0.50);
+		summary.p95 = percentile(0.95);
+		summary.p99 = percentile(0.99);
+		summary.max = values.back();
+		return summary;
+	}
+};
+
+class EngineBenchmark{
+public:
+	static constexpr float DEFAULT_TIMESTEP = 1.0f / 60.0f;
+
+	EngineBenchmark(std::string scene, EngineCameraPath path, uint32_t warmupFrames, uint32_t measuredFrames, float timestep = DEFAULT_TIMESTEP)
+		: scene{std::move(scene)}, path{std::move(path)}, warmupFrames{warmupFrames}, measuredFrames{measuredFrames}, timestep{timestep} {
+		samples.reserve(measuredFrames);
+	}
+
+	float getTimestep() const {return timestep;}
+	uint32_t getTotalFrames() const {return warmupFrames + measuredFrames;}
+	bool isFinished() const {return frame >= getTotalFrames();}
+
+	// Poses the camera for the current frame from the simulated clock
+	void updateCamera(Camera &camera) const {
+		path.sample(frame * timestep, camera.position, camera.rotation);
+	}
+
+	// Advances the simulated clock, the sample is dropped during warmup
+	void endFrame(const EngineBenchmarkSample &sample){
+		if (frame >= warmupFrames && samples.size() < measuredFrames) samples.push_back(sample);
+		frame++;
+	}
+
+	bool writeJson(const std::string &outputPath, const std::string &deviceName, uint32_t threadCount, const EngineAllocatorStats &memory) const {
+		std::vector<double> frameTimes, gpuTimes, drawCalls, triangles;
+		for (const auto &sample : samples){
+			frameTimes.push_back(sample.frameMilliseconds);
+			if (sample.gpuMilliseconds >= 0.0f) gpuTimes.push_back(sample.gpuMilliseconds);
+			drawCalls.push_back(sample.drawCalls);
+			triangles.push_back(static_cast<double>(sample.triangles));
+		}
+
+		std::ofstream out{outputPath, std::ios::trunc};
+		if (!out.is_open()) return false;
+
+		out << "{\n";
+		out << "\t\"scene\": \"" << scene << "\",\n";
+		out << "\t\"device\": \"" << deviceName << "\",\n";
+		out << "\t\"threads\": " << threadCount << ",\n";
+		out << "\t\"warmup_frames\": " << warmupFrames << ",\n";
+		out << "\t\"measured_frames\": " << samples.size() << ",\n";
+		out << "\t\"timestep\": " << timestep << ",\n";
+		writeSummary(out, "frame_time_ms", frameTimes);
+		if (gpuTimes.empty()) out << "\t\"gpu_time_ms\": null,\n";
+		else writeSummary(out, "gpu_time_ms", gpuTimes);
+		writeSummary(out, "draw_calls", drawCalls);
+		writeSummary(out, "triangles", triangles);
+		out << "\t\"memory\": {\"used_bytes\": " << memory.usedBytes << ", \"block_bytes\": " << memory.blockBytes
+			<< ", \"dedicated_bytes\": " << memory.dedicatedBytes << ", \"allocations\": " << memory.allocationCount << "}\n";
+		out << "}\n";
+
+		EngineBenchmarkSummary frameSummary = EngineBenchmarkSummary::of(frameTimes);
+		std::cout << "Benchmark " << scene << ": " << samples.size() << " frames, mean " << frameSummary.mean << " ms, p99 "
+			<< frameSummary.p99 << " ms, written to " << outputPath << std::endl;
+		return out.good();
+	}
+
+private:
+
+	static void writeSummary(std::ofstream &out, const char *name, const std::vector<double> &values){
+		EngineBenchmarkSummary summary = EngineBenchmarkSummary::of(values);
+		out << "\t\"" << name << "\": {\"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+			<< ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "},\n";
+	}
+
+	std::string scene;
+	EngineCameraPath path;
+	uint32_t warmupFrames;
+	uint32_t measuredFrames;
+	float timestep;
+	uint32_t frame = 0;
+	std::vector<EngineBenchmarkSample> samples;
+};
+} // namespace
+
+#endif
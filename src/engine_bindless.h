@@ -0,0 +1,240 @@
+#ifndef ENGINE_BINDLESS_H
+#define ENGINE_BINDLESS_H
+
+/*
+ * Bindless resource table
+ *
+ * One update-after-bind descriptor set holding large arrays of storage buffers (binding 0) and
+ * combined image samplers (binding 1), visible to every stage. Resources are registered once and
+ * get a stable integer handle, shaders index the arrays with it (shader_bindless.vert reads its
+ * instance buffer through a handle in its push constants). The set is bound once per command
+ * buffer, so drawing with different resources needs no descriptor binds.
+ *
+ * Needs descriptor indexing (Vulkan 1.2, see EngineDevice::bindlessSupported). Slots are partially
+ * bound, and a slot may be rewritten while command buffers that do not use it are pending.
+ * Released handles are reused only after MAX_FRAMES_IN_FLIGHT frames, when no submitted frame can
+ * still read them.
+ */
+
+#include "engine_device.h"
+#include "engine_buffer.h"
+#include "engine_swap_chain.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+namespace Engine{
+
+struct EngineResourceHandle{
+	static constexpr uint32_t INVALID = UINT32_MAX;
+	uint32_t index = INVALID;
+
+	bool isValid() const {return index != INVALID;}
+	bool operator==(const EngineResourceHandle &other) const {return index == other.index;}
+	bool operator!=(const EngineResourceHandle &other) const {return index != other.index;}
+};
+
+class EngineBindlessTable{
+public:
+	static constexpr uint32_t BUFFER_BINDING = 0;
+	static constexpr uint32_t IMAGE_BINDING = 1;
+	static constexpr uint32_t DEFAULT_MAX_BUFFERS = 16384;
+	static constexpr uint32_t DEFAULT_MAX_IMAGES = 4096;
+
+	static bool isSupported(EngineDevice &device) {return device.bindlessSupported();}
+
+	// Array sizes are clamped to the device's update-after-bind limits
+	EngineBindlessTable(EngineDevice &device, uint32_t maxBuffers = DEFAULT_MAX_BUFFERS, uint32_t maxImages = DEFAULT_MAX_IMAGES)
+	: engineDevice{device}
+	{
+		if (!isSupported(device)) throw std::runtime_error("bindless resources need descriptor indexing");
+		clampToLimits(maxBuffers, maxImages);
+		createSetLayout();
+		createPool();
+		allocateSet();
+	}
+
+	~EngineBindlessTable(){
+		vkDestroyDescriptorPool(engineDevice.device(), descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(engineDevice.device(), setLayout, nullptr);
+	}
+
+	EngineBindlessTable(const EngineBindlessTable &) = delete;
+	EngineBindlessTable &operator=(const EngineBindlessTable &) = delete;
+
+	VkDescriptorSetLayout getSetLayout() const {return setLayout;}
+	VkDescriptorSet getDescriptorSet() const {return descriptorSet;}
+	uint32_t getBufferCapacity() const {return buffers.capacity;}
+	uint32_t getImageCapacity() const {return images.capacity;}
+	uint32_t getBufferCount() const {return buffers.used - static_cast<uint32_t>(buffers.free.size() + buffers.retired.size());}
+	uint32_t getImageCount() const {return images.used - static_cast<uint32_t>(images.free.size() + images.retired.size());}
+
+	EngineResourceHandle registerBuffer(const VkDescriptorBufferInfo &bufferInfo){
+		EngineResourceHandle handle = buffers.acquire("bindless buffer table is full");
+		updateBuffer(handle, bufferInfo);
+		return handle;
+	}
+
+	EngineResourceHandle registerBuffer(EngineBuffer &buffer) {return registerBuffer(buffer.descriptorInfo());}
+
+	// Points the handle at another buffer, no frame in flight may be using it
+	void updateBuffer(EngineResourceHandle handle, const VkDescriptorBufferInfo &bufferInfo){
+		VkWriteDescriptorSet write = slotWrite(BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, handle);
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(engineDevice.device(), 1, &write, 0, nullptr);
+	}
+
+	EngineResourceHandle registerImage(VkImageView imageView, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+		EngineResourceHandle handle = images.acquire("bindless image table is full");
+		VkDescriptorImageInfo imageInfo{sampler, imageView, layout};
+		VkWriteDescriptorSet write = slotWrite(IMAGE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, handle);
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(engineDevice.device(), 1, &write, 0, nullptr);
+		return handle;
+	}
+
+	void releaseBuffer(EngineResourceHandle handle) {buffers.release(handle, frameCounter);}
+	void releaseImage(EngineResourceHandle handle) {images.release(handle, frameCounter);}
+
+	// Once per frame, before recording, makes handles released MAX_FRAMES_IN_FLIGHT frames ago reusable
+	void beginFrame(){
+		frameCounter++;
+		buffers.recycle(frameCounter);
+		images.recycle(frameCounter);
+	}
+
+private:
+	// Handle allocation for one array, a free list plus releases waiting for their frames to retire
+	struct Slots{
+		uint32_t capacity = 0;
+		uint32_t used = 0;   // slots ever handed out
+		std::vector<uint32_t> free;
+		std::vector<std::pair<uint32_t, uint64_t>> retired;   // slot, frame it was released in
+
+		EngineResourceHandle acquire(const char *fullMessage){
+			if (!free.empty()){
+				uint32_t index = free.back();
+				free.pop_back();
+				return {index};
+			}
+			if (used == capacity) throw std::runtime_error(fullMessage);
+			return {used++};
+		}
+
+		void release(EngineResourceHandle handle, uint64_t frame){
+			if (handle.isValid()) retired.emplace_back(handle.index, frame);
+		}
+
+		void recycle(uint64_t frame){
+			auto done = std::partition(retired.begin(), retired.end(), [&](const auto &slot) {
+				return slot.second + EngineSwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+			});
+			for (auto it = done; it != retired.end(); ++it) free.push_back(it->first);
+			retired.erase(done, retired.end());
+		}
+	};
+
+	void clampToLimits(uint32_t maxBuffers, uint32_t maxImages){
+		VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexingProperties;
+		engineDevice.getPhysicalDeviceProperties2(&properties);
+
+		buffers.capacity = std::min({maxBuffers,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers});
+		images.capacity = std::min({maxImages,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSamplers});
+	}
+
+	void createSetLayout(){
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = BUFFER_BINDING;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[0].descriptorCount = buffers.capacity;
+		bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+		bindings[1].binding = IMAGE_BINDING;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].descriptorCount = images.capacity;
+		bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+		VkDescriptorBindingFlags flags =
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		VkDescriptorBindingFlags bindingFlags[2] = {flags, flags};
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		bindingFlagsInfo.bindingCount = 2;
+		bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 2;
+		layoutInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(engineDevice.device(), &layoutInfo, nullptr, &setLayout) != VK_SUCCESS){
+			throw std::runtime_error("failed to create bindless descriptor set layout!");
+		}
+	}
+
+	void createPool(){
+		VkDescriptorPoolSize poolSizes[2] = {
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffers.capacity},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, images.capacity}};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(engineDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS){
+			throw std::runtime_error("failed to create bindless descriptor pool!");
+		}
+	}
+
+	void allocateSet(){
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &setLayout;
+		if (vkAllocateDescriptorSets(engineDevice.device(), &allocInfo, &descriptorSet) != VK_SUCCESS){
+			throw std::runtime_error("failed to allocate bindless descriptor set!");
+		}
+	}
+
+	VkWriteDescriptorSet slotWrite(uint32_t binding, VkDescriptorType type, EngineResourceHandle handle) const {
+		if (!handle.isValid()) throw std::runtime_error("invalid bindless handle");
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = binding;
+		write.dstArrayElement = handle.index;
+		write.descriptorType = type;
+		write.descriptorCount = 1;
+		return write;
+	}
+
+	EngineDevice &engineDevice;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	Slots buffers;
+	Slots images;
+	uint64_t frameCounter = 0;
+};
+
+} // namespace
+
+#endif
@@ -6,6 +6,9 @@
  *
  * Initially based off VulkanBuffer by Sascha Willems -
  * https://github.com/SaschaWillems/Vulkan/blob/master/base/VulkanBuffer.h
+ *
+ * The memory is a range inside a block owned by EngineDevice's allocator, host visible blocks are
+ * mapped persistently so map/unmap only hand out a pointer into that mapping.
  */
  
 #include "engine_device.h"
@@ -29,12 +32,11 @@ public:
     {
   		alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
   		bufferSize = alignmentSize * instanceCount;
-  		device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+  		device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, allocation);
 	}
 	~EngineBuffer(){
 		unmap();
-		vkDestroyBuffer(engineDevice.device(), buffer, nullptr);
-		vkFreeMemory(engineDevice.device(), memory, nullptr);
+		engineDevice.destroyBuffer(buffer, allocation);
 	}
 
 	EngineBuffer(const EngineBuffer&) = delete;
@@ -52,21 +54,20 @@ public:
 	* @return VkResult of the buffer mapping call
 	*/
 	VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0){
-		assert(buffer && memory && "Called map on buffer before create");
-  		return vkMapMemory(engineDevice.device(), memory, offset, size, 0, &mapped);
+		assert(buffer && allocation.memory && "Called map on buffer before create");
+		if (!allocation.mapped) return VK_ERROR_MEMORY_MAP_FAILED;
+		mapped = static_cast<char *>(allocation.mapped) + offset;
+		return VK_SUCCESS;
 	}
 
 
 	/**
 	* Unmap a mapped memory range
 	*
-	* @note Does not return a result as vkUnmapMemory can't fail
+	* @note The block stays mapped, this only drops the buffer's pointer into it
 	*/
 	void unmap(){
-		if (mapped) {
-    		vkUnmapMemory(engineDevice.device(), memory);
-    		mapped = nullptr;
-  		}
+		mapped = nullptr;
 	}
 
 
@@ -106,11 +107,7 @@ public:
 	* @return VkResult of the flush call
 	*/
 	VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0){
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		VkMappedMemoryRange mappedRange = engineDevice.allocator().mappedRange(allocation, size, offset);
 		return vkFlushMappedMemoryRanges(engineDevice.device(), 1, &mappedRange);
 	}
 
@@ -140,11 +137,7 @@ public:
 	* @return VkResult of the invalidate call
 	*/
 	VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0){
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		VkMappedMemoryRange mappedRange = engineDevice.allocator().mappedRange(allocation, size, offset);
 		return vkInvalidateMappedMemoryRanges(engineDevice.device(), 1, &mappedRange);
 	}
 
@@ -205,6 +198,7 @@ public:
 	VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
 	VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
 	VkDeviceSize getBufferSize() const { return bufferSize; }
+	const EngineAllocation &getAllocation() const { return allocation; }
 
 private:
 
@@ -227,7 +221,7 @@ private:
 	EngineDevice& engineDevice;
 	void* mapped = nullptr;
 	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	EngineAllocation allocation{};
 
 	VkDeviceSize bufferSize;
 	uint32_t instanceCount;
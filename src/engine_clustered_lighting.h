@@ -0,0 +1,330 @@
+#ifndef ENGINE_CLUSTERED_LIGHTING_H
+#define ENGINE_CLUSTERED_LIGHTING_H
+
+/*
+ * Clustered forward lighting
+ *
+ * The view frustum is split into CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles and CLUSTER_GRID_Z
+ * depth slices, exponentially spaced between the cluster near and far planes. Every frame a compute
+ * pass (cluster.comp) tests every point light against every cluster's view space bounding box and
+ * writes one compact index list per cluster. shader.frag finds its fragment's cluster and only
+ * loops over those lights.
+ *
+ * Lights go to a host visible storage buffer per frame in flight, the cluster grid and index lists
+ * to device local ones. They are bound to the global descriptor set (bindings 1 to 3), the slice
+ * parameters travel in GlobalUbo::clusterParameters. Light ranges are cut off at their radius, and
+ * lights past the cluster far plane do not reach fragments beyond it.
+ *
+ * binLights() is the CPU reference of the compute pass; testClusteredLighting() checks it against
+ * brute force per point light evaluation and needs no GPU.
+ */
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "engine_pipeline.h"
+#include "engine_device.h"
+#include "engine_camera.h"
+#include "engine_frame_info.h"
+#include "engine_buffer.h"
+#include "engine_descriptor.h"
+#include "engine_layout_cache.h"
+#include "engine_swap_chain.h"
+
+#include <memory>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <random>
+#include <limits>
+#include <iostream>
+#include <stdexcept>
+
+namespace Engine{
+
+// Match cluster.comp and shader.frag
+constexpr uint32_t CLUSTER_GRID_X = 16;
+constexpr uint32_t CLUSTER_GRID_Y = 9;
+constexpr uint32_t CLUSTER_GRID_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+constexpr uint32_t LIGHT_INDEX_CAPACITY = CLUSTER_COUNT * 64;   // shared by all clusters' lists
+
+// Matches PointLight in cluster.comp and shader.frag (std430)
+struct PointLight{
+	glm::vec4 position{0.0f, 0.0f, 0.0f, 1.0f};   // world space xyz, w radius
+	glm::vec4 colour{1.0f};                       // rgb, w intensity
+};
+
+// Matches the push constants of cluster.comp
+struct ClusterPushConstantData{
+	glm::mat4 view{1.0f};
+	glm::vec4 projection{1.0f};   // projection[0][0], projection[1][1], cluster near, cluster far
+	uint32_t lightCount = 0;
+	uint32_t indexCapacity = 0;
+};
+
+// Cluster geometry for one perspective projection, shared by the compute pass and the CPU reference
+struct ClusterGrid{
+	float projectionX;   // projection[0][0], ndc x = projectionX * x / z
+	float projectionY;   // projection[1][1]
+	float near;
+	float far;
+
+	// slice = log(z) * sliceScale() - sliceBias()
+	float sliceScale() const {return CLUSTER_GRID_Z / std::log(far / near);}
+	float sliceBias() const {return CLUSTER_GRID_Z * std::log(near) / std::log(far / near);}
+
+	// First slice reaches down to the camera, depths past far land in the last slice
+	float sliceDepth(uint32_t slice) const {
+		if (slice == 0) return 0.0f;
+		return near * std::pow(far / near, static_cast<float>(slice) / CLUSTER_GRID_Z);
+	}
+
+	uint32_t clusterIndex(uint32_t x, uint32_t y, uint32_t z) const {return x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);}
+
+	// Cluster of a view space point, as shader.frag computes it from gl_FragCoord and the view depth
+	uint32_t clusterOf(glm::vec3 viewPosition) const {
+		float ndcX = projectionX * viewPosition.x / viewPosition.z;
+		float ndcY = projectionY * viewPosition.y / viewPosition.z;
+		uint32_t x = std::min(CLUSTER_GRID_X - 1, static_cast<uint32_t>(std::max(0.0f, (ndcX * 0.5f + 0.5f) * CLUSTER_GRID_X)));
+		uint32_t y = std::min(CLUSTER_GRID_Y - 1, static_cast<uint32_t>(std::max(0.0f, (ndcY * 0.5f + 0.5f) * CLUSTER_GRID_Y)));
+		float slice = std::floor(std::log(std::max(viewPosition.z, 1e-4f)) * sliceScale() - sliceBias());
+		uint32_t z = static_cast<uint32_t>(std::clamp(slice, 0.0f, static_cast<float>(CLUSTER_GRID_Z - 1)));
+		return clusterIndex(x, y, z);
+	}
+
+	// View space box around the cluster's frustum piece (view space y points down, z forward)
+	void clusterBounds(uint32_t x, uint32_t y, uint32_t z, glm::vec3 &minimum, glm::vec3 &maximum) const {
+		float ndcX0 = 2.0f * x / CLUSTER_GRID_X - 1.0f, ndcX1 = 2.0f * (x + 1) / CLUSTER_GRID_X - 1.0f;
+		float ndcY0 = 2.0f * y / CLUSTER_GRID_Y - 1.0f, ndcY1 = 2.0f * (y + 1) / CLUSTER_GRID_Y - 1.0f;
+		float depths[2] = {sliceDepth(z), sliceDepth(z + 1)};
+		minimum = glm::vec3{std::numeric_limits<float>::max()};
+		maximum = glm::vec3{-std::numeric_limits<float>::max()};
+		for (float depth : depths){
+			for (float ndcX : {ndcX0, ndcX1}){
+				for (float ndcY : {ndcY0, ndcY1}){
+					glm::vec3 corner{ndcX * depth / projectionX, ndcY * depth / projectionY, depth};
+					minimum = glm::min(minimum, corner);
+					maximum = glm::max(maximum, corner);
+				}
+			}
+		}
+	}
+};
+
+inline bool sphereIntersectsBox(glm::vec3 centre, float radius, glm::vec3 minimum, glm::vec3 maximum){
+	glm::vec3 closest = glm::clamp(centre, minimum, maximum);
+	glm::vec3 offset = closest - centre;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+// CPU reference of cluster.comp. clusters gets (offset, count) per cluster into indices, every list in
+// light order. The GPU lists only differ in their offsets, and are cut once LIGHT_INDEX_CAPACITY runs out.
+inline void binLights(
+	const ClusterGrid &grid, const glm::mat4 &view, const std::vector<PointLight> &lights,
+	std::vector<glm::uvec2> &clusters, std::vector<uint32_t> &indices)
+{
+	std::vector<glm::vec4> viewLights(lights.size());
+	for (size_t i = 0; i < lights.size(); i++){
+		viewLights[i] = glm::vec4{glm::vec3{view * glm::vec4{glm::vec3{lights[i].position}, 1.0f}}, lights[i].position.w};
+	}
+
+	clusters.assign(CLUSTER_COUNT, glm::uvec2{0});
+	indices.clear();
+	for (uint32_t z = 0; z < CLUSTER_GRID_Z; z++){
+		for (uint32_t y = 0; y < CLUSTER_GRID_Y; y++){
+			for (uint32_t x = 0; x < CLUSTER_GRID_X; x++){
+				glm::vec3 minimum, maximum;
+				grid.clusterBounds(x, y, z, minimum, maximum);
+				uint32_t offset = static_cast<uint32_t>(indices.size());
+				for (uint32_t i = 0; i < viewLights.size(); i++){
+					if (sphereIntersectsBox(glm::vec3{viewLights[i]}, viewLights[i].w, minimum, maximum)) indices.push_back(i);
+				}
+				clusters[grid.clusterIndex(x, y, z)] = {offset, static_cast<uint32_t>(indices.size()) - offset};
+			}
+		}
+	}
+}
+
+// Bins 4096 random lights on the CPU and checks, for random points in the frustum, that every light
+// whose radius reaches the point is in the point's cluster list. Needs no GPU.
+inline bool testClusteredLighting(const glm::mat4 &projection, const glm::mat4 &view, uint32_t lightCount = 4096, uint32_t pointCount = 200000){
+	ClusterGrid grid{projection[0][0], projection[1][1], 0.1f, 200.0f};
+	glm::mat4 inverseView = glm::inverse(view);
+
+	std::mt19937 random{1234};
+	std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+	std::vector<PointLight> lights(lightCount);
+	for (auto &light : lights){
+		glm::vec3 position{unit(random) * 120.0f - 60.0f, unit(random) * 4.0f - 2.0f, unit(random) * 110.0f - 5.0f};
+		light.position = glm::vec4{glm::vec3{inverseView * glm::vec4{position, 1.0f}}, 0.5f + unit(random) * 2.5f};
+	}
+
+	std::vector<glm::uvec2> clusters;
+	std::vector<uint32_t> indices;
+	binLights(grid, view, lights, clusters, indices);
+
+	// points spread over the screen and over depth, up to the cluster far plane
+	uint32_t missing = 0, pointsLit = 0;
+	for (uint32_t p = 0; p < pointCount; p++){
+		float depth = grid.near * 0.5f * std::pow(grid.far / (grid.near * 0.5f), unit(random));
+		glm::vec3 viewPosition{(unit(random) * 2.0f - 1.0f) * depth / grid.projectionX, (unit(random) * 2.0f - 1.0f) * depth / grid.projectionY, depth};
+		glm::vec3 worldPosition{inverseView * glm::vec4{viewPosition, 1.0f}};
+		glm::uvec2 cluster = clusters[grid.clusterOf(viewPosition)];
+		const uint32_t *list = indices.data() + cluster.x;
+
+		bool lit = false;
+		for (uint32_t i = 0; i < lightCount; i++){
+			glm::vec3 offset = glm::vec3{lights[i].position} - worldPosition;
+			if (glm::dot(offset, offset) > lights[i].position.w * lights[i].position.w) continue;
+			lit = true;
+			if (!std::binary_search(list, list + cluster.y, i)) missing++;
+		}
+		if (lit) pointsLit++;
+	}
+
+	uint32_t maxPerCluster = 0;
+	for (const auto &cluster : clusters) maxPerCluster = std::max(maxPerCluster, cluster.y);
+	bool ok = missing == 0 && indices.size() <= LIGHT_INDEX_CAPACITY;
+	std::cout << "Clustered lighting: " << lightCount << " lights in " << CLUSTER_COUNT << " clusters, " << indices.size()
+		<< " of " << LIGHT_INDEX_CAPACITY << " indices (" << float(indices.size()) / CLUSTER_COUNT << " per cluster, max "
+		<< maxPerCluster << "), " << pointsLit << " of " << pointCount << " points lit, " << missing
+		<< " light contributions missing" << (ok ? "" : " FAILED") << std::endl;
+	return ok;
+}
+
+class ClusteredLightingSystem{
+public:
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+	static constexpr float CLUSTER_NEAR = 0.1f;
+	static constexpr float CLUSTER_FAR = 200.0f;
+
+	static constexpr const char *COMP_SHADER_PATH = ENGINE_SHADER_DIR "cluster.comp.spv";
+
+	ClusteredLightingSystem(EngineDevice &device, EngineLayoutCache &layoutCache, EngineDescriptorAllocator &descriptorAllocator, uint32_t maxLights)
+	: engineDevice{device}, descriptorAllocator{descriptorAllocator}, maxLights{std::max(1u, maxLights)}
+	{
+		createLayouts(layoutCache);
+		createBuffers();
+		pipeline = std::make_unique<EngineComputePipeline>(engineDevice, COMP_SHADER_PATH, pipelineLayout);
+	}
+
+	ClusteredLightingSystem(const ClusteredLightingSystem &) = delete;
+	ClusteredLightingSystem &operator=(const ClusteredLightingSystem &) = delete;
+
+	uint32_t getMaxLights() const {return maxLights;}
+	uint32_t getLightCount() const {return lightCount;}
+
+	// Global set bindings 1 to 3 for shader.frag
+	VkDescriptorBufferInfo getLightBufferInfo(int frameIndex) {return lightBuffers[frameIndex]->descriptorInfo();}
+	VkDescriptorBufferInfo getClusterBufferInfo(int frameIndex) {return clusterBuffers[frameIndex]->descriptorInfo();}
+	VkDescriptorBufferInfo getLightIndexBufferInfo(int frameIndex) {return lightIndexBuffers[frameIndex]->descriptorInfo();}
+
+	ClusterGrid getGrid(const Camera &camera) const {
+		return {camera.getProjection()[0][0], camera.getProjection()[1][1], CLUSTER_NEAR, CLUSTER_FAR};
+	}
+
+	// GlobalUbo::clusterParameters, framebuffer width and height, slice scale and bias
+	glm::vec4 getClusterParameters(const Camera &camera, VkExtent2D extent) const {
+		ClusterGrid grid = getGrid(camera);
+		return {static_cast<float>(extent.width), static_cast<float>(extent.height), grid.sliceScale(), grid.sliceBias()};
+	}
+
+	// Writes this frame's lights, the frame's previous submission must have completed
+	void writeLights(int frameIndex, const std::vector<PointLight> &lights){
+		if (lights.size() > maxLights) throw std::runtime_error("more point lights than the clustered lighting system was created for");
+		lightCount = static_cast<uint32_t>(lights.size());
+		if (lightCount == 0) return;
+		lightBuffers[frameIndex]->writeToBuffer(const_cast<PointLight *>(lights.data()), sizeof(PointLight) * lightCount);
+		lightBuffers[frameIndex]->flush();
+	}
+
+	// Records the binning pass, outside of any render pass, then makes the lists visible to fragment shaders
+	void cluster(FrameInfo &frameInfo){
+		int frameIndex = frameInfo.frameIndex;
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+		// the index list counter lives in front of the indices
+		vkCmdFillBuffer(commandBuffer, lightIndexBuffers[frameIndex]->getBuffer(), 0, sizeof(uint32_t), 0);
+		VkMemoryBarrier resetBarrier{};
+		resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+		ClusterGrid grid = getGrid(frameInfo.camera);
+		ClusterPushConstantData push{};
+		push.view = frameInfo.camera.getView();
+		push.projection = {grid.projectionX, grid.projectionY, grid.near, grid.far};
+		push.lightCount = lightCount;
+		push.indexCapacity = LIGHT_INDEX_CAPACITY;
+
+		auto lightInfo = lightBuffers[frameIndex]->descriptorInfo();
+		auto clusterInfo = clusterBuffers[frameIndex]->descriptorInfo();
+		auto indexInfo = lightIndexBuffers[frameIndex]->descriptorInfo();
+		VkDescriptorSet clusterSet = EngineDescriptorWriter(*clusterSetLayout)
+		.writeBuffer(0, &lightInfo)
+		.writeBuffer(1, &clusterInfo)
+		.writeBuffer(2, &indexInfo)
+		.build(descriptorAllocator, frameIndex);
+
+		pipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &clusterSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, &push);
+		vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+		VkMemoryBarrier clusterBarrier{};
+		clusterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clusterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		clusterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &clusterBarrier, 0, nullptr, 0, nullptr);
+	}
+
+private:
+
+	void createLayouts(EngineLayoutCache &layoutCache){
+		EngineShaderReflection reflection = EnginePipeline::reflect({COMP_SHADER_PATH});
+		pushConstantSize = reflection.getPushConstantSize();
+		if (pushConstantSize > sizeof(ClusterPushConstantData)) throw std::runtime_error("cluster.comp push constants do not fit ClusterPushConstantData");
+		clusterSetLayout = &layoutCache.getSetLayout(reflection, 0);
+		pipelineLayout = layoutCache.getPipelineLayout(reflection);
+	}
+
+	void createBuffers(){
+		for (int i = 0; i < EngineSwapChain::MAX_FRAMES_IN_FLIGHT; i++){
+			lightBuffers.push_back(std::make_unique<EngineBuffer>(
+				engineDevice, sizeof(PointLight), maxLights,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+			lightBuffers.back()->map();
+			clusterBuffers.push_back(std::make_unique<EngineBuffer>(
+				engineDevice, sizeof(glm::uvec2), CLUSTER_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+			lightIndexBuffers.push_back(std::make_unique<EngineBuffer>(
+				engineDevice, sizeof(uint32_t), LIGHT_INDEX_CAPACITY + 1,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+		}
+	}
+
+	EngineDevice &engineDevice;
+	EngineDescriptorAllocator &descriptorAllocator;
+	uint32_t maxLights;
+	uint32_t lightCount = 0;
+
+	std::unique_ptr<EngineComputePipeline> pipeline;
+	VkPipelineLayout pipelineLayout;   // layouts are owned by the layout cache
+	uint32_t pushConstantSize = 0;
+	EngineDescriptorSetLayout *clusterSetLayout;
+
+	std::vector<std::unique_ptr<EngineBuffer>> lightBuffers;
+	std::vector<std::unique_ptr<EngineBuffer>> clusterBuffers;
+	std::vector<std::unique_ptr<EngineBuffer>> lightIndexBuffers;
+};
+
+} // namespace
+
+#endif
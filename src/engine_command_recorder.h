@@ -0,0 +1,150 @@
+#ifndef ENGINE_COMMAND_RECORDER_H
+#define ENGINE_COMMAND_RECORDER_H
+
+/*
+ * Parallel recording of the swap chain render pass into secondary command buffers
+ *
+ * There is one recording slot per job system thread, each owning one command pool per frame in
+ * flight. A slot is recorded by a single job at a time, so pools are never used concurrently, and
+ * a frame's pools are reset as a whole once its fence has signalled. beginFrame() begins one
+ * secondary buffer per slot inheriting the render pass and framebuffer, record() runs a task for
+ * every slot on the job system and execute() ends the buffers and executes them in slot order
+ * inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+ */
+
+#include "engine_device.h"
+#include "engine_swap_chain.h"
+#include "engine_job_system.h"
+
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+
+namespace Engine{
+
+class EngineCommandRecorder{
+public:
+
+	EngineCommandRecorder(EngineDevice &device, EngineJobSystem &jobSystem)
+		: engineDevice{device}, jobSystem{jobSystem}, slotCount{jobSystem.getThreadCount()} {
+		createCommandPools();
+	}
+
+	~EngineCommandRecorder() {
+		for (auto &pool : commandPools) vkDestroyCommandPool(engineDevice.device(), pool, nullptr);
+	}
+
+	EngineCommandRecorder(const EngineCommandRecorder &) = delete;
+	EngineCommandRecorder &operator=(const EngineCommandRecorder &) = delete;
+
+	uint32_t getSlotCount() const {return slotCount;}
+	EngineJobSystem &getJobSystem() {return jobSystem;}
+
+	// Wall time of the last record() call
+	float getRecordTime() const {return recordTime;}
+
+	// Pipeline statistics the secondary buffers inherit, must match the query active around the render pass
+	void setInheritedPipelineStatistics(VkQueryPipelineStatisticFlags flags) {inheritedPipelineStatistics = flags;}
+
+	// The frame's previous submission must have finished (Renderer::beginFrame waits on its fence)
+	void beginFrame(int frameIndex, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent){
+		currentFrame = frameIndex;
+		for (uint32_t slot = 0; slot < slotCount; slot++){
+			vkResetCommandPool(engineDevice.device(), commandPools[poolIndex(frameIndex, slot)], 0);
+		}
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = framebuffer;
+		inheritanceInfo.pipelineStatistics = inheritedPipelineStatistics;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		// Dynamic state is not inherited from the primary buffer
+		VkViewport viewport{0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+		VkRect2D scissor{{0, 0}, extent};
+
+		for (uint32_t slot = 0; slot < slotCount; slot++){
+			VkCommandBuffer commandBuffer = getCommandBuffer(slot);
+			if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+				throw std::runtime_error("failed to begin recording secondary command buffer!");
+			}
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		}
+	}
+
+	VkCommandBuffer getCommandBuffer(uint32_t slot) const {return commandBuffers[poolIndex(currentFrame, slot)];}
+
+	// Runs task(slot, commandBuffer) once for every slot as jobs and returns when all have finished
+	void record(const std::function<void(uint32_t, VkCommandBuffer)> &task){
+		auto start = std::chrono::high_resolution_clock::now();
+		jobSystem.parallelFor(slotCount, 1, [&](size_t begin, size_t end) {
+			for (size_t slot = begin; slot < end; slot++){
+				task(static_cast<uint32_t>(slot), getCommandBuffer(static_cast<uint32_t>(slot)));
+			}
+		});
+		recordTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+			std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Call between Renderer::beginSwapChainRenderPass(..., VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) and the end of the pass
+	void execute(VkCommandBuffer primaryCommandBuffer){
+		for (uint32_t slot = 0; slot < slotCount; slot++){
+			if (vkEndCommandBuffer(getCommandBuffer(slot)) != VK_SUCCESS){
+				throw std::runtime_error("failed to record secondary command buffer!");
+			}
+		}
+		vkCmdExecuteCommands(primaryCommandBuffer, slotCount, &commandBuffers[poolIndex(currentFrame, 0)]);
+	}
+
+private:
+
+	size_t poolIndex(int frameIndex, uint32_t slot) const {return size_t(frameIndex) * slotCount + slot;}
+
+	void createCommandPools(){
+		QueueFamilyIndices queueFamilyIndices = engineDevice.findPhysicalQueueFamilies();
+		size_t poolCount = size_t(EngineSwapChain::MAX_FRAMES_IN_FLIGHT) * slotCount;
+		commandPools.resize(poolCount);
+		commandBuffers.resize(poolCount);
+
+		for (size_t i = 0; i < poolCount; i++){
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			if (vkCreateCommandPool(engineDevice.device(), &poolInfo, nullptr, &commandPools[i]) != VK_SUCCESS){
+				throw std::runtime_error("failed to create command pool!");
+			}
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = commandPools[i];
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(engineDevice.device(), &allocInfo, &commandBuffers[i]) != VK_SUCCESS){
+				throw std::runtime_error("failed to allocate secondary command buffers!");
+			}
+		}
+	}
+
+	EngineDevice &engineDevice;
+	EngineJobSystem &jobSystem;
+	uint32_t slotCount;
+	int currentFrame = 0;
+	float recordTime = 0.0f;
+	VkQueryPipelineStatisticFlags inheritedPipelineStatistics = 0;
+
+	// Indexed [frame * slotCount + slot]
+	std::vector<VkCommandPool> commandPools;
+	std::vector<VkCommandBuffer> commandBuffers;
+};
+} // namespace
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef ENGINE_CULLING_H
+#define ENGINE_CULLING_H
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define ENGINE_CULLING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define ENGINE_CULLING_SSE
+#endif
+
+namespace Engine{
+
+// Six inward facing planes, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum{
+	enum Plane {Left = 0, Right, Bottom, Top, Near, Far, Count};
+	glm::vec4 planes[Count];
+};
+
+// Gribb/Hartmann plane extraction, for clip space depth in [0, 1] (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+inline Frustum extractFrustum(const glm::mat4 &projectionView){
+	auto row = [&](int i) {return glm::vec4{projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]};};
+
+	Frustum frustum{};
+	frustum.planes[Frustum::Left] = row(3) + row(0);
+	frustum.planes[Frustum::Right] = row(3) - row(0);
+	frustum.planes[Frustum::Bottom] = row(3) + row(1);
+	frustum.planes[Frustum::Top] = row(3) - row(1);
+	frustum.planes[Frustum::Near] = row(2);
+	frustum.planes[Frustum::Far] = row(3) - row(2);
+
+	for (auto &plane : frustum.planes){
+		plane /= glm::length(glm::vec3{plane});
+	}
+	return frustum;
+}
+
+// Bounding sphere (xyz centre, w radius) moved to world space, the radius grows with the largest axis scale
+inline glm::vec4 transformSphere(const glm::mat4 &meshMatrix, const glm::vec4 &sphere){
+	glm::vec3 centre = glm::vec3{meshMatrix * glm::vec4{glm::vec3{sphere}, 1.0f}};
+	float scale = std::max({
+		glm::length(glm::vec3{meshMatrix[0]}),
+		glm::length(glm::vec3{meshMatrix[1]}),
+		glm::length(glm::vec3{meshMatrix[2]})});
+	return glm::vec4{centre, sphere.w * scale};
+}
+
+// Scalar reference test, cull.comp implements the same test on the GPU
+inline bool sphereInFrustum(const Frustum &frustum, const glm::vec4 &sphere){
+	for (const auto &plane : frustum.planes){
+		if (glm::dot(glm::vec3{plane}, glm::vec3{sphere}) + plane.w < -sphere.w) return false;
+	}
+	return true;
+}
+
+// World space bounding spheres in structure of arrays layout, so the kernels load 4/8 objects per register
+struct CullingSpheres{
+	std::vector<float> x, y, z, radius;
+
+	void clear() {x.clear(); y.clear(); z.clear(); radius.clear();}
+	void reserve(size_t count) {x.reserve(count); y.reserve(count); z.reserve(count); radius.reserve(count);}
+	void resize(size_t count) {x.resize(count); y.resize(count); z.resize(count); radius.resize(count);}
+	void push(const glm::vec4 &sphere) {x.push_back(sphere.x); y.push_back(sphere.y); z.push_back(sphere.z); radius.push_back(sphere.w);}
+	void set(size_t i, const glm::vec4 &sphere) {x[i] = sphere.x; y[i] = sphere.y; z[i] = sphere.z; radius[i] = sphere.w;}
+	uint32_t size() const {return static_cast<uint32_t>(x.size());}
+};
+
+// Scalar kernel, writes the indices of visible spheres in order and returns how many there are
+inline uint32_t cullSpheresScalar(const Frustum &frustum, const CullingSpheres &spheres, uint32_t begin, uint32_t end, uint32_t *visible){
+	uint32_t visibleCount = 0;
+	for (uint32_t i = begin; i < end; i++){
+		bool inside = true;
+		for (const auto &plane : frustum.planes){
+			float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+			inside = inside && distance >= -spheres.radius[i];
+		}
+		if (inside) visible[visibleCount++] = i;
+	}
+	return visibleCount;
+}
+
+// Batched kernel over spheres [begin, end), AVX2 tests 8 spheres per iteration, SSE 4, otherwise the scalar kernel.
+// Same results and order as cullSpheresScalar, the SIMD paths use the same multiply-add order so rounding matches too.
+inline uint32_t cullSpheres(const Frustum &frustum, const CullingSpheres &spheres, uint32_t begin, uint32_t end, uint32_t *visible){
+	uint32_t count = end;
+	uint32_t visibleCount = 0;
+	uint32_t i = begin;
+
+#if defined(ENGINE_CULLING_AVX2)
+	__m256 planeX[Frustum::Count], planeY[Frustum::Count], planeZ[Frustum::Count], planeW[Frustum::Count];
+	for (int p = 0; p < Frustum::Count; p++){
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+	for (; i + 8 <= count; i += 8){
+		__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+		__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&spheres.radius[i]), signMask);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < Frustum::Count; p++){
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+		while (mask){
+			uint32_t bit = 0;
+			while (!(mask & (1u << bit))) bit++;
+			visible[visibleCount++] = i + bit;
+			mask &= mask - 1;
+		}
+	}
+#elif defined(ENGINE_CULLING_SSE)
+	__m128 planeX[Frustum::Count], planeY[Frustum::Count], planeZ[Frustum::Count], planeW[Frustum::Count];
+	for (int p = 0; p < Frustum::Count; p++){
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (; i + 4 <= count; i += 4){
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&spheres.radius[i]), signMask);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < Frustum::Count; p++){
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_mul_ps(planeZ[p], z)), planeW[p]);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+		while (mask){
+			uint32_t bit = 0;
+			while (!(mask & (1u << bit))) bit++;
+			visible[visibleCount++] = i + bit;
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	return visibleCount + cullSpheresScalar(frustum, spheres, i, count, visible + visibleCount);
+}
+
+inline uint32_t cullSpheres(const Frustum &frustum, const CullingSpheres &spheres, uint32_t *visible){
+	return cullSpheres(frustum, spheres, 0, spheres.size(), visible);
+}
+
+inline const char *cullingKernelName(){
+#if defined(ENGINE_CULLING_AVX2)
+	return "AVX2";
+#elif defined(ENGINE_CULLING_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+// Throughput of the batched and scalar kernels in objects/ns over random spheres, and a check that both agree
+inline bool benchmarkCulling(const glm::mat4 &projectionView, uint32_t objectCount = 1000000, int iterations = 20){
+	Frustum frustum = extractFrustum(projectionView);
+
+	std::mt19937 random{1234};
+	std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+	std::uniform_real_distribution<float> radius{0.1f, 2.0f};
+	CullingSpheres spheres;
+	spheres.reserve(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++){
+		spheres.push({position(random), position(random), position(random), radius(random)});
+	}
+
+	std::vector<uint32_t> visible(objectCount), reference(objectCount);
+	uint32_t visibleCount = 0, referenceCount = 0;
+
+	auto measure = [&](auto &&kernel) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; i++) kernel();
+		double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+		return double(objectCount) * iterations / nanoseconds;
+	};
+	double batchedRate = measure([&] {visibleCount = cullSpheres(frustum, spheres, visible.data());});
+	double scalarRate = measure([&] {referenceCount = cullSpheresScalar(frustum, spheres, 0, objectCount, reference.data());});
+
+	bool match = visibleCount == referenceCount && std::equal(visible.begin(), visible.begin() + visibleCount, reference.begin());
+	std::cout << "Culling " << objectCount << " spheres: " << cullingKernelName() << " " << batchedRate << " objects/ns, scalar "
+		<< scalarRate << " objects/ns, " << visibleCount << " visible, " << (match ? "matches" : "DOES NOT MATCH")
+		<< " scalar reference" << std::endl;
+	return match;
+}
+} // namespace
+
+#endif
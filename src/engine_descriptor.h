@@ -3,9 +3,11 @@
 
  
 #include "engine_device.h"
+#include "engine_swap_chain.h"
 #include <memory>
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
  
@@ -85,107 +87,180 @@ private:
 
 
 
-class EngineDescriptorPool {
+/*
+ * Per frame descriptor sets from growing pools
+ *
+ * Every frame in flight has its own list of pools. A set is allocated from the frame's newest pool,
+ * and when that one is full (out of pool memory or fragmented) another pool is taken from the free
+ * list or created, each new pool twice the size of the last up to MAX_SETS_PER_POOL. Sets are never
+ * freed one by one: beginFrame resets the frame's pools as a whole once its fence has signalled and
+ * hands them back to the free list, so per frame descriptor churn costs a few pool resets.
+ *
+ * getSet also caches sets by layout and writes for the frame, identical requests reuse the set.
+ * Sets live until their frame index comes around again, write them every frame. Not thread safe.
+ */
+class EngineDescriptorAllocator {
 public:
-  	class Builder {
-   	public:
-	    Builder(EngineDevice &engineDevice) : engineDevice{engineDevice} {}
-	 
-	    Builder &addPoolSize(VkDescriptorType descriptorType, uint32_t count){
-			poolSizes.push_back({descriptorType, count});
-			return *this;
-	    }
-
-	    Builder &setPoolFlags(VkDescriptorPoolCreateFlags flags){
-			poolFlags = flags;
-			return *this;
-	    }
-
-	    Builder &setMaxSets(uint32_t count){
-	    	maxSets = count;
-	  		return *this;
-	    }
-
-	    std::unique_ptr<EngineDescriptorPool> build() const{
-			return std::make_unique<EngineDescriptorPool>(engineDevice, maxSets, poolFlags, poolSizes);
-	    }
- 
-    private:
-    	EngineDevice &engineDevice;
-   	 	std::vector<VkDescriptorPoolSize> poolSizes{};
-    	uint32_t maxSets = 1000;
-    	VkDescriptorPoolCreateFlags poolFlags = 0;
-  };
- 
-  EngineDescriptorPool(
-      	EngineDevice &engineDevice,
-      	uint32_t maxSets,
-      	VkDescriptorPoolCreateFlags poolFlags,
-      	const std::vector<VkDescriptorPoolSize> &poolSizes) : engineDevice{engineDevice}
-  	{
-		VkDescriptorPoolCreateInfo descriptorPoolInfo{};
-		descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		descriptorPoolInfo.pPoolSizes = poolSizes.data();
-		descriptorPoolInfo.maxSets = maxSets;
-		descriptorPoolInfo.flags = poolFlags;
+	static constexpr uint32_t INITIAL_SETS_PER_POOL = 64;
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+	// Descriptors of each type a pool holds per set
+	struct PoolRatio{
+		VkDescriptorType type;
+		float perSet;
+	};
+
+	EngineDescriptorAllocator(EngineDevice &engineDevice, std::vector<PoolRatio> ratios = {
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}})
+	: engineDevice{engineDevice}, ratios{std::move(ratios)}, frames(EngineSwapChain::MAX_FRAMES_IN_FLIGHT) {}
+
+	~EngineDescriptorAllocator(){
+		for (auto &frame : frames){
+			for (VkDescriptorPool pool : frame.pools) vkDestroyDescriptorPool(engineDevice.device(), pool, nullptr);
+		}
+		for (VkDescriptorPool pool : freePools) vkDestroyDescriptorPool(engineDevice.device(), pool, nullptr);
+	}
 
-		if (vkCreateDescriptorPool(engineDevice.device(), &descriptorPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create descriptor pool!");
+	EngineDescriptorAllocator(const EngineDescriptorAllocator &) = delete;
+	EngineDescriptorAllocator &operator=(const EngineDescriptorAllocator &) = delete;
+
+	// The frame's previous submission has completed, its sets are released all at once
+	void beginFrame(int frameIndex){
+		FrameState &frame = frames[frameIndex];
+		for (VkDescriptorPool pool : frame.pools){
+			vkResetDescriptorPool(engineDevice.device(), pool, 0);
+			freePools.push_back(pool);
 		}
-  	}
+		frame.pools.clear();
+		frame.cache.clear();
+	}
 
-  	~EngineDescriptorPool(){
-		vkDestroyDescriptorPool(engineDevice.device(), descriptorPool, nullptr);
-  	}
+	// An unwritten set, valid until the frame index's next beginFrame
+	VkDescriptorSet allocate(int frameIndex, VkDescriptorSetLayout setLayout){
+		FrameState &frame = frames[frameIndex];
+		VkDescriptorSet set;
+		if (!frame.pools.empty() && tryAllocate(frame.pools.back(), setLayout, set)) return set;
+
+		// Full pools report out of pool memory or fragmentation, 1.0 drivers may report out of memory instead.
+		// Any of them moves on to a fresh pool, failing there is a real error.
+		frame.pools.push_back(acquirePool());
+		if (!tryAllocate(frame.pools.back(), setLayout, set)) throw std::runtime_error("failed to allocate descriptor set!");
+		return set;
+	}
 
-  	EngineDescriptorPool(const EngineDescriptorPool &) = delete;
-  	EngineDescriptorPool &operator=(const EngineDescriptorPool &) = delete;
- 
-  	bool allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet &descriptor) const{
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.pSetLayouts = &descriptorSetLayout;
-		allocInfo.descriptorSetCount = 1;
+	// A set with the writes applied, or the one an identical earlier request of this frame got
+	VkDescriptorSet getSet(int frameIndex, VkDescriptorSetLayout setLayout, std::vector<VkWriteDescriptorSet> &writes){
+		SetKey key{};
+		key.words.push_back(reinterpret_cast<uint64_t>(setLayout));
+		for (const auto &write : writes){
+			key.words.insert(key.words.end(), {write.dstBinding, write.dstArrayElement, uint64_t(write.descriptorType)});
+			for (uint32_t i = 0; i < write.descriptorCount; i++){
+				if (write.pBufferInfo){
+					const VkDescriptorBufferInfo &info = write.pBufferInfo[i];
+					key.words.insert(key.words.end(), {reinterpret_cast<uint64_t>(info.buffer), info.offset, info.range});
+				}
+				if (write.pImageInfo){
+					const VkDescriptorImageInfo &info = write.pImageInfo[i];
+					key.words.insert(key.words.end(), {reinterpret_cast<uint64_t>(info.sampler), reinterpret_cast<uint64_t>(info.imageView), uint64_t(info.imageLayout)});
+				}
+			}
+		}
 
-		// Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-		// a new pool whenever an old pool fills up. But this is beyond our current scope
-		if (vkAllocateDescriptorSets(engineDevice.device(), &allocInfo, &descriptor) != VK_SUCCESS) {
-			return false;
+		FrameState &frame = frames[frameIndex];
+		auto found = frame.cache.find(key);
+		if (found != frame.cache.end()){
+			cacheHits++;
+			return found->second;
 		}
-		return true;
-  	}
- 
-  	void freeDescriptors(std::vector<VkDescriptorSet> &descriptors) const{
-		vkFreeDescriptorSets(
-			engineDevice.device(),
-			descriptorPool,
-			static_cast<uint32_t>(descriptors.size()),
-			descriptors.data());
-  	}
- 
-	void resetPool(){
-		vkResetDescriptorPool(engineDevice.device(), descriptorPool, 0);
+
+		VkDescriptorSet set = allocate(frameIndex, setLayout);
+		for (auto &write : writes) write.dstSet = set;
+		vkUpdateDescriptorSets(engineDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		frame.cache.emplace(std::move(key), set);
+		return set;
 	}
- 
+
+	uint32_t getPoolCount() const {
+		uint32_t count = static_cast<uint32_t>(freePools.size());
+		for (const auto &frame : frames) count += static_cast<uint32_t>(frame.pools.size());
+		return count;
+	}
+	uint64_t getAllocationCount() const {return allocationCount;}
+	uint64_t getCacheHitCount() const {return cacheHits;}
+
 private:
-  	EngineDevice &engineDevice;
-  	VkDescriptorPool descriptorPool;
- 
-  	friend class EngineDescriptorWriter;
-};
- 
+	struct SetKey{
+		std::vector<uint64_t> words;
+		bool operator==(const SetKey &other) const {return words == other.words;}
+	};
+
+	// FNV-1a over the key words
+	struct SetKeyHash{
+		size_t operator()(const SetKey &key) const {
+			uint64_t hash = 14695981039346656037ull;
+			for (uint64_t word : key.words){
+				hash ^= word;
+				hash *= 1099511628211ull;
+			}
+			return static_cast<size_t>(hash);
+		}
+	};
 
+	struct FrameState{
+		std::vector<VkDescriptorPool> pools;   // allocating from the last one
+		std::unordered_map<SetKey, VkDescriptorSet, SetKeyHash> cache;
+	};
 
+	bool tryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout setLayout, VkDescriptorSet &set){
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.pSetLayouts = &setLayout;
+		allocInfo.descriptorSetCount = 1;
+		if (vkAllocateDescriptorSets(engineDevice.device(), &allocInfo, &set) != VK_SUCCESS) return false;
+		allocationCount++;
+		return true;
+	}
 
+	VkDescriptorPool acquirePool(){
+		if (!freePools.empty()){
+			VkDescriptorPool pool = freePools.back();
+			freePools.pop_back();
+			return pool;
+		}
 
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const auto &ratio : ratios){
+			poolSizes.push_back({ratio.type, std::max(1u, static_cast<uint32_t>(ratio.perSet * nextPoolSize))});
+		}
+		VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+		descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		descriptorPoolInfo.pPoolSizes = poolSizes.data();
+		descriptorPoolInfo.maxSets = nextPoolSize;
 
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(engineDevice.device(), &descriptorPoolInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+		nextPoolSize = std::min(nextPoolSize * 2, MAX_SETS_PER_POOL);
+		return pool;
+	}
 
+	EngineDevice &engineDevice;
+	std::vector<PoolRatio> ratios;
+	std::vector<FrameState> frames;
+	std::vector<VkDescriptorPool> freePools;   // reset, shared by all frames
+	uint32_t nextPoolSize = INITIAL_SETS_PER_POOL;
+	uint64_t allocationCount = 0;
+	uint64_t cacheHits = 0;
+};
 
 class EngineDescriptorWriter {
 public:
-	EngineDescriptorWriter(EngineDescriptorSetLayout &setLayout, EngineDescriptorPool &pool) : setLayout{setLayout}, pool{pool} {}
+	explicit EngineDescriptorWriter(EngineDescriptorSetLayout &setLayout) : setLayout{setLayout} {}
 	 
 	EngineDescriptorWriter &writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo){
 		assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
@@ -221,24 +296,19 @@ public:
 		return *this;
   	}
  
-  	bool build(VkDescriptorSet &set){
-		bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
-		if (!success) {
-			return false;
-		}
-		overwrite(set);
-		return true;
-  	}
   	void overwrite(VkDescriptorSet &set){
 		for (auto &write : writes) {
 			write.dstSet = set;
 		}
-		vkUpdateDescriptorSets(pool.engineDevice.device(), writes.size(), writes.data(), 0, nullptr);
+		vkUpdateDescriptorSets(setLayout.engineDevice.device(), writes.size(), writes.data(), 0, nullptr);
   	}
+	// This frame's set for the writes, see EngineDescriptorAllocator::getSet
+	VkDescriptorSet build(EngineDescriptorAllocator &allocator, int frameIndex){
+		return allocator.getSet(frameIndex, setLayout.getDescriptorSetLayout(), writes);
+	}
  
 private:
 	EngineDescriptorSetLayout &setLayout;
-	EngineDescriptorPool &pool;
 	std::vector<VkWriteDescriptorSet> writes;
 };
 }  // namespace 
@@ -8,8 +8,11 @@
 #include <iostream>
 #include <set>
 #include <unordered_set>
+#include <memory>
 
 #include "engine_window.h"
+#include "engine_allocator.h"
+#include "engine_pipeline_cache.h"
 
 namespace Engine{
 
@@ -22,8 +25,10 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   	uint32_t graphicsFamily;
   	uint32_t presentFamily;
+  	uint32_t transferFamily;     // dedicated transfer family when available, graphics otherwise
   	bool graphicsFamilyHasValue = false;
   	bool presentFamilyHasValue = false;
+  	bool transferFamilyHasValue = false;
   	bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -52,18 +57,24 @@ void DestroyDebugUtilsMessengerEXT(
 class EngineDevice {
 
 public:
-	const bool enableValidationLayers = true; // set false for distrobution
+	bool enableValidationLayers = true; // set false for distrobution, headless runs drop it when the layers are missing
 
-	EngineDevice(EngineWindow &window) : window{window} {
+	// A headless window skips the surface, the swap chain extension and the present queue
+	EngineDevice(EngineWindow &window) : window{window}, headless{window.isHeadless()} {
 		createInstance();
 		setupDebugMessenger();
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
 		createCommandPool();
+		createAllocator();
+		createPipelineCache();
 	}
 
 	~EngineDevice() {
+		if (!pipelineCache_->save()) std::cerr << "failed to save pipeline cache" << std::endl;
+		pipelineCache_.reset();
+		allocator_.reset();
 		vkDestroyCommandPool(device_, commandPool, nullptr);
 		vkDestroyDevice(device_, nullptr);
 
@@ -86,19 +97,29 @@ public:
 	VkSurfaceKHR surface() { return surface_; }
 	VkQueue graphicsQueue() { return graphicsQueue_; }
 	VkQueue presentQueue() { return presentQueue_; }
+	VkQueue transferQueue() { return transferQueue_; }
+	bool hasDedicatedTransferQueue() { return queueFamilies_.transferFamily != queueFamilies_.graphicsFamily; }
+	EngineMemoryAllocator &allocator() { return *allocator_; }
+	// Shared by every pipeline, loaded from and saved to EnginePipelineCache::DEFAULT_PATH
+	VkPipelineCache pipelineCache() { return pipelineCache_->getPipelineCache(); }
+	EnginePipelineCache &pipelineCacheStore() { return *pipelineCache_; }
+	const VkPhysicalDeviceFeatures &enabledFeatures() { return enabledFeatures_; }
+	// Descriptor indexing for EngineBindlessTable, needs a Vulkan 1.2 loader and device
+	bool bindlessSupported() const { return bindlessSupported_; }
+	// vkGetPhysicalDeviceProperties2 of the selected device, only available when bindlessSupported()
+	void getPhysicalDeviceProperties2(VkPhysicalDeviceProperties2 *properties2) {
+		if (!getPhysicalDeviceProperties2_) throw std::runtime_error("vkGetPhysicalDeviceProperties2 is not available!");
+		getPhysicalDeviceProperties2_(physicalDevice, properties2);
+	}
 
 	SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
+	VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
+	bool isHeadless() const { return headless; }
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) &&
-				(memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
-			}
-  		}
-  		throw std::runtime_error("failed to find suitable memory type!");
+		return EngineMemoryAllocator::findMemoryType(memProperties, typeFilter, properties);
 	}
 
 	QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
@@ -123,12 +144,13 @@ public:
 	}
 
 	// Buffer Helper Functions
+	// Memory is sub-allocated from shared blocks, release it with destroyBuffer
 	void createBuffer(
 	    VkDeviceSize size,
 	    VkBufferUsageFlags usage,
 	    VkMemoryPropertyFlags properties,
 	    VkBuffer &buffer,
-	    VkDeviceMemory &bufferMemory) {
+	    EngineAllocation &allocation) {
 
 			VkBufferCreateInfo bufferInfo{};
 			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -136,6 +158,14 @@ public:
 			bufferInfo.usage = usage;
 			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+			// Buffers filled on the transfer queue are read on the graphics queue without ownership transfers
+			uint32_t sharedFamilies[] = {queueFamilies_.graphicsFamily, queueFamilies_.transferFamily};
+			if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && hasDedicatedTransferQueue()) {
+				bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+				bufferInfo.queueFamilyIndexCount = 2;
+				bufferInfo.pQueueFamilyIndices = sharedFamilies;
+			}
+
 			if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
 				throw std::runtime_error("failed to create vertex buffer!");
 			}
@@ -143,16 +173,16 @@ public:
 			VkMemoryRequirements memRequirements;
 			vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-			VkMemoryAllocateInfo allocInfo{};
-			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			allocInfo.allocationSize = memRequirements.size;
-			allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+			allocation = allocator_->allocate(memRequirements, properties);
 
-			if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-				throw std::runtime_error("failed to allocate vertex buffer memory!");
+			if (vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+				throw std::runtime_error("failed to bind buffer memory!");
 			}
+	}
 
-			vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+	void destroyBuffer(VkBuffer buffer, EngineAllocation &allocation) {
+		vkDestroyBuffer(device_, buffer, nullptr);
+		allocator_->free(allocation);
 	}
 
 	VkCommandBuffer beginSingleTimeCommands() {
@@ -259,7 +289,9 @@ public:
 private:
 	void createInstance(){
 		if (enableValidationLayers && !checkValidationLayerSupport()) {
-    		throw std::runtime_error("validation layers requested, but not available!");
+			if (!headless) throw std::runtime_error("validation layers requested, but not available!");
+			std::cerr << "validation layers not available, running headless without them" << std::endl;
+			enableValidationLayers = false;
   		}
 
 		VkApplicationInfo appInfo = {};
@@ -268,7 +300,9 @@ private:
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		// 1.2 when the loader has it, for descriptor indexing, everything else only needs 1.0
+		instanceApiVersion = loaderApiVersion() >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : VK_API_VERSION_1_0;
+		appInfo.apiVersion = instanceApiVersion;
 
 		VkInstanceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -322,7 +356,10 @@ private:
   		}
 	}
 	
-	void createSurface(){window.createWindowSurface(instance, &surface_);}
+	void createSurface(){
+		if (headless) return;
+		window.createWindowSurface(instance, &surface_);
+	}
 
 	void pickPhysicalDevice(){
 		uint32_t deviceCount = 0;
@@ -352,9 +389,10 @@ private:
 
 	void createLogicalDevice(){
 		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+		queueFamilies_ = indices;
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+		std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, indices.transferFamily};
 
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -366,18 +404,66 @@ private:
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance; // optional, GPU culling
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;     // optional, GPU profiler
+		deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;                   // optional, GPU profiler
+		enabledFeatures_ = deviceFeatures;
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+		// optional, bindless resources, core in Vulkan 1.2
+		VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		if (instanceApiVersion >= VK_API_VERSION_1_2 && properties.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing = {};
+			supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+			VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+			supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures2.pNext = &supportedIndexing;
+
+			// Loaded at runtime, linking the 1.1 entry points directly fails on a 1.0 loader
+			auto getPhysicalDeviceFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(
+				vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2"));
+			getPhysicalDeviceProperties2_ = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2>(
+				vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2"));
+			if (getPhysicalDeviceFeatures2 && getPhysicalDeviceProperties2_) getPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+			// The bindless shaders index the storage buffer array with a dynamically uniform push constant
+			bindlessSupported_ = getPhysicalDeviceFeatures2 && getPhysicalDeviceProperties2_ &&
+				supportedFeatures.shaderStorageBufferArrayDynamicIndexing &&
+				supportedIndexing.runtimeDescriptorArray &&
+				supportedIndexing.descriptorBindingPartiallyBound &&
+				supportedIndexing.descriptorBindingUpdateUnusedWhilePending &&
+				supportedIndexing.descriptorBindingStorageBufferUpdateAfterBind &&
+				supportedIndexing.descriptorBindingSampledImageUpdateAfterBind;
+			if (bindlessSupported_) {
+				indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+				indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+				indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+				indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+				indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+				indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = supportedIndexing.shaderStorageBufferArrayNonUniformIndexing;
+				indexingFeatures.shaderSampledImageArrayNonUniformIndexing = supportedIndexing.shaderSampledImageArrayNonUniformIndexing;
+				createInfo.pNext = &indexingFeatures;
+				deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+				deviceFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+				enabledFeatures_ = deviceFeatures;
+			}
+		}
+
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		auto extensions = getDeviceExtensions();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		// might not really be necessary anymore because device specific validation layers
 		// have been deprecated
@@ -397,6 +483,21 @@ private:
 
 		vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
 		vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+		vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+
+		if (hasDedicatedTransferQueue()) std::cout << "transfer queue family: " << indices.transferFamily << std::endl;
+	}
+
+	void createAllocator(){
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		allocator_ = std::make_unique<EngineMemoryAllocator>(device_, memProperties, properties.limits.nonCoherentAtomSize);
+	}
+
+	void createPipelineCache(){
+		pipelineCache_ = std::make_unique<EnginePipelineCache>(device_, properties);
+		std::cout << "pipeline cache: " << (pipelineCache_->wasLoaded() ? "loaded" : "empty") << ", "
+			<< pipelineCache_->dataSize() << " bytes" << std::endl;
 	}
 
 	void createCommandPool(){
@@ -418,8 +519,8 @@ private:
 
 		bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported) {
+		bool swapChainAdequate = headless;
+		if (extensionsSupported && !headless) {
 		    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		    swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 		}
@@ -432,11 +533,13 @@ private:
 
 
 	std::vector<const char *> getRequiredExtensions(){
-		uint32_t glfwExtensionCount = 0;
-		const char **glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		std::vector<const char *> extensions;
+		if (!headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char **glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers) {
 		    extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -485,8 +588,10 @@ private:
 		  		indices.graphicsFamily = i;
 		  		indices.graphicsFamilyHasValue = true;
 			}
+			// Nothing is presented headless, the graphics queue stands in for the present queue
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+			if (headless) presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			else vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
 			if (queueFamily.queueCount > 0 && presentSupport) {
 		  		indices.presentFamily = i;
 		  		indices.presentFamilyHasValue = true;
@@ -496,6 +601,19 @@ private:
 		i++;
 		}
 
+		// Prefer a transfer-only family (DMA engine) so uploads run beside rendering
+		indices.transferFamily = indices.graphicsFamily;
+		indices.transferFamilyHasValue = indices.graphicsFamilyHasValue;
+		for (uint32_t family = 0; family < queueFamilyCount; family++) {
+			VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if (queueFamilies[family].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+				!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = family;
+				indices.transferFamilyHasValue = true;
+				break;
+			}
+		}
+
 		return indices;
 	}
 
@@ -535,6 +653,15 @@ private:
 		}
 	}
 
+	// Highest instance version the loader supports, vkEnumerateInstanceVersion is missing from 1.0 loaders
+	static uint32_t loaderApiVersion(){
+		auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+			vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+		uint32_t version = VK_API_VERSION_1_0;
+		if (enumerateInstanceVersion && enumerateInstanceVersion(&version) != VK_SUCCESS) version = VK_API_VERSION_1_0;
+		return version;
+	}
+
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device){
 		uint32_t extensionCount;
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -542,6 +669,7 @@ private:
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
+		auto deviceExtensions = getDeviceExtensions();
 		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 		for (const auto &extension : availableExtensions) {
@@ -551,6 +679,11 @@ private:
 		return requiredExtensions.empty();
 	}
 
+	std::vector<const char *> getDeviceExtensions(){
+		if (headless) return {};
+		return deviceExtensions;
+	}
+
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device){
 		SwapChainSupportDetails details;
 		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &details.capabilities);
@@ -577,12 +710,21 @@ private:
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	EngineWindow &window;
+	bool headless;
 	VkCommandPool commandPool;
 
 	VkDevice device_;
-	VkSurfaceKHR surface_;
+	VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 	VkQueue graphicsQueue_;
 	VkQueue presentQueue_;
+	VkQueue transferQueue_;
+	QueueFamilyIndices queueFamilies_;
+	VkPhysicalDeviceFeatures enabledFeatures_{};
+	uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+	bool bindlessSupported_ = false;
+	PFN_vkGetPhysicalDeviceProperties2 getPhysicalDeviceProperties2_ = nullptr;
+	std::unique_ptr<EngineMemoryAllocator> allocator_;
+	std::unique_ptr<EnginePipelineCache> pipelineCache_;
 
 	const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 	const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
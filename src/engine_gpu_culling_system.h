@@ -0,0 +1,340 @@
+#ifndef ENGINE_GPU_CULLING_SYSTEM_H
+#define ENGINE_GPU_CULLING_SYSTEM_H
+
+/*
+ * GPU driven frustum culling
+ *
+ * Object transforms and bounding spheres live in a device local storage buffer. Every frame a
+ * compute pass (cull.comp) tests each object against the camera frustum and compacts the
+ * survivors into this frame's instance buffer, counting them into one VkDrawIndexedIndirectCommand
+ * per mesh. RenderSystem::renderIndirect then records one indirect draw per mesh, so the CPU cost
+ * of a frame does not depend on the object count.
+ *
+ * Per mesh instance ranges start at a non zero firstInstance, which needs drawIndirectFirstInstance.
+ * Check isSupported() and fall back to RenderSystem::renderGameObjects without it.
+ *
+ * With a bindless table the instance buffers are registered in it for a bindless RenderSystem,
+ * see getInstanceBufferHandle, instead of getting their own descriptor sets.
+ */
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "engine_pipeline.h"
+#include "engine_device.h"
+#include "engine_game_object.h"
+#include "engine_frame_info.h"
+#include "engine_buffer.h"
+#include "engine_descriptor.h"
+#include "engine_layout_cache.h"
+#include "engine_bindless.h"
+#include "engine_swap_chain.h"
+#include "engine_upload_manager.h"
+#include "engine_render_system.h"
+#include "engine_culling.h"
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+namespace Engine{
+
+// Matches ObjectData in cull.comp (std430)
+struct CullObjectData{
+	glm::mat4 meshMatrix{1.0f};
+	glm::mat4 normalMatrix{1.0f};
+	glm::vec4 boundingSphere{0.0f};
+	uint32_t meshIndex = 0;
+	uint32_t padding[3]{};
+};
+
+struct CullPushConstantData{
+	glm::vec4 planes[Frustum::Count];
+	uint32_t objectCount = 0;
+	uint32_t padding[3]{};
+};
+
+class GpuCullingSystem{
+public:
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+	static constexpr const char *COMP_SHADER_PATH = ENGINE_SHADER_DIR "cull.comp.spv";
+
+	GpuCullingSystem(
+		EngineDevice& device,
+		EngineUploadManager &uploadManager,
+		EngineLayoutCache &layoutCache,
+		EngineDescriptorAllocator &descriptorAllocator,
+		bool validate = false,
+		EngineBindlessTable *bindlessTable = nullptr)
+	: engineDevice{device}, uploadManager{uploadManager}, descriptorAllocator{descriptorAllocator}, validate{validate}, bindlessTable{bindlessTable}
+	{
+		createLayouts(layoutCache);
+		pipeline = std::make_unique<EngineComputePipeline>(engineDevice, COMP_SHADER_PATH, pipelineLayout);
+	}
+
+	~GpuCullingSystem(){
+		for (auto handle : instanceHandles) bindlessTable->releaseBuffer(handle);
+	}
+
+	GpuCullingSystem(const GpuCullingSystem &) = delete;
+	GpuCullingSystem &operator=(const GpuCullingSystem &) = delete;
+
+	static bool isSupported(EngineDevice &device) {return device.enabledFeatures().drawIndirectFirstInstance == VK_TRUE;}
+
+	// Uploads the object set with the store's current world matrices, call again whenever objects are added, removed or moved.
+	// Waits for the GPU to go idle.
+	void setObjects(const std::vector<EngineGameObject> &gameObjects, const EngineTransformStore &transforms){
+		vkDeviceWaitIdle(engineDevice.device());
+
+		meshes.clear();
+		objects.clear();
+		std::unordered_map<EngineMesh *, uint32_t> meshLookup;
+		std::vector<uint32_t> meshObjectCounts;
+
+		for (auto &obj : gameObjects){
+			if (!obj.mesh || !obj.mesh->hasIndices()) continue;
+			auto result = meshLookup.try_emplace(obj.mesh.get(), static_cast<uint32_t>(meshes.size()));
+			if (result.second) {meshes.push_back(obj.mesh); meshObjectCounts.push_back(0);}
+
+			CullObjectData object{};
+			object.meshMatrix = transforms.getWorldMatrix(obj.transform);
+			object.normalMatrix = transforms.getNormalMatrix(obj.transform);
+			object.boundingSphere = obj.mesh->getBoundingSphere();
+			object.meshIndex = result.first->second;
+			objects.push_back(object);
+			meshObjectCounts[object.meshIndex]++;
+		}
+
+		// Every mesh owns a range of the instance buffer large enough for all of its objects
+		drawTemplate.resize(meshes.size());
+		uint32_t firstInstance = 0;
+		for (size_t i = 0; i < meshes.size(); i++){
+			drawTemplate[i].indexCount = meshes[i]->getIndexCount();
+			drawTemplate[i].instanceCount = 0;
+			drawTemplate[i].firstIndex = 0;
+			drawTemplate[i].vertexOffset = 0;
+			drawTemplate[i].firstInstance = firstInstance;
+			firstInstance += meshObjectCounts[i];
+		}
+
+		createBuffers();
+		if (objects.empty()) return;
+
+		uploadTicket = uploadManager.uploadBuffer(*objectBuffer, objects.data(), sizeof(CullObjectData) * objects.size());
+		uploadTicket = uploadManager.uploadBuffer(*drawTemplateBuffer, drawTemplate.data(), sizeof(VkDrawIndexedIndirectCommand) * drawTemplate.size());
+		frameFrustums.assign(EngineSwapChain::MAX_FRAMES_IN_FLIGHT, Frustum{});
+		readbackPending.assign(EngineSwapChain::MAX_FRAMES_IN_FLIGHT, false);
+	}
+
+	// Records the cull pass, outside of any render pass. Returns false while uploads are pending, draw with the CPU path then.
+	bool cull(FrameInfo &frameInfo){
+		if (objects.empty() || !uploadManager.isComplete(uploadTicket)) return false;
+		for (auto &mesh : meshes) {if (!mesh->isReady()) return false;}
+
+		int frameIndex = frameInfo.frameIndex;
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+		if (validate) checkReadback(frameIndex);
+
+		// Reset instance counts from the template
+		VkBufferCopy templateCopy{0, 0, sizeof(VkDrawIndexedIndirectCommand) * drawTemplate.size()};
+		vkCmdCopyBuffer(commandBuffer, drawTemplateBuffer->getBuffer(), drawBuffers[frameIndex]->getBuffer(), 1, &templateCopy);
+
+		VkMemoryBarrier resetBarrier{};
+		resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+		CullPushConstantData push{};
+		Frustum frustum = extractFrustum(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+		for (int i = 0; i < Frustum::Count; i++) push.planes[i] = frustum.planes[i];
+		push.objectCount = static_cast<uint32_t>(objects.size());
+		frameFrustums[frameIndex] = frustum;
+
+		// this frame's sets, the instance set is bound later by RenderSystem::renderIndirect
+		auto objectInfo = objectBuffer->descriptorInfo();
+		auto drawInfo = drawBuffers[frameIndex]->descriptorInfo();
+		auto instanceInfo = instanceBuffers[frameIndex]->descriptorInfo();
+		VkDescriptorSet cullSet = EngineDescriptorWriter(*cullSetLayout)
+		.writeBuffer(0, &objectInfo)
+		.writeBuffer(1, &drawInfo)
+		.writeBuffer(2, &instanceInfo)
+		.build(descriptorAllocator, frameIndex);
+		if (!bindlessTable){
+			instanceDescriptorSet = EngineDescriptorWriter(*instanceSetLayout)
+			.writeBuffer(0, &instanceInfo)
+			.build(descriptorAllocator, frameIndex);
+		}
+
+		pipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &cullSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, &push);
+		vkCmdDispatch(commandBuffer, (push.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+		if (validate){
+			vkCmdCopyBuffer(commandBuffer, drawBuffers[frameIndex]->getBuffer(), readbackBuffers[frameIndex]->getBuffer(), 1, &templateCopy);
+
+			// Makes the copy visible to checkReadback once the frame's fence has signalled
+			VkMemoryBarrier readbackBarrier{};
+			readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+			readbackPending[frameIndex] = true;
+		}
+		return true;
+	}
+
+	const std::vector<std::shared_ptr<EngineMesh>> &getMeshes() const {return meshes;}
+	uint32_t getObjectCount() const {return static_cast<uint32_t>(objects.size());}
+	VkBuffer getDrawBuffer(int frameIndex) const {return drawBuffers[frameIndex]->getBuffer();}
+	// Written by this frame's cull call
+	VkDescriptorSet getInstanceDescriptorSet() const {return instanceDescriptorSet;}
+	EngineResourceHandle getInstanceBufferHandle(int frameIndex) const {return instanceHandles[frameIndex];}
+
+private:
+
+	void createLayouts(EngineLayoutCache &layoutCache){
+		EngineShaderReflection reflection = EnginePipeline::reflect({COMP_SHADER_PATH});
+		pushConstantSize = reflection.getPushConstantSize();
+		if (pushConstantSize > sizeof(CullPushConstantData)) throw std::runtime_error("cull.comp push constants do not fit CullPushConstantData");
+		cullSetLayout = &layoutCache.getSetLayout(reflection, 0);
+		pipelineLayout = layoutCache.getPipelineLayout(reflection);
+
+		// The same layout object as RenderSystem's instance set, so the sets are compatible with its pipeline
+		if (bindlessTable) return;
+		EngineShaderReflection renderReflection = EnginePipeline::reflect({RenderSystem::VERT_SHADER_PATH, RenderSystem::FRAG_SHADER_PATH});
+		instanceSetLayout = &layoutCache.getSetLayout(renderReflection, 1);
+	}
+
+	void createBuffers(){
+		for (auto handle : instanceHandles) bindlessTable->releaseBuffer(handle);
+		instanceHandles.clear();
+		drawBuffers.clear();
+		instanceBuffers.clear();
+		readbackBuffers.clear();
+		if (objects.empty()) return;
+
+		objectBuffer = std::make_unique<EngineBuffer>(
+			engineDevice, sizeof(CullObjectData), static_cast<uint32_t>(objects.size()),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		drawTemplateBuffer = std::make_unique<EngineBuffer>(
+			engineDevice, sizeof(VkDrawIndexedIndirectCommand), static_cast<uint32_t>(drawTemplate.size()),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		for (int i = 0; i < EngineSwapChain::MAX_FRAMES_IN_FLIGHT; i++){
+			drawBuffers.push_back(std::make_unique<EngineBuffer>(
+				engineDevice, sizeof(VkDrawIndexedIndirectCommand), static_cast<uint32_t>(drawTemplate.size()),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+			instanceBuffers.push_back(std::make_unique<EngineBuffer>(
+				engineDevice, sizeof(InstanceData), static_cast<uint32_t>(objects.size()),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+			if (validate){
+				readbackBuffers.push_back(std::make_unique<EngineBuffer>(
+					engineDevice, sizeof(VkDrawIndexedIndirectCommand), static_cast<uint32_t>(drawTemplate.size()),
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+				readbackBuffers.back()->map();
+			}
+			if (bindlessTable) instanceHandles.push_back(bindlessTable->registerBuffer(*instanceBuffers.back()));
+		}
+	}
+
+	// Relative to the magnitude of the plane test's terms, covers the GPU's own float rounding (and FMA)
+	static constexpr float PLANE_TOLERANCE = 1e-4f;
+
+	// 1 visible, -1 culled, 0 within tolerance of a plane where the GPU may decide either way
+	static int classifySphere(const Frustum &frustum, const glm::vec4 &sphere){
+		int result = 1;
+		for (const auto &plane : frustum.planes){
+			float dot = glm::dot(glm::vec3{plane}, glm::vec3{sphere});
+			float distance = dot + plane.w + sphere.w;
+			float tolerance = PLANE_TOLERANCE * (std::abs(dot) + std::abs(plane.w) + sphere.w + 1.0f);
+			if (distance < -tolerance) return -1;
+			if (distance <= tolerance) result = 0;
+		}
+		return result;
+	}
+
+	// The frame's previous submission has completed, compare its GPU visible counts with the scalar reference.
+	// Objects near a plane may count either way and are reported separately.
+	void checkReadback(int frameIndex){
+		if (!readbackPending[frameIndex]) return;
+		readbackPending[frameIndex] = false;
+
+		readbackBuffers[frameIndex]->invalidate();
+		auto *commands = static_cast<const VkDrawIndexedIndirectCommand *>(readbackBuffers[frameIndex]->getMappedMemory());
+
+		std::vector<uint32_t> expected(meshes.size(), 0), nearPlane(meshes.size(), 0);
+		for (const auto &object : objects){
+			int visibility = classifySphere(frameFrustums[frameIndex], transformSphere(object.meshMatrix, object.boundingSphere));
+			if (visibility > 0) expected[object.meshIndex]++;
+			else if (visibility == 0) nearPlane[object.meshIndex]++;
+		}
+
+		uint32_t gpuVisible = 0, cpuVisible = 0, cpuNearPlane = 0, mismatchedMeshes = 0;
+		for (size_t i = 0; i < meshes.size(); i++){
+			gpuVisible += commands[i].instanceCount;
+			cpuVisible += expected[i];
+			cpuNearPlane += nearPlane[i];
+			if (commands[i].instanceCount < expected[i] || commands[i].instanceCount > expected[i] + nearPlane[i]) mismatchedMeshes++;
+		}
+		if (mismatchedMeshes > 0 || ++validatedFrames % 120 == 0){
+			std::cout << "GPU culling: " << gpuVisible << " visible, CPU reference " << cpuVisible << " + " << cpuNearPlane
+				<< " near a plane (" << mismatchedMeshes << " meshes differ)" << std::endl;
+		}
+	}
+
+	EngineDevice& engineDevice;
+	EngineUploadManager &uploadManager;
+	EngineDescriptorAllocator &descriptorAllocator;
+	bool validate;
+
+	std::unique_ptr<EngineComputePipeline> pipeline;
+	VkPipelineLayout pipelineLayout;   // layouts are owned by the layout cache
+	uint32_t pushConstantSize = 0;
+	EngineDescriptorSetLayout *cullSetLayout;
+	EngineDescriptorSetLayout *instanceSetLayout = nullptr;
+	EngineBindlessTable *bindlessTable;   // registers the instance buffers instead of instanceSetLayout sets when set
+
+	std::vector<std::shared_ptr<EngineMesh>> meshes;
+	std::vector<CullObjectData> objects;
+	std::vector<VkDrawIndexedIndirectCommand> drawTemplate;
+	EngineUploadTicket uploadTicket{};
+
+	std::unique_ptr<EngineBuffer> objectBuffer;
+	std::unique_ptr<EngineBuffer> drawTemplateBuffer;
+	std::vector<std::unique_ptr<EngineBuffer>> drawBuffers;
+	std::vector<std::unique_ptr<EngineBuffer>> instanceBuffers;
+	VkDescriptorSet instanceDescriptorSet = VK_NULL_HANDLE;   // this frame's, from the descriptor allocator
+	std::vector<EngineResourceHandle> instanceHandles;
+
+	// Validation
+	std::vector<std::unique_ptr<EngineBuffer>> readbackBuffers;
+	std::vector<Frustum> frameFrustums;
+	std::vector<bool> readbackPending;
+	uint32_t validatedFrames = 0;
+};
+
+} // namespace
+
+#endif
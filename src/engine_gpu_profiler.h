@@ -0,0 +1,246 @@
+#ifndef ENGINE_GPU_PROFILER_H
+#define ENGINE_GPU_PROFILER_H
+
+/*
+ * GPU timestamp and pipeline statistics queries
+ *
+ * Every frame in flight has its own query pools. beginFrame() reads back the results the frame
+ * wrote last time round, whose fence Renderer::beginFrame has already waited on, so reading never
+ * stalls, then resets the pools for the new frame. beginScope()/endScope() write timestamps and may
+ * be used in primary or secondary command buffers outside of reset; the pipeline statistics query
+ * wraps the whole swap chain render pass.
+ *
+ * Timestamps need timestampComputeAndGraphics (or non-zero timestampValidBits on the graphics
+ * family), statistics need the pipelineStatisticsQuery and inheritedQueries features because the
+ * pass executes secondary command buffers. Missing support turns the matching part into a no-op.
+ *
+ * With ENGINE_ENABLE_PROFILER the scopes are also sent to EngineProfiler on a GPU track, placed on
+ * the CPU timeline through a one-off calibration of the two clocks.
+ */
+
+#include "engine_device.h"
+#include "engine_swap_chain.h"
+#include "engine_profiler.h"
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+namespace Engine{
+
+struct EngineGpuScopeResult{
+	const char *name;
+	double milliseconds;
+};
+
+struct EngineGpuPipelineStatistics{
+	uint64_t vertexShaderInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentShaderInvocations = 0;
+};
+
+class EngineGpuProfiler{
+public:
+	static constexpr uint32_t MAX_SCOPES = 32;
+
+	static constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	EngineGpuProfiler(EngineDevice &device, bool enablePipelineStatistics) : engineDevice{device} {
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(engineDevice.getPhysicalDevice(), &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(engineDevice.getPhysicalDevice(), &familyCount, families.data());
+		uint32_t validBits = families[engineDevice.findPhysicalQueueFamilies().graphicsFamily].timestampValidBits;
+
+		timestampsSupported = engineDevice.properties.limits.timestampComputeAndGraphics || validBits > 0;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		timestampPeriod = engineDevice.properties.limits.timestampPeriod;
+		statisticsSupported = enablePipelineStatistics &&
+			engineDevice.enabledFeatures().pipelineStatisticsQuery && engineDevice.enabledFeatures().inheritedQueries;
+
+		if (!timestampsSupported) std::cerr << "GPU timestamps are not supported, GPU scopes are disabled" << std::endl;
+		if (enablePipelineStatistics && !statisticsSupported) std::cerr << "pipeline statistics queries are not supported" << std::endl;
+
+		frames.resize(EngineSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (auto &frame : frames) createQueryPools(frame);
+		calibrate();
+	}
+
+	~EngineGpuProfiler() {
+		for (auto &frame : frames){
+			if (frame.timestampPool != VK_NULL_HANDLE) vkDestroyQueryPool(engineDevice.device(), frame.timestampPool, nullptr);
+			if (frame.statisticsPool != VK_NULL_HANDLE) vkDestroyQueryPool(engineDevice.device(), frame.statisticsPool, nullptr);
+		}
+	}
+
+	EngineGpuProfiler(const EngineGpuProfiler &) = delete;
+	EngineGpuProfiler &operator=(const EngineGpuProfiler &) = delete;
+
+	bool hasTimestamps() const {return timestampsSupported;}
+	bool hasPipelineStatistics() const {return statisticsSupported;}
+
+	// Flags secondary buffers must inherit while the statistics query is active, 0 without statistics
+	VkQueryPipelineStatisticFlags inheritedPipelineStatistics() const {return statisticsSupported ? PIPELINE_STATISTICS : 0;}
+
+	// Call on the frame's primary command buffer before the render pass, after Renderer::beginFrame
+	void beginFrame(int frameIndex, VkCommandBuffer commandBuffer){
+		currentFrame = frameIndex;
+		FrameQueries &frame = frames[frameIndex];
+		readResults(frame);
+
+		frame.scopeNames.clear();
+		frame.statisticsWritten = false;
+		if (timestampsSupported) vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, MAX_SCOPES * 2);
+		if (statisticsSupported) vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, 1);
+	}
+
+	// Returns the scope id for endScope, scopes past MAX_SCOPES in a frame are dropped
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char *name){
+		FrameQueries &frame = frames[currentFrame];
+		if (!timestampsSupported || frame.scopeNames.size() >= MAX_SCOPES) return MAX_SCOPES;
+
+		uint32_t scope = static_cast<uint32_t>(frame.scopeNames.size());
+		frame.scopeNames.push_back(name);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, scope * 2);
+		return scope;
+	}
+
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope){
+		if (scope >= MAX_SCOPES) return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames[currentFrame].timestampPool, scope * 2 + 1);
+	}
+
+	// Outside the render pass on the primary buffer, around beginSwapChainRenderPass/endSwapChainRenderPass
+	void beginStatistics(VkCommandBuffer commandBuffer){
+		if (!statisticsSupported) return;
+		vkCmdBeginQuery(commandBuffer, frames[currentFrame].statisticsPool, 0, 0);
+		frames[currentFrame].statisticsWritten = true;
+	}
+
+	void endStatistics(VkCommandBuffer commandBuffer){
+		if (!statisticsSupported) return;
+		vkCmdEndQuery(commandBuffer, frames[currentFrame].statisticsPool, 0);
+	}
+
+	// Results of the most recently completed frame
+	const std::vector<EngineGpuScopeResult> &getScopeResults() const {return scopeResults;}
+	double getFrameMilliseconds() const {return frameMilliseconds;}   // first scope begin to last scope end
+	const EngineGpuPipelineStatistics &getPipelineStatistics() const {return statistics;}
+
+private:
+
+	struct FrameQueries{
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		std::vector<const char *> scopeNames;   // scopes written by the frame's last recording
+		bool statisticsWritten = false;
+	};
+
+	void createQueryPools(FrameQueries &frame){
+		if (timestampsSupported){
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			poolInfo.queryCount = MAX_SCOPES * 2;
+			if (vkCreateQueryPool(engineDevice.device(), &poolInfo, nullptr, &frame.timestampPool) != VK_SUCCESS){
+				throw std::runtime_error("failed to create timestamp query pool!");
+			}
+		}
+		if (statisticsSupported){
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			poolInfo.queryCount = 1;
+			poolInfo.pipelineStatistics = PIPELINE_STATISTICS;
+			if (vkCreateQueryPool(engineDevice.device(), &poolInfo, nullptr, &frame.statisticsPool) != VK_SUCCESS){
+				throw std::runtime_error("failed to create pipeline statistics query pool!");
+			}
+		}
+	}
+
+	// No waiting, a frame whose queries are not available yet is skipped
+	void readResults(FrameQueries &frame){
+		if (timestampsSupported && !frame.scopeNames.empty()){
+			uint32_t queryCount = static_cast<uint32_t>(frame.scopeNames.size()) * 2;
+			uint64_t timestamps[MAX_SCOPES * 2];
+			VkResult result = vkGetQueryPoolResults(
+				engineDevice.device(), frame.timestampPool, 0, queryCount,
+				sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+			if (result == VK_SUCCESS){
+				scopeResults.clear();
+				double frameBegin = std::numeric_limits<double>::max();
+				double frameEnd = 0.0;
+				for (size_t scope = 0; scope < frame.scopeNames.size(); scope++){
+					uint64_t begin = timestamps[scope * 2] & timestampMask;
+					uint64_t end = timestamps[scope * 2 + 1] & timestampMask;
+					double beginNanoseconds = double(begin) * timestampPeriod;
+					double endNanoseconds = double(end) * timestampPeriod;
+					scopeResults.push_back({frame.scopeNames[scope], (endNanoseconds - beginNanoseconds) / 1.0e6});
+					frameBegin = std::min(frameBegin, beginNanoseconds);
+					frameEnd = std::max(frameEnd, endNanoseconds);
+#ifdef ENGINE_ENABLE_PROFILER
+					EngineProfiler::get().recordGpuZone(frame.scopeNames[scope], anchorTicks,
+						beginNanoseconds - anchorGpuNanoseconds, endNanoseconds - anchorGpuNanoseconds);
+#endif
+				}
+				frameMilliseconds = (frameEnd - frameBegin) / 1.0e6;
+			}
+		}
+
+		if (statisticsSupported && frame.statisticsWritten){
+			uint64_t values[3];
+			VkResult result = vkGetQueryPoolResults(
+				engineDevice.device(), frame.statisticsPool, 0, 1,
+				sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT);
+
+			// Results come in flag bit order: vertex invocations, clipping primitives, fragment invocations
+			if (result == VK_SUCCESS) statistics = {values[0], values[1], values[2]};
+		}
+	}
+
+	// Pairs a GPU timestamp with the CPU tick it was written at, so GPU scopes can be placed on the CPU timeline
+	void calibrate(){
+		if (!timestampsSupported) return;
+#ifdef ENGINE_ENABLE_PROFILER
+		VkCommandBuffer commandBuffer = engineDevice.beginSingleTimeCommands();
+		vkCmdResetQueryPool(commandBuffer, frames[0].timestampPool, 0, 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frames[0].timestampPool, 0);
+		uint64_t before = EngineProfiler::ticks();
+		engineDevice.endSingleTimeCommands(commandBuffer);
+		uint64_t after = EngineProfiler::ticks();
+
+		uint64_t timestamp = 0;
+		vkGetQueryPoolResults(engineDevice.device(), frames[0].timestampPool, 0, 1, sizeof(timestamp), &timestamp,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		anchorGpuNanoseconds = double(timestamp & timestampMask) * timestampPeriod;
+		anchorTicks = before + (after - before) / 2;
+#endif
+	}
+
+	EngineDevice &engineDevice;
+	std::vector<FrameQueries> frames;
+	int currentFrame = 0;
+
+	bool timestampsSupported = false;
+	bool statisticsSupported = false;
+	uint64_t timestampMask = ~0ull;
+	float timestampPeriod = 1.0f;        // ns per timestamp tick
+
+	uint64_t anchorTicks = 0;            // CPU profiler tick matching anchorGpuNanoseconds
+	double anchorGpuNanoseconds = 0.0;
+
+	std::vector<EngineGpuScopeResult> scopeResults;
+	double frameMilliseconds = 0.0;
+	EngineGpuPipelineStatistics statistics{};
+};
+} // namespace
+
+#endif
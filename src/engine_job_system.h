@@ -0,0 +1,399 @@
+#ifndef ENGINE_JOB_SYSTEM_H
+#define ENGINE_JOB_SYSTEM_H
+
+/*
+ * Work stealing job system
+ *
+ * Every thread of the system (the thread that created it plus threadCount - 1 workers) owns a
+ * Chase-Lev deque. A thread pushes and pops its own jobs at the bottom of its deque, idle threads
+ * steal from the top of the others. Jobs submitted from threads outside the system go through a
+ * locked injection queue.
+ *
+ * A job can signal an EngineJobCounter when it finishes, and can be held back until another
+ * counter reaches zero (a dependency). wait() runs jobs on the calling thread until the counter
+ * reaches zero, so the main thread works instead of blocking.
+ */
+
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace Engine{
+
+class EngineJobSystem;
+struct EngineJobCounter;
+
+struct EngineJob{
+	std::function<void()> function;
+	EngineJobCounter *counter = nullptr;
+};
+
+// Number of unfinished jobs, plus the jobs waiting for it to reach zero
+struct EngineJobCounter{
+	std::atomic<uint32_t> value{0};
+
+	bool isDone() const {return value.load(std::memory_order_acquire) == 0;}
+
+private:
+	friend class EngineJobSystem;
+	std::mutex mutex;
+	std::vector<EngineJob *> continuations;
+};
+
+// Chase-Lev deque (Lê et al. 2013 C11 formulation). push/pop only from the owning thread, steal from any.
+// Buffers replaced on growth are kept until destruction, a concurrent thief may still be reading them.
+class EngineWorkStealingDeque{
+public:
+	explicit EngineWorkStealingDeque(int64_t capacity = 1024) {
+		buffers.push_back(std::make_unique<Buffer>(capacity));
+		buffer.store(buffers.back().get(), std::memory_order_relaxed);
+	}
+
+	EngineWorkStealingDeque(const EngineWorkStealingDeque &) = delete;
+	EngineWorkStealingDeque &operator=(const EngineWorkStealingDeque &) = delete;
+
+	void push(EngineJob *job){
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		Buffer *array = buffer.load(std::memory_order_relaxed);
+		if (b - t > array->capacity - 1) array = grow(array, b, t);
+		array->put(b, job);
+		bottom.store(b + 1, std::memory_order_release);
+	}
+
+	EngineJob *pop(){
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Buffer *array = buffer.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b){
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		EngineJob *job = array->get(b);
+		if (t == b){
+			// Last element, race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	EngineJob *steal(){
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b) return nullptr;
+
+		Buffer *array = buffer.load(std::memory_order_acquire);
+		EngineJob *job = array->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+		return job;
+	}
+
+private:
+	struct Buffer{
+		int64_t capacity;
+		int64_t mask;
+		std::unique_ptr<std::atomic<EngineJob *>[]> slots;
+
+		explicit Buffer(int64_t capacity) : capacity{capacity}, mask{capacity - 1}, slots{new std::atomic<EngineJob *>[capacity]} {}
+		void put(int64_t i, EngineJob *job) {slots[i & mask].store(job, std::memory_order_relaxed);}
+		EngineJob *get(int64_t i) const {return slots[i & mask].load(std::memory_order_relaxed);}
+	};
+
+	Buffer *grow(Buffer *old, int64_t b, int64_t t){
+		buffers.push_back(std::make_unique<Buffer>(old->capacity * 2));
+		Buffer *array = buffers.back().get();
+		for (int64_t i = t; i < b; i++) array->put(i, old->get(i));
+		buffer.store(array, std::memory_order_release);
+		return array;
+	}
+
+	alignas(64) std::atomic<int64_t> top{0};
+	alignas(64) std::atomic<int64_t> bottom{0};
+	std::atomic<Buffer *> buffer{nullptr};
+	std::vector<std::unique_ptr<Buffer>> buffers;   // only touched by the owner
+};
+
+class EngineJobSystem{
+public:
+
+	// threadCount 0 uses one thread per hardware thread, the creating thread counts as one of them
+	explicit EngineJobSystem(uint32_t threadCount = 0) {
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		this->threadCount = threadCount;
+
+		for (uint32_t i = 0; i < threadCount; i++) deques.push_back(std::make_unique<EngineWorkStealingDeque>());
+
+		currentThread() = {this, 0};
+		for (uint32_t i = 1; i < threadCount; i++){
+			workers.emplace_back([this, i] {workerLoop(i);});
+		}
+	}
+
+	~EngineJobSystem() {
+		{
+			std::lock_guard<std::mutex> lock{sleepMutex};
+			stopping = true;
+		}
+		wakeWorkers.notify_all();
+		for (auto &worker : workers) worker.join();
+		if (currentThread().system == this) currentThread() = {};
+	}
+
+	EngineJobSystem(const EngineJobSystem &) = delete;
+	EngineJobSystem &operator=(const EngineJobSystem &) = delete;
+
+	uint32_t getThreadCount() const {return threadCount;}
+
+	// Queues function, counter (if any) is incremented now and decremented when the job has run
+	void run(std::function<void()> function, EngineJobCounter *counter = nullptr){
+		schedule(createJob(std::move(function), counter));
+	}
+
+	// Like run, but the job is only queued once dependency has reached zero
+	void runAfter(EngineJobCounter &dependency, std::function<void()> function, EngineJobCounter *counter = nullptr){
+		EngineJob *job = createJob(std::move(function), counter);
+		{
+			std::lock_guard<std::mutex> lock{dependency.mutex};
+			if (!dependency.isDone()){
+				dependency.continuations.push_back(job);
+				return;
+			}
+		}
+		schedule(job);
+	}
+
+	// Runs queued jobs on the calling thread until counter reaches zero, after that the counter may be destroyed
+	void wait(EngineJobCounter &counter){
+		uint32_t spins = 0;
+		while (!counter.isDone()){
+			if (EngineJob *job = findJob()) {execute(job); spins = 0;}
+			else if (++spins > 64) std::this_thread::yield();
+		}
+		std::lock_guard<std::mutex> lock{counter.mutex};
+	}
+
+	// Calls function(begin, end) over [0, count) in ranges of about grainSize elements and waits for all of them
+	template <typename Function>
+	void parallelFor(size_t count, size_t grainSize, const Function &function){
+		if (count == 0) return;
+		grainSize = std::max<size_t>(1, grainSize);
+		if (count <= grainSize || threadCount == 1) {function(size_t(0), count); return;}
+
+		// All ranges are counted before the first is queued, so a range finishing early cannot take the counter to zero
+		EngineJobCounter counter;
+		counter.value.store(static_cast<uint32_t>((count - 1) / grainSize), std::memory_order_relaxed);
+		for (size_t begin = grainSize; begin < count; begin += grainSize){
+			size_t end = std::min(count, begin + grainSize);
+			EngineJob *job = createJob([&function, begin, end] {function(begin, end);}, nullptr);
+			job->counter = &counter;
+			schedule(job);
+		}
+		function(size_t(0), std::min(count, grainSize));
+		wait(counter);
+	}
+
+	// Splits [0, count) into one range per thread
+	template <typename Function>
+	void parallelFor(size_t count, const Function &function){
+		parallelFor(count, (count + threadCount - 1) / threadCount, function);
+	}
+
+private:
+
+	struct ThreadState{
+		EngineJobSystem *system = nullptr;
+		uint32_t index = 0;
+	};
+
+	static ThreadState &currentThread() {
+		static thread_local ThreadState state{};
+		return state;
+	}
+
+	EngineJob *createJob(std::function<void()> function, EngineJobCounter *counter){
+		if (counter) counter->value.fetch_add(1, std::memory_order_relaxed);
+		EngineJob *job = new EngineJob{};
+		job->function = std::move(function);
+		job->counter = counter;
+		return job;
+	}
+
+	void schedule(EngineJob *job){
+		ThreadState &state = currentThread();
+		if (state.system == this) deques[state.index]->push(job);
+		else {
+			std::lock_guard<std::mutex> lock{injectionMutex};
+			injectionQueue.push_back(job);
+		}
+
+		// seq_cst on both counters, so either the sleeper sees the job or this sees the sleeper
+		queuedJobs.fetch_add(1);
+		if (sleepingWorkers.load() > 0){
+			std::lock_guard<std::mutex> lock{sleepMutex};
+			wakeWorkers.notify_one();
+		}
+	}
+
+	EngineJob *findJob(){
+		ThreadState &state = currentThread();
+		EngineJob *job = nullptr;
+
+		if (state.system == this) job = deques[state.index]->pop();
+
+		if (!job){
+			std::lock_guard<std::mutex> lock{injectionMutex};
+			if (!injectionQueue.empty()){
+				job = injectionQueue.front();
+				injectionQueue.pop_front();
+			}
+		}
+
+		// Steal from the others starting at a random victim
+		if (!job && threadCount > 1){
+			static thread_local std::minstd_rand random{std::random_device{}()};
+			uint32_t first = static_cast<uint32_t>(random() % threadCount);
+			for (uint32_t i = 0; i < threadCount && !job; i++){
+				uint32_t victim = (first + i) % threadCount;
+				if (state.system == this && victim == state.index) continue;
+				job = deques[victim]->steal();
+			}
+		}
+
+		if (job) queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	void execute(EngineJob *job){
+		job->function();
+		EngineJobCounter *counter = job->counter;
+		delete job;
+		if (!counter) return;
+
+		uint32_t value = counter->value.load(std::memory_order_acquire);
+		while (value > 1 && !counter->value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel)) {}
+		if (value > 1) return;
+
+		// Possibly the last job. Reaching zero and taking the continuations happen under the lock wait() takes
+		// before returning, so the counter is not touched once a waiter may have destroyed it. A job added since
+		// the load keeps the counter above zero, that job's own decrement then finishes it.
+		std::vector<EngineJob *> ready;
+		{
+			std::lock_guard<std::mutex> lock{counter->mutex};
+			if (counter->value.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+			ready.swap(counter->continuations);
+		}
+		for (EngineJob *continuation : ready) schedule(continuation);
+	}
+
+	void workerLoop(uint32_t index){
+		currentThread() = {this, index};
+		uint32_t spins = 0;
+		while (true){
+			if (EngineJob *job = findJob()) {execute(job); spins = 0; continue;}
+			if (++spins < 64) {std::this_thread::yield(); continue;}
+
+			std::unique_lock<std::mutex> lock{sleepMutex};
+			sleepingWorkers.fetch_add(1);
+			wakeWorkers.wait(lock, [this] {return stopping || queuedJobs.load() > 0;});
+			sleepingWorkers.fetch_sub(1);
+			if (stopping) return;
+			spins = 0;
+		}
+	}
+
+	uint32_t threadCount;
+	std::vector<std::unique_ptr<EngineWorkStealingDeque>> deques;
+	std::vector<std::thread> workers;
+
+	std::mutex injectionMutex;
+	std::deque<EngineJob *> injectionQueue;
+
+	// Jobs queued but not yet taken, lets idle workers sleep
+	std::atomic<int64_t> queuedJobs{0};
+	std::atomic<uint32_t> sleepingWorkers{0};
+	std::mutex sleepMutex;
+	std::condition_variable wakeWorkers;
+	bool stopping = false;
+};
+
+// Scaling of parallelFor over a synthetic per-element workload from 1 to maxThreads threads. Also checks
+// that every element is visited exactly once and that dependent jobs run after their dependency.
+inline bool benchmarkJobSystem(uint32_t maxThreads = 0, size_t elementCount = 1 << 22, int iterations = 10){
+	if (maxThreads == 0) maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<float> values(elementCount);
+	std::vector<uint8_t> visits(elementCount);
+	bool correct = true;
+	double singleThreadTime = 0.0;
+
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads)){
+		EngineJobSystem jobSystem{threads};
+
+		std::fill(visits.begin(), visits.end(), 0);
+		jobSystem.parallelFor(elementCount, 4096, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) visits[i]++;
+		});
+		correct &= std::all_of(visits.begin(), visits.end(), [](uint8_t visit) {return visit == 1;});
+
+		// Many small parallelFors back to back, a range finishing while the rest are still being queued must not
+		// let wait() return early
+		std::atomic<uint64_t> visited{0};
+		uint64_t expected = 0;
+		for (int pass = 0; pass < 20000; pass++){
+			size_t count = 2 + pass % 61;
+			jobSystem.parallelFor(count, 1 + pass % 3, [&](size_t begin, size_t end) {
+				visited.fetch_add(end - begin, std::memory_order_relaxed);
+			});
+			correct &= visited.load() == expected + count;
+			expected += count;
+		}
+
+		EngineJobCounter first, second;
+		std::atomic<int> order{0};
+		int firstSeen = -1, secondSeen = -1;
+		jobSystem.run([&] {firstSeen = order++;}, &first);
+		jobSystem.runAfter(first, [&] {secondSeen = order++;}, &second);
+		jobSystem.wait(second);
+		correct &= firstSeen == 0 && secondSeen == 1;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++){
+			jobSystem.parallelFor(elementCount, 4096, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++){
+					float x = static_cast<float>(i) * 0.001f;
+					for (int k = 0; k < 16; k++) x = x * 0.999f + 0.5f / (1.0f + x * x);
+					values[i] = x;
+				}
+			});
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (threads == 1) singleThreadTime = milliseconds;
+
+		std::cout << "Job system " << threads << " threads: " << milliseconds / iterations << " ms per pass, speedup "
+			<< singleThreadTime / milliseconds << std::endl;
+
+		if (threads == maxThreads) break;
+	}
+
+	std::cout << "Job system checks " << (correct ? "passed" : "FAILED") << std::endl;
+	return correct;
+}
+} // namespace
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef ENGINE_LAYOUT_CACHE_H
+#define ENGINE_LAYOUT_CACHE_H
+
+/*
+ * Deduplicated descriptor set and pipeline layouts
+ *
+ * Layouts are looked up by a hash of their definition, so systems whose shaders declare the same
+ * sets share one VkDescriptorSetLayout and, with the same push constants, one VkPipelineLayout.
+ * Pipelines with the same layout keep each other's bound descriptor sets. The cache owns every
+ * layout it hands out and destroys them with itself, after the systems using them.
+ *
+ * Layouts come from shader reflection (EnginePipeline::reflect). Sets shared between systems,
+ * like the global set 0, are passed in and checked against what the shaders declare.
+ */
+
+#include "engine_device.h"
+#include "engine_descriptor.h"
+#include "engine_shader_reflection.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+
+namespace Engine{
+
+class EngineLayoutCache{
+public:
+	explicit EngineLayoutCache(EngineDevice &device) : engineDevice{device} {}
+
+	~EngineLayoutCache(){
+		for (auto &entry : pipelineLayouts) vkDestroyPipelineLayout(engineDevice.device(), entry.second, nullptr);
+	}
+
+	EngineLayoutCache(const EngineLayoutCache &) = delete;
+	EngineLayoutCache &operator=(const EngineLayoutCache &) = delete;
+
+	EngineDescriptorSetLayout &getSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings){
+		requestCount++;
+		std::sort(bindings.begin(), bindings.end(), [](const auto &a, const auto &b) {return a.binding < b.binding;});
+
+		LayoutKey key{};
+		for (const auto &binding : bindings){
+			key.words.insert(key.words.end(), {binding.binding, uint64_t(binding.descriptorType), binding.descriptorCount, binding.stageFlags});
+		}
+		auto found = setLayouts.find(key);
+		if (found != setLayouts.end()) return *found->second;
+
+		std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindingMap;
+		for (const auto &binding : bindings) bindingMap[binding.binding] = binding;
+		auto setLayout = std::make_unique<EngineDescriptorSetLayout>(engineDevice, bindingMap);
+		setLayoutBindings[setLayout->getDescriptorSetLayout()] = bindings;
+		return *setLayouts.emplace(std::move(key), std::move(setLayout)).first->second;
+	}
+
+	EngineDescriptorSetLayout &getSetLayout(const EngineShaderReflection &reflection, uint32_t set){
+		return getSetLayout(reflection.getSetBindings(set));
+	}
+
+	VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout> &setLayouts, const std::vector<VkPushConstantRange> &pushConstantRanges){
+		requestCount++;
+		LayoutKey key{};
+		for (VkDescriptorSetLayout setLayout : setLayouts) key.words.push_back(reinterpret_cast<uint64_t>(setLayout));
+		for (const auto &range : pushConstantRanges) key.words.insert(key.words.end(), {range.stageFlags, range.offset, range.size});
+		auto found = pipelineLayouts.find(key);
+		if (found != pipelineLayouts.end()) return found->second;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+		pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+		VkPipelineLayout pipelineLayout;
+		if (vkCreatePipelineLayout(engineDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS){
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+		pipelineLayouts.emplace(std::move(key), pipelineLayout);
+		return pipelineLayout;
+	}
+
+	// Sets [0, sharedSets.size()) use the given layouts, the shaders' bindings in them must be declared
+	// there with the same type and stages. Later sets and the push constants come from the reflection.
+	VkPipelineLayout getPipelineLayout(const EngineShaderReflection &reflection, const std::vector<VkDescriptorSetLayout> &sharedSets = {}){
+		std::vector<VkDescriptorSetLayout> setLayouts = sharedSets;
+		for (const auto &binding : reflection.getBindings()){
+			if (binding.set < sharedSets.size()) checkSharedBinding(sharedSets[binding.set], binding);
+		}
+		for (uint32_t set = static_cast<uint32_t>(sharedSets.size()); set < reflection.getSetCount(); set++){
+			setLayouts.push_back(getSetLayout(reflection, set).getDescriptorSetLayout());
+		}
+		return getPipelineLayout(setLayouts, reflection.getPushConstantRanges());
+	}
+
+	uint32_t getSetLayoutCount() const {return static_cast<uint32_t>(setLayouts.size());}
+	uint32_t getPipelineLayoutCount() const {return static_cast<uint32_t>(pipelineLayouts.size());}
+	uint32_t getRequestCount() const {return requestCount;}
+
+private:
+	struct LayoutKey{
+		std::vector<uint64_t> words;
+		bool operator==(const LayoutKey &other) const {return words == other.words;}
+	};
+
+	// FNV-1a over the definition words
+	struct LayoutKeyHash{
+		size_t operator()(const LayoutKey &key) const {
+			uint64_t hash = 14695981039346656037ull;
+			for (uint64_t word : key.words){
+				hash ^= word;
+				hash *= 1099511628211ull;
+			}
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	void checkSharedBinding(VkDescriptorSetLayout setLayout, const EngineShaderBinding &binding) const {
+		auto found = setLayoutBindings.find(setLayout);
+		if (found == setLayoutBindings.end()) return;   // not built by the cache, nothing to check against
+		for (const auto &layoutBinding : found->second){
+			if (layoutBinding.binding != binding.binding) continue;
+			if (layoutBinding.descriptorType == binding.type && layoutBinding.descriptorCount == binding.count &&
+				(layoutBinding.stageFlags & binding.stages) == binding.stages) return;
+			break;
+		}
+		throw std::runtime_error("shader binding " + binding.name + " (set " + std::to_string(binding.set) + ", binding " +
+			std::to_string(binding.binding) + ") does not match the shared descriptor set layout");
+	}
+
+	EngineDevice &engineDevice;
+	std::unordered_map<LayoutKey, std::unique_ptr<EngineDescriptorSetLayout>, LayoutKeyHash> setLayouts;
+	std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSetLayoutBinding>> setLayoutBindings;
+	std::unordered_map<LayoutKey, VkPipelineLayout, LayoutKeyHash> pipelineLayouts;
+	uint32_t requestCount = 0;
+};
+
+} // namespace
+
+#endif
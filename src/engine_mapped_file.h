@@ -0,0 +1,98 @@
+#ifndef ENGINE_MAPPED_FILE_H
+#define ENGINE_MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+	// windows.h defines these as empty macros, which breaks Camera's near/far members
+	#undef near
+	#undef far
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace Engine{
+
+// Read-only memory mapping of a whole file. The mapping stays valid for the lifetime of the object.
+class EngineMappedFile{
+public:
+
+	EngineMappedFile(const std::string &filepath) {
+#ifdef _WIN32
+		fileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) return;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize)) return;
+		size_ = static_cast<size_t>(fileSize.QuadPart);
+		isOpen_ = true;
+		if (size_ == 0) return;
+
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappingHandle == nullptr) {isOpen_ = false; return;}
+
+		data_ = static_cast<const char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (data_ == nullptr) isOpen_ = false;
+#else
+		fileDescriptor = open(filepath.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) return;
+
+		struct stat fileStat;
+		if (fstat(fileDescriptor, &fileStat) != 0) return;
+		size_ = static_cast<size_t>(fileStat.st_size);
+		isOpen_ = true;
+		if (size_ == 0) return;
+
+		void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping == MAP_FAILED) {isOpen_ = false; return;}
+
+		// the whole file is consumed front to back
+		madvise(mapping, size_, MADV_SEQUENTIAL);
+		data_ = static_cast<const char *>(mapping);
+#endif
+	}
+
+	~EngineMappedFile() {
+#ifdef _WIN32
+		if (data_) UnmapViewOfFile(data_);
+		if (mappingHandle) CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+		if (data_) munmap(const_cast<char *>(data_), size_);
+		if (fileDescriptor >= 0) close(fileDescriptor);
+#endif
+	}
+
+	EngineMappedFile(const EngineMappedFile &) = delete;
+	EngineMappedFile &operator=(const EngineMappedFile &) = delete;
+
+	bool isOpen() const {return isOpen_;}
+	const char *data() const {return data_;}
+	size_t size() const {return size_;}
+
+private:
+	const char *data_ = nullptr;
+	size_t size_ = 0;
+	bool isOpen_ = false;
+
+#ifdef _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
+} // namespace
+
+#endif
@@ -3,9 +3,13 @@
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "engine_obj_parser.h"
+#include "engine_mesh_cache.h"
 
 #include "engine_device.h"
 #include "engine_buffer.h"
+#include "engine_upload_manager.h"
+#include "engine_profiler.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -15,6 +19,16 @@
 #include <cassert>
 #include <cstring>
 #include <memory>
+#include <unordered_map>
+#include <limits>
+#include <chrono>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+#include <fstream>
 
 
 namespace Engine{
@@ -56,28 +70,117 @@ public:
 			attributeDescriptions[1].offset = offsetof(Vertex, colour);
 			return attributeDescriptions;
 		}
+
+		// Bitwise comparison so that equality always agrees with the hash below
+		bool operator==(const Vertex &other) const {
+			return std::memcmp(this, &other, sizeof(Vertex)) == 0;
+		}
+	};
+
+	struct VertexHash{
+		size_t operator()(const Vertex &vertex) const {
+			const uint32_t *words = reinterpret_cast<const uint32_t *>(&vertex);
+			size_t seed = 0;
+			for (size_t i = 0; i < sizeof(Vertex) / sizeof(uint32_t); i++){
+				seed ^= std::hash<uint32_t>{}(words[i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			}
+			return seed;
+		}
 	};
 
 	struct Builder{
 		std::vector<Vertex> vertices{};
 		std::vector<uint32_t> indices{};
+		std::vector<MeshCacheSubmesh> submeshes{}; // index range of every shape in the source file
+		glm::vec3 boundsMin{0.0f};
+		glm::vec3 boundsMax{0.0f};
+		bool loadedFromCache = false;
+		float parseTime = 0.0f; // ms spent in the .obj parser, 0 on a cache hit
+
+        // Loads filepath through its binary mesh cache, importing and writing the cache on a miss
+        void loadModel(const std::string &filepath, EngineJobSystem *jobSystem = nullptr){
+            if (loadCache(filepath)) return;
+
+            importModel(filepath, jobSystem);
+            computeBounds();
+            writeCache(filepath);
+        }
+
+        void writeCache(const std::string &filepath) const {
+            if (!EngineMeshCache::write(filepath, sizeof(Vertex), vertices.data(), static_cast<uint32_t>(vertices.size()),
+                                        indices.data(), static_cast<uint32_t>(indices.size()), submeshes,
+                                        &boundsMin.x, &boundsMax.x)) {
+                std::cerr << "failed to write mesh cache for " << filepath << std::endl;
+            }
+        }
+
+        // Bulk copies the mapped cache streams into the builder, no per vertex parsing.
+        // createMeshFromFile stages straight from the mapping instead.
+        bool loadCache(const std::string &filepath){
+            ENGINE_PROFILE_ZONE("mesh cache load");
+            EngineMeshCache cache{filepath, sizeof(Vertex)};
+            loadedFromCache = cache.isValid();
+            if (!loadedFromCache) return false;
+
+            vertices.resize(cache.vertexCount());
+            indices.resize(cache.indexCount());
+            submeshes.resize(cache.submeshCount());
+            std::memcpy(vertices.data(), cache.vertexData(), vertices.size() * sizeof(Vertex));
+            std::memcpy(indices.data(), cache.indexData(), indices.size() * sizeof(uint32_t));
+            std::memcpy(submeshes.data(), cache.submeshData(), submeshes.size() * sizeof(MeshCacheSubmesh));
+
+            const MeshCacheHeader &header = cache.getHeader();
+            boundsMin = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+            boundsMax = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+            return true;
+        }
+
+        void computeBounds(){
+            if (vertices.empty()) {boundsMin = boundsMax = glm::vec3{0.0f}; return;}
+            boundsMin = boundsMax = vertices[0].position;
+            for (const auto &vertex : vertices){
+                boundsMin = glm::min(boundsMin, vertex.position);
+                boundsMax = glm::max(boundsMax, vertex.position);
+            }
+        }
 
-        void loadModel(const std::string &filepath){
+        // Without deduplicate every face corner becomes its own vertex and no indices are emitted, the
+        // loader's behaviour before indexed meshes, kept for benchmarkMeshImport
+        void importModel(const std::string &filepath, EngineJobSystem *jobSystem = nullptr, bool deduplicate = true){
+            ENGINE_PROFILE_ZONE("obj import");
             tinyobj::attrib_t attrib;
             std::vector<tinyobj::shape_t> shapes;
             std::vector<tinyobj::material_t> materials;
             std::string warn, err;
 
-			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
+            auto parseStart = std::chrono::high_resolution_clock::now();
+			if (!EngineObjParser::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath, 0, jobSystem)) {
 				throw std::runtime_error(warn + err);
 			}
+            parseTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+                std::chrono::high_resolution_clock::now() - parseStart).count();
 
 
             vertices.clear();
             indices.clear();
+            submeshes.clear();
+
+            size_t cornerCount = 0;
+            for (const auto &shape : shapes) cornerCount += shape.mesh.indices.size();
+
+            // Face corners sharing position/colour/normal/uv collapse into one vertex
+            std::unordered_map<Vertex, uint32_t, VertexHash> uniqueVertices{};
+            if (deduplicate) {
+                uniqueVertices.reserve(cornerCount);
+                indices.reserve(cornerCount);
+            }
+            else vertices.reserve(cornerCount);
 
             for (const auto &shape : shapes)
             {
+                uint32_t firstCorner = static_cast<uint32_t>(deduplicate ? indices.size() : vertices.size());
+                submeshes.push_back({firstCorner, static_cast<uint32_t>(shape.mesh.indices.size())});
+
                 for (const auto &index : shape.mesh.indices)
                 {
                     Vertex vertex{};
@@ -114,15 +217,30 @@ public:
                         };
                     }
 
-                    vertices.push_back(vertex);
+                    if (!deduplicate) {vertices.push_back(vertex); continue;}
+                    auto result = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size()));
+                    if (result.second) {vertices.push_back(vertex);}
+                    indices.push_back(result.first->second);
                 }
             }
         }
 	};
 
-	EngineMesh(EngineDevice& _engineDevice, const EngineMesh::Builder &_builder) : engineDevice{_engineDevice}, builder{_builder} {
-		createVertexBuffers(_builder.vertices);
-		createIndexBuffers(_builder.indices);
+	EngineMesh(EngineDevice& _engineDevice, EngineUploadManager &_uploadManager, const EngineMesh::Builder &_builder)
+	: engineDevice{_engineDevice}, uploadManager{_uploadManager},
+	  submeshes{_builder.submeshes}, boundsMin{_builder.boundsMin}, boundsMax{_builder.boundsMax} {
+		createBuffers(_builder.vertices.data(), static_cast<uint32_t>(_builder.vertices.size()),
+		              _builder.indices.data(), static_cast<uint32_t>(_builder.indices.size()));
+	}
+
+	// Stages the vertex and index streams straight out of the cache mapping, the cache must be valid
+	EngineMesh(EngineDevice& _engineDevice, EngineUploadManager &_uploadManager, const EngineMeshCache &cache)
+	: engineDevice{_engineDevice}, uploadManager{_uploadManager},
+	  submeshes(cache.submeshData(), cache.submeshData() + cache.submeshCount()) {
+		const MeshCacheHeader &header = cache.getHeader();
+		boundsMin = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+		boundsMax = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+		createBuffers(static_cast<const Vertex *>(cache.vertexData()), cache.vertexCount(), cache.indexData(), cache.indexCount());
 	}
 
 	~EngineMesh() {}
@@ -130,57 +248,111 @@ public:
 	EngineMesh(const EngineMesh &) = delete;
 	EngineMesh &operator=(const EngineMesh &) = delete;		
 
-    static std::unique_ptr<EngineMesh> createMeshFromFile(EngineDevice &device, const std::string &filepath){
+    static std::unique_ptr<EngineMesh> createMeshFromFile(
+        EngineDevice &device,
+        EngineUploadManager &uploadManager,
+        const std::string &filepath,
+        EngineJobSystem *jobSystem = nullptr){
+        ENGINE_PROFILE_ZONE("createMeshFromFile");
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        {
+            ENGINE_PROFILE_ZONE("mesh cache load");
+            EngineMeshCache cache{filepath, sizeof(Vertex)};
+            if (cache.isValid()) {
+                auto mesh = std::make_unique<EngineMesh>(device, uploadManager, cache);
+                float loadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+                    std::chrono::high_resolution_clock::now() - startTime).count();
+                logLoad(filepath, " (mesh cache)", cache.indexCount(), cache.vertexCount(), loadTime);
+                std::cout << std::endl;
+                return mesh;
+            }
+        }
+
         Builder builder{};
-        builder.loadModel(filepath);
+        builder.importModel(filepath, jobSystem);
+        builder.computeBounds();
+        builder.writeCache(filepath);
+
+        float loadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+            std::chrono::high_resolution_clock::now() - startTime).count();
+        logLoad(filepath, "", builder.indices.size(), builder.vertices.size(), loadTime);
+        // Parser throughput only, the total above also includes deduplication and the cache write
+        std::error_code sizeError;
+        auto fileSize = std::filesystem::file_size(filepath, sizeError);
+        if (!sizeError && builder.parseTime > 0.0f) {
+            std::cout << " (parse " << builder.parseTime << " ms, "
+                      << (fileSize / (1024.0 * 1024.0)) / (builder.parseTime / 1000.0f) << " MB/s)";
+        }
+        std::cout << std::endl;
 
-        return std::make_unique<EngineMesh>(device, builder);
+        return std::make_unique<EngineMesh>(device, uploadManager, builder);
     }
 
+	// False until the vertex and index uploads have finished on the GPU
+	bool isReady() const {return uploadManager.isComplete(uploadTicket);}
+
 	void bind(VkCommandBuffer commandBuffer) {
 		VkBuffer buffers[] = {vertexBuffer->getBuffer()};
 		VkDeviceSize offsets[] = {0};
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
 		if (hasIndexBuffer){
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
 		}
 	}
 
-	void draw(VkCommandBuffer commandBuffer) {
-		if (hasIndexBuffer) {vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);}
-		else                {vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);}
+	void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0) {
+		if (hasIndexBuffer) {vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);}
+		else                {vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);}
 	}
 
-	const std::vector<Vertex>& getVertices() const {
-		assert(builder.vertices.size() >= 3 && "Mesh requires 3 or more vertices!");
-        return builder.vertices;
-    }
+    // Vertex and index data only live on the GPU, keep the Builder for CPU side access
+    const std::vector<MeshCacheSubmesh>& getSubmeshes() const {return submeshes;}
+    glm::vec3 getBoundsMin() const {return boundsMin;}
+    glm::vec3 getBoundsMax() const {return boundsMax;}
+    uint32_t getVertexCount() const {return vertexCount;}
+    glm::vec4 getBoundingSphere() const {return boundingSphere;} // xyz centre, w radius, mesh space
 
-    const std::vector<uint32_t>& getIndices() const {
-        return builder.indices;
-    }
+    bool hasIndices() const {return hasIndexBuffer;}
+    uint32_t getIndexCount() const {return indexCount;}
+    uint32_t getTriangleCount() const {return (hasIndexBuffer ? indexCount : vertexCount) / 3;}
 
 
 private:
 
-	// ADDED STAGING BUFFER - TEST PERFORMANCE AND REFER TO https://www.youtube.com/watch?v=qxuvQVtehII&t=385s FOR INFO
-	void createVertexBuffers(const std::vector<Vertex> &vertices){
-		vertexCount = static_cast<uint32_t>(vertices.size());
-		assert(vertexCount >= 3 && "Vertex count must be at least 3");
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-		uint32_t vertexSize = sizeof(vertices[0]);
+	static void logLoad(const std::string &filepath, const char *source, size_t indexCount, size_t vertexCount, float loadTime){
+		std::cout << "Loaded " << filepath << source << ": "
+		          << indexCount << " face corners -> "
+		          << vertexCount << " unique vertices, "
+		          << indexCount << " indices ("
+		          << (vertexCount <= std::numeric_limits<uint16_t>::max() ? 16 : 32) << "-bit) in "
+		          << loadTime << " ms";
+	}
 
-		EngineBuffer stagingBuffer{
-			engineDevice,
-			vertexSize,
-			vertexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		};
+	void createBuffers(const Vertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount){
+		computeBoundingSphere(vertices, vertexCount);
+		createVertexBuffers(vertices, vertexCount);
+		createIndexBuffers(indices, indexCount);
+	}
 
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void *) vertices.data());
+	// Centred on the AABB, tighter than the AABB's circumscribed sphere for most meshes
+	void computeBoundingSphere(const Vertex *vertices, uint32_t vertexCount){
+		glm::vec3 centre = 0.5f * (boundsMin + boundsMax);
+		float radiusSquared = 0.0f;
+		for (uint32_t i = 0; i < vertexCount; i++){
+			glm::vec3 offset = vertices[i].position - centre;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		boundingSphere = glm::vec4{centre, std::sqrt(radiusSquared)};
+	}
+
+	// Staged through the upload manager, REFER TO https://www.youtube.com/watch?v=qxuvQVtehII&t=385s FOR INFO
+	void createVertexBuffers(const Vertex *vertices, uint32_t vertexCount){
+		this->vertexCount = vertexCount;
+		assert(vertexCount >= 3 && "Vertex count must be at least 3");
+		VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
+		uint32_t vertexSize = sizeof(Vertex);
 
 		vertexBuffer = std::make_unique<EngineBuffer>(
 			engineDevice,
@@ -190,31 +362,29 @@ private:
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 		);
 
-		// Copy staging buffer to vertex buffer
-		engineDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+		uploadTicket = uploadManager.uploadBuffer(*vertexBuffer, vertices, bufferSize);
 	}
 
-	// ADDED STAGING BUFFER - TEST PERFORMANCE AND REFER TO https://www.youtube.com/watch?v=qxuvQVtehII&t=385s FOR INFO
-	void createIndexBuffers(const std::vector<uint32_t> &indices){
-		indexCount = static_cast<uint32_t>(indices.size());
+	// Staged through the upload manager, REFER TO https://www.youtube.com/watch?v=qxuvQVtehII&t=385s FOR INFO
+	void createIndexBuffers(const uint32_t *indices, uint32_t indexCount){
+		this->indexCount = indexCount;
 		hasIndexBuffer = indexCount > 0;
 
 		if (!hasIndexBuffer) return;
 
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-		uint32_t indexSize = sizeof(indices[0]);
-
-
-		EngineBuffer stagingBuffer{
-			engineDevice,
-			indexSize,
-			indexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		};
+		// Narrow to 16-bit indices whenever every vertex is addressable, halving index memory
+		std::vector<uint16_t> shortIndices{};
+		const void *indexData = indices;
+		uint32_t indexSize = sizeof(uint32_t);
+		indexType = VK_INDEX_TYPE_UINT32;
+		if (vertexCount <= std::numeric_limits<uint16_t>::max()){
+			shortIndices.assign(indices, indices + indexCount);
+			indexData = shortIndices.data();
+			indexSize = sizeof(uint16_t);
+			indexType = VK_INDEX_TYPE_UINT16;
+		}
+		VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * indexCount;
 
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void *) indices.data());
 
 		indexBuffer = std::make_unique<EngineBuffer>(
 			engineDevice,
@@ -224,12 +394,16 @@ private:
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 		);
 
-		// Copy staging buffer to vertex buffer
-		engineDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+		uploadTicket = uploadManager.uploadBuffer(*indexBuffer, indexData, bufferSize);
 	}
 
 	EngineDevice& engineDevice;
-	Builder builder;
+	EngineUploadManager& uploadManager;
+	EngineUploadTicket uploadTicket{};
+	std::vector<MeshCacheSubmesh> submeshes{};
+	glm::vec3 boundsMin{0.0f};
+	glm::vec3 boundsMax{0.0f};
+	glm::vec4 boundingSphere{0.0f};
 
     // VERTICES
 	std::unique_ptr<EngineBuffer> vertexBuffer;
@@ -239,7 +413,129 @@ private:
 	bool hasIndexBuffer = false;
 	std::unique_ptr<EngineBuffer> indexBuffer;
 	uint32_t indexCount; 
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 };	
+
+// Import time and GPU memory of the expanded, one vertex per face corner loader against the deduplicating
+// indexed one on a synthetic .obj, and checks that both describe the same triangles
+inline bool benchmarkMeshImport(EngineJobSystem *jobSystem = nullptr, size_t megabytes = 100){
+	std::string filepath = (std::filesystem::temp_directory_path() / "engine_mesh_import_bench.obj").string();
+	if (!writeSyntheticObj(filepath, megabytes << 20)){
+		std::cerr << "failed to write " << filepath << std::endl;
+		return false;
+	}
+
+	auto timeImport = [&](EngineMesh::Builder &builder, bool deduplicate) {
+		auto start = std::chrono::high_resolution_clock::now();
+		builder.importModel(filepath, jobSystem, deduplicate);
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+	EngineMesh::Builder expanded{}, indexed{};
+	double expandedTime = timeImport(expanded, false);
+	double indexedTime = timeImport(indexed, true);
+	std::remove(filepath.c_str());
+
+	bool correct = expanded.indices.empty() && indexed.indices.size() == expanded.vertices.size() &&
+		indexed.submeshes.size() == expanded.submeshes.size();
+	for (size_t i = 0; correct && i < indexed.indices.size(); i++){
+		correct = indexed.indices[i] < indexed.vertices.size() && indexed.vertices[indexed.indices[i]] == expanded.vertices[i];
+	}
+	for (size_t i = 0; correct && i < indexed.submeshes.size(); i++){
+		correct = indexed.submeshes[i].firstIndex == expanded.submeshes[i].firstIndex && indexed.submeshes[i].indexCount == expanded.submeshes[i].indexCount;
+	}
+
+	// What EngineMesh uploads: the vertex buffer plus 16 or 32-bit indices
+	size_t indexSize = indexed.vertices.size() <= std::numeric_limits<uint16_t>::max() ? sizeof(uint16_t) : sizeof(uint32_t);
+	double expandedBytes = double(expanded.vertices.size() * sizeof(EngineMesh::Vertex));
+	double indexedBytes = double(indexed.vertices.size() * sizeof(EngineMesh::Vertex) + indexed.indices.size() * indexSize);
+	std::cout << "Mesh import " << expanded.vertices.size() << " face corners: expanded " << expandedTime << " ms (parse "
+		<< expanded.parseTime << " ms), " << expandedBytes / (1024.0 * 1024.0) << " MB; indexed " << indexedTime << " ms (parse "
+		<< indexed.parseTime << " ms), " << indexed.vertices.size() << " unique vertices, " << indexedBytes / (1024.0 * 1024.0)
+		<< " MB (" << 100.0 * (1.0 - indexedBytes / expandedBytes) << "% smaller)" << std::endl;
+	std::cout << "Mesh import checks " << (correct ? "passed" : "FAILED") << std::endl;
+	return correct;
+}
+
+// Startup time of a synthetic .obj imported from scratch against the same mesh opened from its cache, plus a
+// write -> read round trip of the cache and the rejection of caches with out of range indices or submeshes
+inline bool benchmarkMeshCache(EngineJobSystem *jobSystem = nullptr, size_t megabytes = 100){
+	std::string filepath = (std::filesystem::temp_directory_path() / "engine_mesh_cache_bench.obj").string();
+	std::string cachePath = EngineMeshCache::cachePath(filepath);
+	std::remove(cachePath.c_str());
+	if (!writeSyntheticObj(filepath, megabytes << 20)){
+		std::cerr << "failed to write " << filepath << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	EngineMesh::Builder builder{};
+	builder.importModel(filepath, jobSystem);
+	builder.computeBounds();
+	double importTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	builder.writeCache(filepath);
+
+	// What createMeshFromFile does on a hit before staging: map, validate and read the streams in place.
+	// Scoped so the mapping is closed before the file is modified below.
+	bool correct = false;
+	double cacheTime = 0.0;
+	float radiusSquared = 0.0f;
+	MeshCacheHeader header{};
+	{
+		start = std::chrono::high_resolution_clock::now();
+		EngineMeshCache cache{filepath, sizeof(EngineMesh::Vertex)};
+		glm::vec3 centre = 0.5f * (builder.boundsMin + builder.boundsMax);
+		const auto *cachedVertices = static_cast<const EngineMesh::Vertex *>(cache.vertexData());
+		for (uint32_t i = 0; cache.isValid() && i < cache.vertexCount(); i++){
+			glm::vec3 offset = cachedVertices[i].position - centre;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		cacheTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		correct = cache.isValid() &&
+			cache.vertexCount() == builder.vertices.size() &&
+			cache.indexCount() == builder.indices.size() &&
+			cache.submeshCount() == builder.submeshes.size() &&
+			std::memcmp(cache.vertexData(), builder.vertices.data(), builder.vertices.size() * sizeof(EngineMesh::Vertex)) == 0 &&
+			std::memcmp(cache.indexData(), builder.indices.data(), builder.indices.size() * sizeof(uint32_t)) == 0 &&
+			std::memcmp(cache.submeshData(), builder.submeshes.data(), builder.submeshes.size() * sizeof(MeshCacheSubmesh)) == 0 &&
+			std::memcmp(cache.getHeader().boundsMin, &builder.boundsMin.x, sizeof(float) * 3) == 0 &&
+			std::memcmp(cache.getHeader().boundsMax, &builder.boundsMax.x, sizeof(float) * 3) == 0;
+		header = cache.getHeader();
+	}
+
+	std::cout << "Mesh cache " << builder.vertices.size() << " vertices, " << builder.indices.size() << " indices: import "
+		<< importTime << " ms, cache " << cacheTime << " ms, speedup " << importTime / cacheTime
+		<< " (bounding radius " << std::sqrt(radiusSquared) << ")" << std::endl;
+
+	// Corrupt one value in place, the cache must then be rejected
+	auto rejects = [&](uint64_t offset, auto value) {
+		decltype(value) original{};
+		{
+			std::fstream file{cachePath, std::ios::in | std::ios::out | std::ios::binary};
+			file.seekg(static_cast<std::streamoff>(offset));
+			file.read(reinterpret_cast<char *>(&original), sizeof(original));
+			file.seekp(static_cast<std::streamoff>(offset));
+			file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+		bool rejected = !EngineMeshCache{filepath, sizeof(EngineMesh::Vertex)}.isValid();
+		std::fstream file{cachePath, std::ios::in | std::ios::out | std::ios::binary};
+		file.seekp(static_cast<std::streamoff>(offset));
+		file.write(reinterpret_cast<const char *>(&original), sizeof(original));
+		return rejected;
+	};
+	if (correct && header.indexCount > 0 && header.submeshCount > 0){
+		correct &= rejects(header.indexOffset + uint64_t(header.indexCount - 1) * sizeof(uint32_t), header.vertexCount);
+		correct &= rejects(header.submeshOffset + offsetof(MeshCacheSubmesh, firstIndex), header.indexCount);
+		// offset + length wraps around to a small value inside the file
+		correct &= rejects(offsetof(MeshCacheHeader, indexOffset), std::numeric_limits<uint64_t>::max() - 3);
+		correct &= EngineMeshCache{filepath, sizeof(EngineMesh::Vertex)}.isValid();
+	}
+
+	std::remove(cachePath.c_str());
+	std::remove(filepath.c_str());
+	std::cout << "Mesh cache checks " << (correct ? "passed" : "FAILED") << std::endl;
+	return correct;
+}
 } // namespace
 
 
@@ -0,0 +1,186 @@
+#ifndef ENGINE_MESH_CACHE_H
+#define ENGINE_MESH_CACHE_H
+
+/*
+ * Versioned binary mesh cache written next to an imported source file (<source>.meshcache)
+ *
+ * Layout: MeshCacheHeader | vertex stream | index stream (uint32) | submesh table
+ * The header records the source path hash, size and modification time, a cache whose key no
+ * longer matches the source is ignored and rewritten on the next import. Reading maps the file
+ * and hands out pointers into the mapping, so nothing is parsed per vertex. A cache whose indices or
+ * submesh ranges point outside its streams is rejected like a stale one.
+ */
+
+#include "engine_mapped_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <system_error>
+
+namespace Engine{
+
+struct MeshCacheSubmesh{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+struct MeshCacheHeader{
+	static constexpr uint32_t MAGIC = 0x48534d45; // "EMSH"
+	static constexpr uint32_t VERSION = 1;
+
+	uint32_t magic = MAGIC;
+	uint32_t version = VERSION;
+	uint64_t sourcePathHash = 0;
+	uint64_t sourceSize = 0;
+	int64_t sourceWriteTime = 0;
+
+	uint32_t vertexStride = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t submeshCount = 0;
+
+	float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+	float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+
+	uint64_t vertexOffset = 0;
+	uint64_t indexOffset = 0;
+	uint64_t submeshOffset = 0;
+};
+
+class EngineMeshCache{
+public:
+
+	// Maps <sourcePath>.meshcache, check isValid() before reading any stream
+	EngineMeshCache(const std::string &sourcePath, uint32_t vertexStride) : file{cachePath(sourcePath)} {
+		if (!file.isOpen() || file.size() < sizeof(MeshCacheHeader)) return;
+
+		std::memcpy(&header, file.data(), sizeof(MeshCacheHeader));
+
+		MeshCacheHeader expected{};
+		if (!sourceKey(sourcePath, expected)) return;
+
+		if (header.magic != MeshCacheHeader::MAGIC || header.version != MeshCacheHeader::VERSION) return;
+		if (header.sourcePathHash != expected.sourcePathHash ||
+			header.sourceSize != expected.sourceSize ||
+			header.sourceWriteTime != expected.sourceWriteTime) return;
+		if (header.vertexStride != vertexStride) return;
+
+		if (!streamFits(header.vertexOffset, header.vertexCount, vertexStride) ||
+			!streamFits(header.indexOffset, header.indexCount, sizeof(uint32_t)) ||
+			!streamFits(header.submeshOffset, header.submeshCount, sizeof(MeshCacheSubmesh))) return;
+		if (!rangesValid()) return;
+
+		valid = true;
+	}
+
+	EngineMeshCache(const EngineMeshCache &) = delete;
+	EngineMeshCache &operator=(const EngineMeshCache &) = delete;
+
+	bool isValid() const {return valid;}
+	const MeshCacheHeader &getHeader() const {return header;}
+
+	const void *vertexData() const {return file.data() + header.vertexOffset;}
+	uint32_t vertexCount() const {return header.vertexCount;}
+
+	// Every stream starts 4 byte aligned inside the page aligned mapping, so it can be read in place
+	const uint32_t *indexData() const {return reinterpret_cast<const uint32_t *>(file.data() + header.indexOffset);}
+	uint32_t indexCount() const {return header.indexCount;}
+
+	const MeshCacheSubmesh *submeshData() const {return reinterpret_cast<const MeshCacheSubmesh *>(file.data() + header.submeshOffset);}
+	uint32_t submeshCount() const {return header.submeshCount;}
+
+	// Writes the cache for sourcePath, returns false when the cache cannot be written (e.g. read only directory)
+	static bool write(
+		const std::string &sourcePath,
+		uint32_t vertexStride,
+		const void *vertices, uint32_t vertexCount,
+		const uint32_t *indices, uint32_t indexCount,
+		const std::vector<MeshCacheSubmesh> &submeshes,
+		const float boundsMin[3], const float boundsMax[3])
+	{
+		MeshCacheHeader header{};
+		if (!sourceKey(sourcePath, header)) return false;
+
+		header.vertexStride = vertexStride;
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.submeshCount = static_cast<uint32_t>(submeshes.size());
+		std::memcpy(header.boundsMin, boundsMin, sizeof(header.boundsMin));
+		std::memcpy(header.boundsMax, boundsMax, sizeof(header.boundsMax));
+
+		header.vertexOffset = sizeof(MeshCacheHeader);
+		header.indexOffset = header.vertexOffset + uint64_t(vertexCount) * vertexStride;
+		header.submeshOffset = header.indexOffset + uint64_t(indexCount) * sizeof(uint32_t);
+
+		// Write to a temporary file and rename, so a crash never leaves a torn cache behind
+		std::string path = cachePath(sourcePath);
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out{tempPath, std::ios::binary | std::ios::trunc};
+			if (!out.is_open()) return false;
+
+			out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			out.write(static_cast<const char *>(vertices), std::streamsize(uint64_t(vertexCount) * vertexStride));
+			out.write(reinterpret_cast<const char *>(indices), std::streamsize(uint64_t(indexCount) * sizeof(uint32_t)));
+			out.write(reinterpret_cast<const char *>(submeshes.data()), std::streamsize(submeshes.size() * sizeof(MeshCacheSubmesh)));
+			if (!out.good()) {out.close(); std::remove(tempPath.c_str()); return false;}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+		if (error) {std::remove(tempPath.c_str()); return false;}
+		return true;
+	}
+
+	static std::string cachePath(const std::string &sourcePath) {return sourcePath + ".meshcache";}
+
+private:
+
+	// Compares against the remaining size instead of offset + length, which a corrupt offset could wrap around
+	bool streamFits(uint64_t offset, uint32_t count, uint64_t stride) const {
+		return offset <= file.size() && uint64_t(count) * stride <= file.size() - offset;
+	}
+
+	// Every index addresses a vertex and every submesh lies inside the index stream
+	bool rangesValid() const {
+		if (header.vertexStride % 4 != 0 || header.vertexOffset % 4 != 0 || header.indexOffset % 4 != 0 || header.submeshOffset % 4 != 0) return false;
+
+		const uint32_t *indices = indexData();
+		uint32_t maxIndex = 0;
+		for (uint32_t i = 0; i < header.indexCount; i++) maxIndex = std::max(maxIndex, indices[i]);
+		if (header.indexCount > 0 && maxIndex >= header.vertexCount) return false;
+
+		const MeshCacheSubmesh *submeshes = submeshData();
+		for (uint32_t i = 0; i < header.submeshCount; i++){
+			if (uint64_t(submeshes[i].firstIndex) + submeshes[i].indexCount > header.indexCount) return false;
+		}
+		return true;
+	}
+
+	static bool sourceKey(const std::string &sourcePath, MeshCacheHeader &header){
+		std::error_code error;
+		auto size = std::filesystem::file_size(sourcePath, error);
+		if (error) return false;
+		auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+		if (error) return false;
+
+		header.sourcePathHash = static_cast<uint64_t>(std::hash<std::string>{}(sourcePath));
+		header.sourceSize = static_cast<uint64_t>(size);
+		header.sourceWriteTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+		return true;
+	}
+
+	EngineMappedFile file;
+	MeshCacheHeader header{};
+	bool valid = false;
+};
+} // namespace
+
+#endif
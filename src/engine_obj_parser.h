@@ -0,0 +1,644 @@
+#ifndef ENGINE_OBJ_PARSER_H
+#define ENGINE_OBJ_PARSER_H
+
+/*
+ * Multi-threaded .obj parser producing the same attrib_t/shape_t layout as tinyobj::LoadObj.
+ *
+ * The file is memory mapped and split into line aligned chunks. Every chunk is parsed on its own
+ * thread into chunk local arrays, then prefix sums over the per chunk element counts resolve
+ * relative indices and place each chunk inside the merged attribute arrays.
+ *
+ * Only the v/vn/vt/f/o/g/s subset is handled here. Anything else that changes the output
+ * (materials, lines, points, tags, skin weights, polygons with more than 4 vertices, malformed
+ * indices) makes the whole file fall back to tinyobj::LoadObj, so the result is always identical.
+ *
+ * Must be included after tiny_obj_loader.h has been compiled with TINYOBJLOADER_IMPLEMENTATION,
+ * number parsing reuses tinyobj's own routines so float values match bit for bit. The
+ * implementation section of tiny_obj_loader.h has no include guard, so it is not included here.
+ */
+
+#if !defined(TINY_OBJ_LOADER_H_) || !defined(TINYOBJLOADER_IMPLEMENTATION)
+	#error "engine_obj_parser.h requires the tiny_obj_loader.h implementation, include engine_mesh.h instead"
+#endif
+
+#include "engine_mapped_file.h"
+#include "engine_job_system.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <filesystem>
+
+namespace Engine{
+
+class EngineObjParser{
+public:
+
+	// Chunks smaller than this are not worth a thread of their own
+	static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	static bool LoadObj(
+		tinyobj::attrib_t *attrib,
+		std::vector<tinyobj::shape_t> *shapes,
+		std::vector<tinyobj::material_t> *materials,
+		std::string *warn,
+		std::string *err,
+		const std::string &filepath,
+		unsigned int threadCount = 0,
+		EngineJobSystem *jobSystem = nullptr)
+	{
+		EngineMappedFile file{filepath};
+		if (!file.isOpen()){
+			return tinyobj::LoadObj(attrib, shapes, materials, warn, err, filepath.c_str());
+		}
+
+		if (threadCount == 0) threadCount = jobSystem ? jobSystem->getThreadCount() : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<Chunk> chunks = splitChunks(file.data(), file.size(), threadCount);
+
+		parallelFor(jobSystem, chunks.size(), [&](size_t i) {parseChunk(chunks[i]);});
+
+		bool supported = true;
+		for (const auto &chunk : chunks) supported &= chunk.supported;
+		if (!supported || !resolveChunks(chunks, jobSystem)){
+			return tinyobj::LoadObj(attrib, shapes, materials, warn, err, filepath.c_str());
+		}
+
+		attrib->vertices.clear();
+		attrib->normals.clear();
+		attrib->texcoords.clear();
+		attrib->colors.clear();
+		attrib->vertex_weights.clear();
+		attrib->texcoord_ws.clear();
+		attrib->skin_weights.clear();
+		shapes->clear();
+		materials->clear();
+
+		const Chunk &last = chunks.back();
+		attrib->vertices.resize(last.vBase + last.v.size());
+		attrib->colors.resize(last.vBase + last.vc.size());
+		attrib->normals.resize(last.vnBase + last.vn.size());
+		attrib->texcoords.resize(last.vtBase + last.vt.size());
+
+		parallelFor(jobSystem, chunks.size(), [&](size_t i) {
+			const Chunk &chunk = chunks[i];
+			std::copy(chunk.v.begin(), chunk.v.end(), attrib->vertices.begin() + chunk.vBase);
+			std::copy(chunk.vc.begin(), chunk.vc.end(), attrib->colors.begin() + chunk.vBase);
+			std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin() + chunk.vnBase);
+			std::copy(chunk.vt.begin(), chunk.vt.end(), attrib->texcoords.begin() + chunk.vtBase);
+		});
+
+		// Triangulating quads needs the merged positions, every chunk can still do its own faces
+		parallelFor(jobSystem, chunks.size(), [&](size_t i) {triangulateChunk(chunks[i], attrib->vertices);});
+
+		assembleShapes(chunks, shapes, warn);
+		return true;
+	}
+
+private:
+
+	struct FaceVertex{
+		int v, vt, vn;
+		bool vRelative, vtRelative, vnRelative; // index counts back from the chunk local element count
+	};
+
+	struct Face{
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		unsigned int smoothingId;
+		bool inheritsSmoothing; // no 's' seen yet in this chunk, takes the id left by earlier chunks
+	};
+
+	// A run of faces or a shape boundary ('g'/'o'), in file order
+	struct Item{
+		bool isBoundary;
+		uint32_t firstFace, faceCount;
+		std::string name;
+
+		// filled by triangulateChunk
+		std::vector<tinyobj::index_t> indices;
+		std::vector<unsigned int> numFaceVertices;
+		std::vector<unsigned int> smoothingIds;
+		bool invalidFace = false;
+	};
+
+	struct Chunk{
+		const char *begin;
+		const char *end;
+
+		std::vector<tinyobj::real_t> v, vc, vn, vt;
+		std::vector<FaceVertex> faceVertices;
+		std::vector<Face> faces;
+		std::vector<Item> items;
+
+		bool hasSmoothing = false;
+		unsigned int lastSmoothingId = 0;
+		bool supported = true;
+
+		size_t vBase = 0, vnBase = 0, vtBase = 0;
+	};
+
+	// One job per chunk on jobSystem, or one thread per chunk without one
+	template <typename Function>
+	static void parallelFor(EngineJobSystem *jobSystem, size_t count, const Function &function){
+		if (count == 1) {function(0); return;}
+		if (jobSystem){
+			jobSystem->parallelFor(count, 1, [&](size_t begin, size_t end) {for (size_t i = begin; i < end; i++) function(i);});
+			return;
+		}
+
+		std::vector<std::thread> threads;
+		threads.reserve(count);
+		for (size_t i = 0; i < count; i++) threads.emplace_back([&function, i]() {function(i);});
+		for (auto &thread : threads) thread.join();
+	}
+
+	static std::vector<Chunk> splitChunks(const char *data, size_t size, unsigned int threadCount){
+		size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MIN_CHUNK_SIZE));
+		size_t targetSize = size / chunkCount;
+
+		std::vector<Chunk> chunks;
+		const char *begin = data;
+		const char *fileEnd = data + size;
+		for (size_t i = 0; i < chunkCount && begin < fileEnd; i++){
+			const char *end = fileEnd;
+			if (i + 1 < chunkCount && begin + targetSize < fileEnd){
+				// Chunks always end just past a '\n', so no line or "\r\n" pair is ever split
+				const char *newline = static_cast<const char *>(std::memchr(begin + targetSize, '\n', fileEnd - (begin + targetSize)));
+				if (newline != nullptr) end = newline + 1;
+			}
+			chunks.emplace_back();
+			chunks.back().begin = begin;
+			chunks.back().end = end;
+			begin = end;
+		}
+
+		if (chunks.empty()){
+			chunks.emplace_back();
+			chunks.back().begin = chunks.back().end = data;
+		}
+		return chunks;
+	}
+
+	static void parseChunk(Chunk &chunk){
+		std::string linebuf;
+		const char *cursor = chunk.begin;
+
+		while (cursor < chunk.end && chunk.supported){
+			const char *lineEnd = cursor;
+			while (lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r') lineEnd++;
+
+			// tinyobj's parsing helpers expect a NUL terminated line
+			linebuf.assign(cursor, lineEnd);
+
+			// '\n', "\r\n" and a lone '\r' all end a line, as in tinyobj's safeGetline
+			cursor = lineEnd;
+			if (cursor < chunk.end){
+				if (*cursor == '\r' && cursor + 1 < chunk.end && cursor[1] == '\n') cursor += 2;
+				else cursor++;
+			}
+
+			parseLine(chunk, linebuf.c_str());
+		}
+	}
+
+	static void parseLine(Chunk &chunk, const char *token){
+		token += strspn(token, " \t");
+		if (token[0] == '\0' || token[0] == '#') return;
+
+		// vertex, colours fall back to white like tinyobj's default_vcols_fallback
+		if (token[0] == 'v' && IS_SPACE(token[1])){
+			token += 2;
+			tinyobj::real_t x, y, z, r, g, b;
+			tinyobj::parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+			chunk.v.insert(chunk.v.end(), {x, y, z});
+			chunk.vc.insert(chunk.vc.end(), {r, g, b});
+			return;
+		}
+
+		// normal
+		if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2])){
+			token += 3;
+			tinyobj::real_t x, y, z;
+			tinyobj::parseReal3(&x, &y, &z, &token);
+			chunk.vn.insert(chunk.vn.end(), {x, y, z});
+			return;
+		}
+
+		// texcoord
+		if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2])){
+			token += 3;
+			tinyobj::real_t x, y;
+			tinyobj::parseReal2(&x, &y, &token);
+			chunk.vt.insert(chunk.vt.end(), {x, y});
+			return;
+		}
+
+		// face
+		if (token[0] == 'f' && IS_SPACE(token[1])){
+			token += 2;
+			token += strspn(token, " \t");
+
+			Face face{};
+			face.firstVertex = static_cast<uint32_t>(chunk.faceVertices.size());
+			face.smoothingId = chunk.lastSmoothingId;
+			face.inheritsSmoothing = !chunk.hasSmoothing;
+
+			while (!IS_NEW_LINE(token[0])){
+				FaceVertex vertex{};
+				if (!parseTriple(chunk, &token, vertex)) {chunk.supported = false; return;}
+				chunk.faceVertices.push_back(vertex);
+				token += strspn(token, " \t\r");
+			}
+
+			face.vertexCount = static_cast<uint32_t>(chunk.faceVertices.size()) - face.firstVertex;
+			if (face.vertexCount > 4) {chunk.supported = false; return;} // needs tinyobj's ear clipping
+
+			if (chunk.items.empty() || chunk.items.back().isBoundary){
+				chunk.items.emplace_back();
+				chunk.items.back().isBoundary = false;
+				chunk.items.back().firstFace = static_cast<uint32_t>(chunk.faces.size());
+				chunk.items.back().faceCount = 0;
+			}
+			chunk.items.back().faceCount++;
+			chunk.faces.push_back(face);
+			return;
+		}
+
+		// group name, multiple names are joined with a space
+		if (token[0] == 'g' && IS_SPACE(token[1])){
+			std::vector<std::string> names;
+			while (!IS_NEW_LINE(token[0])){
+				names.push_back(tinyobj::parseString(&token));
+				token += strspn(token, " \t\r");
+			}
+
+			std::string name;
+			for (size_t i = 1; i < names.size(); i++){
+				if (i > 1) name += " ";
+				name += names[i];
+			}
+			pushBoundary(chunk, name);
+			return;
+		}
+
+		// object name
+		if (token[0] == 'o' && IS_SPACE(token[1])){
+			pushBoundary(chunk, std::string(token + 2));
+			return;
+		}
+
+		// smoothing group id
+		if (token[0] == 's' && IS_SPACE(token[1])){
+			token += 2;
+			token += strspn(token, " \t");
+			if (token[0] == '\0') return;
+			if (token[0] == '\r' || token[1] == '\n') return;
+
+			unsigned int smoothingId = 0;
+			if (!(strlen(token) >= 3 && token[0] == 'o' && token[1] == 'f' && token[2] == 'f')){
+				int parsedId = tinyobj::parseInt(&token);
+				smoothingId = parsedId < 0 ? 0 : static_cast<unsigned int>(parsedId);
+			}
+			chunk.hasSmoothing = true;
+			chunk.lastSmoothingId = smoothingId;
+			return;
+		}
+
+		// Records that change tinyobj's output but are not handled here
+		if ((token[0] == 'v' && token[1] == 'w' && IS_SPACE(token[2])) ||
+			(token[0] == 'l' && IS_SPACE(token[1])) ||
+			(token[0] == 'p' && IS_SPACE(token[1])) ||
+			(token[0] == 't' && IS_SPACE(token[1])) ||
+			strncmp(token, "usemtl", 6) == 0 ||
+			(strncmp(token, "mtllib", 6) == 0 && IS_SPACE(token[6])))
+		{
+			chunk.supported = false;
+		}
+
+		// Ignore unknown command.
+	}
+
+	static void pushBoundary(Chunk &chunk, const std::string &name){
+		chunk.items.emplace_back();
+		chunk.items.back().isBoundary = true;
+		chunk.items.back().name = name;
+	}
+
+	// Same grammar as tinyobj's parseTriple: i, i/j/k, i//k, i/j
+	// Negative indices are kept relative to the chunk and resolved once the chunk bases are known
+	static bool parseTriple(const Chunk &chunk, const char **token, FaceVertex &vertex){
+		vertex.v = vertex.vt = vertex.vn = -1;
+		vertex.vRelative = vertex.vtRelative = vertex.vnRelative = false;
+
+		if (!fixIndex(atoi(*token), static_cast<int>(chunk.v.size() / 3), false, vertex.v, vertex.vRelative)) return false;
+
+		(*token) += strcspn((*token), "/ \t\r");
+		if ((*token)[0] != '/') return true;
+		(*token)++;
+
+		// i//k
+		if ((*token)[0] == '/'){
+			(*token)++;
+			if (!fixIndex(atoi(*token), static_cast<int>(chunk.vn.size() / 3), true, vertex.vn, vertex.vnRelative)) return false;
+			(*token) += strcspn((*token), "/ \t\r");
+			return true;
+		}
+
+		// i/j/k or i/j
+		if (!fixIndex(atoi(*token), static_cast<int>(chunk.vt.size() / 2), true, vertex.vt, vertex.vtRelative)) return false;
+
+		(*token) += strcspn((*token), "/ \t\r");
+		if ((*token)[0] != '/') return true;
+
+		// i/j/k
+		(*token)++;
+		if (!fixIndex(atoi(*token), static_cast<int>(chunk.vn.size() / 3), true, vertex.vn, vertex.vnRelative)) return false;
+		(*token) += strcspn((*token), "/ \t\r");
+		return true;
+	}
+
+	static bool fixIndex(int idx, int localCount, bool allowZero, int &index, bool &relative){
+		if (idx > 0) {index = idx - 1; return true;}
+		if (idx == 0) {index = -1; return allowZero;}
+
+		index = localCount + idx;
+		relative = true;
+		return true;
+	}
+
+	// Prefix sums over the chunk element counts, then rebase relative indices and smoothing ids
+	static bool resolveChunks(std::vector<Chunk> &chunks, EngineJobSystem *jobSystem){
+		size_t vBase = 0, vnBase = 0, vtBase = 0;
+		unsigned int smoothingId = 0;
+		std::vector<unsigned int> inheritedSmoothing(chunks.size());
+
+		for (size_t i = 0; i < chunks.size(); i++){
+			Chunk &chunk = chunks[i];
+			chunk.vBase = vBase;
+			chunk.vnBase = vnBase;
+			chunk.vtBase = vtBase;
+			vBase += chunk.v.size();
+			vnBase += chunk.vn.size();
+			vtBase += chunk.vt.size();
+
+			inheritedSmoothing[i] = smoothingId;
+			if (chunk.hasSmoothing) smoothingId = chunk.lastSmoothingId;
+		}
+
+		std::vector<char> valid(chunks.size(), 1);
+		parallelFor(jobSystem, chunks.size(), [&](size_t i) {
+			Chunk &chunk = chunks[i];
+			const int vOffset = static_cast<int>(chunk.vBase / 3);
+			const int vnOffset = static_cast<int>(chunk.vnBase / 3);
+			const int vtOffset = static_cast<int>(chunk.vtBase / 2);
+
+			for (auto &vertex : chunk.faceVertices){
+				if (vertex.vRelative) vertex.v += vOffset;
+				if (vertex.vnRelative) vertex.vn += vnOffset;
+				if (vertex.vtRelative) vertex.vt += vtOffset;
+				if ((vertex.vRelative && vertex.v < 0) || (vertex.vnRelative && vertex.vn < 0) || (vertex.vtRelative && vertex.vt < 0)){
+					valid[i] = 0; // invalid relative index, let tinyobj report it
+				}
+			}
+
+			for (auto &face : chunk.faces){
+				if (face.inheritsSmoothing) face.smoothingId = inheritedSmoothing[i];
+			}
+		});
+
+		return std::find(valid.begin(), valid.end(), 0) == valid.end();
+	}
+
+	// Mirrors tinyobj's exportGroupsToShape for triangles and quads
+	static void triangulateChunk(Chunk &chunk, const std::vector<tinyobj::real_t> &v){
+		for (auto &item : chunk.items){
+			if (item.isBoundary) continue;
+
+			item.indices.reserve(item.faceCount * 3);
+			for (uint32_t f = item.firstFace; f < item.firstFace + item.faceCount; f++){
+				const Face &face = chunk.faces[f];
+				const FaceVertex *corners = &chunk.faceVertices[face.firstVertex];
+
+				if (face.vertexCount < 3) {item.invalidFace = true; continue;}
+
+				if (face.vertexCount == 3){
+					for (uint32_t k = 0; k < 3; k++) item.indices.push_back(toIndex(corners[k]));
+					item.numFaceVertices.push_back(3);
+					item.smoothingIds.push_back(face.smoothingId);
+					continue;
+				}
+
+				size_t vi0 = size_t(corners[0].v);
+				size_t vi1 = size_t(corners[1].v);
+				size_t vi2 = size_t(corners[2].v);
+				size_t vi3 = size_t(corners[3].v);
+
+				if (((3 * vi0 + 2) >= v.size()) || ((3 * vi1 + 2) >= v.size()) ||
+					((3 * vi2 + 2) >= v.size()) || ((3 * vi3 + 2) >= v.size())) {
+					item.invalidFace = true;
+					continue;
+				}
+
+				// Split along the shorter diagonal
+				tinyobj::real_t e02x = v[vi2 * 3 + 0] - v[vi0 * 3 + 0];
+				tinyobj::real_t e02y = v[vi2 * 3 + 1] - v[vi0 * 3 + 1];
+				tinyobj::real_t e02z = v[vi2 * 3 + 2] - v[vi0 * 3 + 2];
+				tinyobj::real_t e13x = v[vi3 * 3 + 0] - v[vi1 * 3 + 0];
+				tinyobj::real_t e13y = v[vi3 * 3 + 1] - v[vi1 * 3 + 1];
+				tinyobj::real_t e13z = v[vi3 * 3 + 2] - v[vi1 * 3 + 2];
+
+				tinyobj::real_t sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+				tinyobj::real_t sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+				static const int SPLIT_02[6] = {0, 1, 2, 0, 2, 3};
+				static const int SPLIT_13[6] = {0, 1, 3, 1, 2, 3};
+				const int *order = sqr02 < sqr13 ? SPLIT_02 : SPLIT_13;
+				for (int k = 0; k < 6; k++) item.indices.push_back(toIndex(corners[order[k]]));
+
+				item.numFaceVertices.insert(item.numFaceVertices.end(), {3, 3});
+				item.smoothingIds.insert(item.smoothingIds.end(), {face.smoothingId, face.smoothingId});
+			}
+		}
+	}
+
+	static tinyobj::index_t toIndex(const FaceVertex &vertex){
+		tinyobj::index_t index;
+		index.vertex_index = vertex.v;
+		index.normal_index = vertex.vn;
+		index.texcoord_index = vertex.vt;
+		return index;
+	}
+
+	// Walks the chunks in file order and groups face runs into shapes the way tinyobj does on 'g'/'o'
+	static void assembleShapes(const std::vector<Chunk> &chunks, std::vector<tinyobj::shape_t> *shapes, std::string *warn){
+		tinyobj::shape_t shape;
+		std::string name;
+		bool pendingFaces = false;
+		bool invalidFace = false;
+
+		for (const auto &chunk : chunks){
+			for (const auto &item : chunk.items){
+				if (!item.isBoundary){
+					if (!pendingFaces) shape.name = name;
+					pendingFaces = true;
+					invalidFace |= item.invalidFace;
+
+					auto &mesh = shape.mesh;
+					mesh.indices.insert(mesh.indices.end(), item.indices.begin(), item.indices.end());
+					mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), item.numFaceVertices.begin(), item.numFaceVertices.end());
+					mesh.smoothing_group_ids.insert(mesh.smoothing_group_ids.end(), item.smoothingIds.begin(), item.smoothingIds.end());
+					mesh.material_ids.resize(mesh.num_face_vertices.size(), -1);
+					continue;
+				}
+
+				if (shape.mesh.indices.size() > 0) shapes->push_back(shape);
+				shape = tinyobj::shape_t();
+				pendingFaces = false;
+				name = item.name;
+			}
+		}
+
+		if (pendingFaces || shape.mesh.indices.size() > 0) shapes->push_back(shape);
+
+		if (warn && invalidFace) (*warn) += "Degenerated or invalid face found.\n";
+	}
+};
+
+// Writes a synthetic .obj of about byteCount bytes: 64x64 grid patches with coloured positions, normals,
+// uvs and smoothing groups, alternating absolute quads and relative-index triangles
+inline bool writeSyntheticObj(const std::string &filepath, size_t byteCount){
+	std::FILE *file = std::fopen(filepath.c_str(), "wb");
+	if (!file) return false;
+
+	constexpr int GRID = 64;
+	size_t written = 0;
+	int vertexCount = 0;
+	char line[256];
+	auto put = [&](int length) {std::fwrite(line, 1, static_cast<size_t>(length), file); written += static_cast<size_t>(length);};
+
+	for (int patch = 0; written < byteCount; patch++){
+		put(std::snprintf(line, sizeof(line), "o patch%d\ns %d\n", patch, patch % 4));
+		for (int y = 0; y < GRID; y++){
+			for (int x = 0; x < GRID; x++){
+				float px = static_cast<float>(x) + static_cast<float>(patch) * GRID;
+				float pz = std::sin(px * 0.1f) * std::cos(static_cast<float>(y) * 0.1f);
+				put(std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f %.4f %.4f %.4f\n",
+					px, static_cast<float>(y), pz, x / float(GRID), y / float(GRID), 0.5f));
+				put(std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", -pz, 0.25f, 0.9f));
+				put(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", x / float(GRID - 1), y / float(GRID - 1)));
+			}
+		}
+
+		for (int y = 0; y + 1 < GRID; y++){
+			for (int x = 0; x + 1 < GRID; x++){
+				int a = y * GRID + x, b = a + 1, c = a + GRID + 1, d = a + GRID;
+				if (patch % 2 == 0){
+					a += vertexCount + 1; b += vertexCount + 1; c += vertexCount + 1; d += vertexCount + 1;
+					put(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d));
+				}
+				else{
+					a -= GRID * GRID; b -= GRID * GRID; c -= GRID * GRID; d -= GRID * GRID;
+					put(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d//%d %d//%d %d//%d\n",
+						a, a, a, b, b, b, c, c, c, a, a, c, c, d, d));
+				}
+			}
+		}
+		vertexCount += GRID * GRID;
+	}
+
+	bool good = std::ferror(file) == 0;
+	return std::fclose(file) == 0 && good;
+}
+
+// Field by field comparison of two LoadObj results, floats compared bitwise. Describes the first difference.
+inline bool sameObj(
+	const tinyobj::attrib_t &attribA, const std::vector<tinyobj::shape_t> &shapesA,
+	const tinyobj::attrib_t &attribB, const std::vector<tinyobj::shape_t> &shapesB,
+	std::string &difference)
+{
+	auto sameReals = [](const std::vector<tinyobj::real_t> &a, const std::vector<tinyobj::real_t> &b) {
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(tinyobj::real_t)) == 0);
+	};
+	auto sameIndices = [](const std::vector<tinyobj::index_t> &a, const std::vector<tinyobj::index_t> &b) {
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const tinyobj::index_t &x, const tinyobj::index_t &y) {
+			return x.vertex_index == y.vertex_index && x.normal_index == y.normal_index && x.texcoord_index == y.texcoord_index;
+		});
+	};
+
+	if (!sameReals(attribA.vertices, attribB.vertices)) {difference = "attrib.vertices"; return false;}
+	if (!sameReals(attribA.vertex_weights, attribB.vertex_weights)) {difference = "attrib.vertex_weights"; return false;}
+	if (!sameReals(attribA.normals, attribB.normals)) {difference = "attrib.normals"; return false;}
+	if (!sameReals(attribA.texcoords, attribB.texcoords)) {difference = "attrib.texcoords"; return false;}
+	if (!sameReals(attribA.texcoord_ws, attribB.texcoord_ws)) {difference = "attrib.texcoord_ws"; return false;}
+	if (!sameReals(attribA.colors, attribB.colors)) {difference = "attrib.colors"; return false;}
+	if (attribA.skin_weights.size() != attribB.skin_weights.size()) {difference = "attrib.skin_weights"; return false;}
+	if (shapesA.size() != shapesB.size()) {difference = "shape count"; return false;}
+
+	for (size_t i = 0; i < shapesA.size(); i++){
+		const tinyobj::shape_t &a = shapesA[i];
+		const tinyobj::shape_t &b = shapesB[i];
+		std::string shape = "shape " + std::to_string(i) + " ";
+		if (a.name != b.name) {difference = shape + "name"; return false;}
+		if (!sameIndices(a.mesh.indices, b.mesh.indices)) {difference = shape + "mesh.indices"; return false;}
+		if (a.mesh.num_face_vertices != b.mesh.num_face_vertices) {difference = shape + "mesh.num_face_vertices"; return false;}
+		if (a.mesh.material_ids != b.mesh.material_ids) {difference = shape + "mesh.material_ids"; return false;}
+		if (a.mesh.smoothing_group_ids != b.mesh.smoothing_group_ids) {difference = shape + "mesh.smoothing_group_ids"; return false;}
+		if (a.mesh.tags.size() != b.mesh.tags.size()) {difference = shape + "mesh.tags"; return false;}
+		if (!sameIndices(a.lines.indices, b.lines.indices) || a.lines.num_line_vertices != b.lines.num_line_vertices) {difference = shape + "lines"; return false;}
+		if (!sameIndices(a.points.indices, b.points.indices)) {difference = shape + "points"; return false;}
+	}
+	return true;
+}
+
+// Parse throughput of tinyobj::LoadObj against EngineObjParser::LoadObj on synthetic files from 10MB up to
+// maxMegabytes, and checks that both produce identical attrib_t/shape_t
+inline bool benchmarkObjParser(EngineJobSystem *jobSystem = nullptr, size_t maxMegabytes = 1024){
+	bool correct = true;
+	for (size_t megabytes = 10; megabytes <= maxMegabytes; megabytes *= 10){
+		std::string filepath = (std::filesystem::temp_directory_path() / ("engine_obj_bench_" + std::to_string(megabytes) + ".obj")).string();
+		if (!writeSyntheticObj(filepath, megabytes << 20)){
+			std::cerr << "failed to write " << filepath << std::endl;
+			return false;
+		}
+		double fileMegabytes = static_cast<double>(std::filesystem::file_size(filepath)) / (1024.0 * 1024.0);
+
+		tinyobj::attrib_t tinyAttrib, engineAttrib;
+		std::vector<tinyobj::shape_t> tinyShapes, engineShapes;
+		std::vector<tinyobj::material_t> tinyMaterials, engineMaterials;
+		std::string tinyWarn, tinyErr, engineWarn, engineErr;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		bool tinyLoaded = tinyobj::LoadObj(&tinyAttrib, &tinyShapes, &tinyMaterials, &tinyWarn, &tinyErr, filepath.c_str());
+		auto middle = std::chrono::high_resolution_clock::now();
+		bool engineLoaded = EngineObjParser::LoadObj(&engineAttrib, &engineShapes, &engineMaterials, &engineWarn, &engineErr, filepath, 0, jobSystem);
+		auto end = std::chrono::high_resolution_clock::now();
+		std::filesystem::remove(filepath);
+
+		double tinySeconds = std::chrono::duration<double>(middle - start).count();
+		double engineSeconds = std::chrono::duration<double>(end - middle).count();
+
+		std::string difference;
+		bool same = tinyLoaded && engineLoaded && tinyWarn == engineWarn &&
+			sameObj(tinyAttrib, tinyShapes, engineAttrib, engineShapes, difference);
+		if (!tinyLoaded || !engineLoaded) difference = "load failed";
+		else if (difference.empty() && !same) difference = "warnings";
+		correct &= same;
+
+		std::cout << "OBJ " << fileMegabytes << " MB: tinyobj " << fileMegabytes / tinySeconds << " MB/s, engine "
+			<< fileMegabytes / engineSeconds << " MB/s, speedup " << tinySeconds / engineSeconds
+			<< (same ? ", identical" : ", MISMATCH in " + difference) << std::endl;
+	}
+
+	std::cout << "OBJ parser checks " << (correct ? "passed" : "FAILED") << std::endl;
+	return correct;
+}
+} // namespace
+
+#endif
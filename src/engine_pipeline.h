@@ -8,9 +8,17 @@
 #include <iostream>
 #include <vulkan/vulkan.h>
 #include <cassert>
+#include <chrono>
+#include <algorithm>
 
 #include "engine_device.h"
 #include "engine_mesh.h"
+#include "engine_shader_reflection.h"
+
+// Compiled SPIR-V, CMake points this at the shaders it builds into the build tree
+#ifndef ENGINE_SHADER_DIR
+#define ENGINE_SHADER_DIR "shaders/"
+#endif
 
 namespace Engine{
 
@@ -128,8 +136,6 @@ public:
 		configInfo.dynamicStateInfo.flags = 0;
 	}
 
-private:
-
 	static std::vector<char> readFile(const std::string& filePath){
 		std::ifstream file{filePath, std::ios::ate | std::ios::binary};
 
@@ -145,6 +151,26 @@ private:
 		return buffer;
 	}
 
+	// Merged reflection of a pipeline's shader stages, for building its layout (see EngineLayoutCache)
+	static EngineShaderReflection reflect(const std::vector<std::string> &filePaths){
+		EngineShaderReflection reflection{};
+		for (const auto &filePath : filePaths) reflection.merge(EngineShaderReflection{readFile(filePath), filePath});
+		return reflection;
+	}
+
+	static void logPipelineCreation(
+		EngineDevice &device,
+		const std::string &name,
+		std::chrono::high_resolution_clock::time_point start,
+		size_t cacheSizeBefore)
+	{
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		bool hit = device.pipelineCacheStore().dataSize() == cacheSizeBefore;
+		std::cout << "pipeline " << name << ": " << milliseconds << " ms (cache " << (hit ? "hit" : "miss") << ")" << std::endl;
+	}
+
+private:
+
 	void createEnginePipeline(
 		const std::string& vertFilePath, 
 		const std::string& fragFilePath,
@@ -180,8 +206,10 @@ private:
 		shaderStages[1].pSpecializationInfo = nullptr;
 
 
+		// only the vertex attributes the vertex shader reads, a shader without inputs gets no vertex buffer
 		auto bindingDescriptions = EngineMesh::Vertex::getBindingDescriptions();
-		auto attributeDescriptions = EngineMesh::Vertex::getAttributeDescriptions();
+		auto attributeDescriptions = vertexAttributes(EngineShaderReflection{vertCode, vertFilePath}, vertFilePath);
+		if (attributeDescriptions.empty()) bindingDescriptions.clear();
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -211,9 +239,26 @@ private:
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(engineDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &enginePipeline) != VK_SUCCESS){
+		// The cache grows only when the driver had to compile, so an unchanged size counts as a hit
+		size_t cacheSizeBefore = engineDevice.pipelineCacheStore().dataSize();
+		auto start = std::chrono::high_resolution_clock::now();
+		if (vkCreateGraphicsPipelines(engineDevice.device(), engineDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &enginePipeline) != VK_SUCCESS){
 			throw std::runtime_error("failed to create graphics pipeline");
 		}
+		logPipelineCreation(engineDevice, vertFilePath + " + " + fragFilePath, start, cacheSizeBefore);
+	}
+
+	static std::vector<VkVertexInputAttributeDescription> vertexAttributes(const EngineShaderReflection &reflection, const std::string &filePath){
+		auto meshAttributes = EngineMesh::Vertex::getAttributeDescriptions();
+		std::vector<VkVertexInputAttributeDescription> attributes;
+		for (const auto &input : reflection.getVertexInputs()){
+			auto found = std::find_if(meshAttributes.begin(), meshAttributes.end(), [&](const auto &a) {return a.location == input.location;});
+			if (found == meshAttributes.end() || found->format != input.format){
+				throw std::runtime_error(filePath + ": vertex input " + input.name + " (location " + std::to_string(input.location) + ") does not match EngineMesh::Vertex");
+			}
+			attributes.push_back(*found);
+		}
+		return attributes;
 	}
 
 	void CreateShaderModule(const std::vector<char>& code, VkShaderModule * shaderModule){
@@ -233,6 +278,59 @@ private:
 	VkShaderModule fragShaderModule;
 };
 
+
+
+class EngineComputePipeline{
+public:
+	EngineComputePipeline(EngineDevice &device, const std::string& compFilePath, VkPipelineLayout pipelineLayout)
+	    : engineDevice(device)
+	{
+		auto compCode = EnginePipeline::readFile(compFilePath);
+
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = compCode.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(compCode.data());
+		if (vkCreateShaderModule(engineDevice.device(), &moduleInfo, nullptr, &compShaderModule) != VK_SUCCESS){
+			throw std::runtime_error("failed to create shader module");
+		}
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = compShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		size_t cacheSizeBefore = engineDevice.pipelineCacheStore().dataSize();
+		auto start = std::chrono::high_resolution_clock::now();
+		if (vkCreateComputePipelines(engineDevice.device(), engineDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS){
+			throw std::runtime_error("failed to create compute pipeline");
+		}
+		EnginePipeline::logPipelineCreation(engineDevice, compFilePath, start, cacheSizeBefore);
+	}
+
+	~EngineComputePipeline() {
+		vkDestroyShaderModule(engineDevice.device(), compShaderModule, nullptr);
+		vkDestroyPipeline(engineDevice.device(), computePipeline, nullptr);
+	}
+
+	EngineComputePipeline(const EngineComputePipeline&) = delete;
+	EngineComputePipeline& operator=(const EngineComputePipeline&) = delete;
+
+	void bind(VkCommandBuffer commandBuffer){
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	}
+
+private:
+	EngineDevice &engineDevice;
+	VkPipeline computePipeline;
+	VkShaderModule compShaderModule;
+};
+
 } // namespace
 
 
@@ -0,0 +1,136 @@
+#ifndef ENGINE_PIPELINE_CACHE_H
+#define ENGINE_PIPELINE_CACHE_H
+
+/*
+ * VkPipelineCache persisted to disk between runs
+ *
+ * The file is the raw vkGetPipelineCacheData blob. Its VkPipelineCacheHeaderVersionOne header
+ * (header size, version, vendor ID, device ID, pipeline cache UUID) is checked against the
+ * current physical device before the data is handed to the driver, a file written by another
+ * GPU or driver version is ignored and replaced on save. Saving writes a temporary file and
+ * renames it, so a crash never leaves a torn cache behind.
+ */
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <system_error>
+
+namespace Engine{
+
+class EnginePipelineCache{
+public:
+	static constexpr const char *DEFAULT_PATH = "pipeline.cache";
+
+	// Layout of VkPipelineCacheHeaderVersionOne, read field by field so older headers without the struct still build
+	static constexpr size_t HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+	EnginePipelineCache(VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &path = DEFAULT_PATH)
+		: device{device}, properties{properties}, path{path} {
+
+		std::vector<char> data = readCacheFile();
+		loaded = !data.empty();
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS){
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+	}
+
+	~EnginePipelineCache() {vkDestroyPipelineCache(device, cache, nullptr);}
+
+	EnginePipelineCache(const EnginePipelineCache &) = delete;
+	EnginePipelineCache &operator=(const EnginePipelineCache &) = delete;
+
+	VkPipelineCache getPipelineCache() const {return cache;}
+
+	// True if a valid cache file for this device was found at startup
+	bool wasLoaded() const {return loaded;}
+
+	// Size of the cache data, grows when the driver compiles a pipeline it had not seen
+	size_t dataSize() const {
+		size_t size = 0;
+		vkGetPipelineCacheData(device, cache, &size, nullptr);
+		return size;
+	}
+
+	// Returns false when the cache cannot be written (e.g. read only directory), the old file is kept then
+	bool save() const {
+		size_t size = dataSize();
+		std::vector<char> data(size);
+		if (size == 0 || vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) return false;
+
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out{tempPath, std::ios::binary | std::ios::trunc};
+			if (!out.is_open()) return false;
+
+			out.write(data.data(), std::streamsize(size));
+			if (!out.good()) {out.close(); std::remove(tempPath.c_str()); return false;}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+		if (error) {std::remove(tempPath.c_str()); return false;}
+		return true;
+	}
+
+private:
+
+	// Empty when there is no file or it was written for a different device or driver
+	std::vector<char> readCacheFile() const {
+		std::ifstream file{path, std::ios::ate | std::ios::binary};
+		if (!file.is_open()) return {};
+
+		size_t fileSize = static_cast<size_t>(file.tellg());
+		if (fileSize < HEADER_SIZE) return {};
+
+		std::vector<char> data(fileSize);
+		file.seekg(0);
+		file.read(data.data(), fileSize);
+		if (!file.good()) return {};
+
+		if (!isCompatible(data)){
+			std::cout << "pipeline cache " << path << " was written for another device or driver, ignoring it" << std::endl;
+			return {};
+		}
+		return data;
+	}
+
+	bool isCompatible(const std::vector<char> &data) const {
+		uint32_t headerSize, headerVersion, vendorID, deviceID;
+		uint8_t uuid[VK_UUID_SIZE];
+		std::memcpy(&headerSize, data.data(), 4);
+		std::memcpy(&headerVersion, data.data() + 4, 4);
+		std::memcpy(&vendorID, data.data() + 8, 4);
+		std::memcpy(&deviceID, data.data() + 12, 4);
+		std::memcpy(uuid, data.data() + 16, VK_UUID_SIZE);
+
+		return headerSize >= HEADER_SIZE && headerSize <= data.size() &&
+			headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			vendorID == properties.vendorID &&
+			deviceID == properties.deviceID &&
+			std::memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	VkDevice device;
+	VkPhysicalDeviceProperties properties;
+	std::string path;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	bool loaded = false;
+};
+} // namespace
+
+#endif
@@ -11,6 +11,14 @@
 #include "engine_game_object.h"
 #include "engine_camera.h"
 #include "engine_frame_info.h"
+#include "engine_buffer.h"
+#include "engine_descriptor.h"
+#include "engine_layout_cache.h"
+#include "engine_bindless.h"
+#include "engine_swap_chain.h"
+#include "engine_culling.h"
+#include "engine_clustered_lighting.h"
+#include "engine_profiler.h"
 
 
 #include <memory>
@@ -18,66 +26,162 @@
 #include <iostream>
 #include <stdexcept>
 #include <array>
+#include <algorithm>
+#include <utility>
+#include <cmath>
 
 namespace Engine{
 
+// Per billboard data read by point_light.vert from the billboard storage buffer (set 1) via gl_InstanceIndex,
+// point_light_bindless.vert finds the buffer through a pushed bindless handle instead
+struct PointLightBillboard{
+	glm::vec4 position{0.0f, 0.0f, 0.0f, 1.0f};   // world space xyz, w billboard radius
+	glm::vec4 colour{1.0f};                       // rgb, w intensity
+};
 
 class PointLightSystem{
 public:
 
-	PointLightSystem(EngineDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : engineDevice{device} 
+	static constexpr uint32_t INITIAL_BILLBOARD_CAPACITY = 256;
+	static constexpr float BILLBOARD_SCALE = 0.1f;   // billboard radius of a light with intensity 1, grows with its square root
+
+	static constexpr const char *VERT_SHADER_PATH = ENGINE_SHADER_DIR "point_light.vert.spv";
+	static constexpr const char *FRAG_SHADER_PATH = ENGINE_SHADER_DIR "point_light.frag.spv";
+	static constexpr const char *BINDLESS_VERT_SHADER_PATH = ENGINE_SHADER_DIR "point_light_bindless.vert.spv";
+
+	// Set 0 is the shared global set, the billboard set and the rest of the layout come from the shaders,
+	// billboard sets are allocated every frame. With a bindless table set 1 is the table's set and the
+	// billboard buffers are registered in it.
+	PointLightSystem(
+		EngineDevice& device,
+		VkRenderPass renderPass,
+		VkDescriptorSetLayout globalSetLayout,
+		EngineLayoutCache &layoutCache,
+		EngineDescriptorAllocator &descriptorAllocator,
+		EngineBindlessTable *bindlessTable = nullptr)
+	: engineDevice{device}, descriptorAllocator{descriptorAllocator}, bindlessTable{bindlessTable}
 	{
-		createPipelineLayout(globalSetLayout);
+		EngineShaderReflection reflection = EnginePipeline::reflect({getVertShaderPath(), FRAG_SHADER_PATH});
+		if (bindlessTable){
+			if (reflection.getPushConstantSize() != sizeof(uint32_t)) throw std::runtime_error("point_light_bindless.vert should push one buffer handle");
+			pipelineLayout = layoutCache.getPipelineLayout(reflection, {globalSetLayout, bindlessTable->getSetLayout()});
+		}
+		else{
+			billboardSetLayout = &layoutCache.getSetLayout(reflection, 1);
+			pipelineLayout = layoutCache.getPipelineLayout(reflection, {globalSetLayout});
+		}
+		createBillboardBuffers();
 		createPipeline(renderPass);
 	}
 
+	~PointLightSystem(){
+		for (auto handle : billboardHandles) bindlessTable->releaseBuffer(handle);
+	}
 
-	~PointLightSystem() {vkDestroyPipelineLayout(engineDevice.device(), pipelineLayout, nullptr);};
-	
 	PointLightSystem(const PointLightSystem &) = delete;
-	PointLightSystem &operator=(const PointLightSystem &) = delete;	
+	PointLightSystem &operator=(const PointLightSystem &) = delete;
 
 
-	void render(FrameInfo &frameInfo)
+	// Culls the lights' billboards against the camera frustum, sorts the rest back to front for blending
+	// and draws them with one instanced draw call
+	void render(FrameInfo &frameInfo, const std::vector<PointLight> &lights)
 	{
+		ENGINE_PROFILE_ZONE("PointLightSystem::render");
+		prepareBillboards(frameInfo, lights);
+		if (billboardCount == 0) return;
+
 		enginePipeline->bind(frameInfo.commandBuffer);
 
+		VkDescriptorSet billboardSet;
+		if (bindlessTable) billboardSet = bindlessTable->getDescriptorSet();
+		else{
+			auto bufferInfo = billboardBuffers[frameInfo.frameIndex]->descriptorInfo();
+			billboardSet = EngineDescriptorWriter(*billboardSetLayout)
+			.writeBuffer(0, &bufferInfo)
+			.build(descriptorAllocator, frameInfo.frameIndex);
+		}
+
+		VkDescriptorSet descriptorSets[] = {frameInfo.globalDescriptorSet, billboardSet};
 		vkCmdBindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
-			0, 
-			1, 
-			&frameInfo.globalDescriptorSet,
-			0, 
+			0,
+			2,
+			descriptorSets,
+			0,
 			nullptr);
+		if (bindlessTable){
+			vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &billboardHandles[frameInfo.frameIndex].index);
+		}
 
-		vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+		vkCmdDraw(frameInfo.commandBuffer, 6, billboardCount, 0, 0);
 	}
 
+	// Billboards drawn by the last render call
+	uint32_t getBillboardCount() const {return billboardCount;}
+
 
 private:
 
-	void createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+	void prepareBillboards(FrameInfo &frameInfo, const std::vector<PointLight> &lights) {
+		Frustum frustum = extractFrustum(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+		const glm::mat4 &view = frameInfo.camera.getView();
+
+		// view depth and light index of every billboard that reaches into the frustum
+		sortKeys.clear();
+		for (uint32_t i = 0; i < lights.size(); i++){
+			glm::vec4 sphere{glm::vec3{lights[i].position}, billboardRadius(lights[i])};
+			if (!sphereInFrustum(frustum, sphere)) continue;
+			float depth = view[0][2] * sphere.x + view[1][2] * sphere.y + view[2][2] * sphere.z + view[3][2];
+			sortKeys.emplace_back(depth, i);
+		}
+		std::sort(sortKeys.begin(), sortKeys.end(), [](const auto &a, const auto &b) {return a.first > b.first;});
+
+		billboardCount = static_cast<uint32_t>(sortKeys.size());
+		ENGINE_PROFILE_COUNTER("light billboards", billboardCount);
+		if (billboardCount == 0) return;
+		reserveBillboards(frameInfo.frameIndex, billboardCount);
+
+		PointLightBillboard *billboards = static_cast<PointLightBillboard *>(billboardBuffers[frameInfo.frameIndex]->getMappedMemory());
+		for (uint32_t b = 0; b < billboardCount; b++){
+			const PointLight &light = lights[sortKeys[b].second];
+			billboards[b].position = glm::vec4{glm::vec3{light.position}, billboardRadius(light)};
+			billboards[b].colour = light.colour;
+		}
+	}
 
-		// VkPushConstantRange pushConstantRange{};
-		// pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		// pushConstantRange.offset = 0;
-		// pushConstantRange.size = sizeof(SimplePushConstantData);
+	static float billboardRadius(const PointLight &light) {return BILLBOARD_SCALE * std::sqrt(std::max(light.colour.w, 0.0f));}
 
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+	const char *getVertShaderPath() const {return bindlessTable ? BINDLESS_VERT_SHADER_PATH : VERT_SHADER_PATH;}
 
+	void createBillboardBuffers() {
+		billboardBuffers.resize(EngineSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (int i = 0; i < EngineSwapChain::MAX_FRAMES_IN_FLIGHT; i++){
+			createBillboardBuffer(i, INITIAL_BILLBOARD_CAPACITY);
+			if (bindlessTable) billboardHandles.push_back(bindlessTable->registerBuffer(*billboardBuffers[i]));
+		}
+	}
 
+	void createBillboardBuffer(int frameIndex, uint32_t capacity) {
+		billboardBuffers[frameIndex] = std::make_unique<EngineBuffer>(
+			engineDevice,
+			sizeof(PointLightBillboard),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		billboardBuffers[frameIndex]->map();
+	}
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
-		if (vkCreatePipelineLayout(engineDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS){
-			throw std::runtime_error("failed to create pipeline layout!");
-		}
+	// The frame's previous submission has finished by the time it is recorded again, so its buffer can be replaced.
+	// Billboard sets are written every frame, only bindless handles need to follow the new buffer.
+	void reserveBillboards(int frameIndex, uint32_t count) {
+		uint32_t capacity = billboardBuffers[frameIndex]->getInstanceCount();
+		if (count <= capacity) return;
+
+		while (capacity < count) capacity *= 2;
+		createBillboardBuffer(frameIndex, capacity);
+		if (bindlessTable) bindlessTable->updateBuffer(billboardHandles[frameIndex], billboardBuffers[frameIndex]->descriptorInfo());
 	}
 
 	void createPipeline(VkRenderPass renderPass) {
@@ -85,19 +189,36 @@ private:
 
 		PipelineConfigInfo pipelineConfig{};
 		EnginePipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;	
+
+		// glow blends over the scene, billboards are sorted back to front and do not write depth
+		pipelineConfig.colorBlendAttachment.blendEnable = VK_TRUE;
+		pipelineConfig.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		pipelineConfig.colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+
+		pipelineConfig.renderPass = renderPass;
 		pipelineConfig.pipelineLayout = pipelineLayout;
 		enginePipeline = std::make_unique<EnginePipeline>(
-			engineDevice, 
-			"../shaders/point_light.vert.spv", 
-			"../shaders/point_light.frag.spv", 
+			engineDevice,
+			getVertShaderPath(),
+			FRAG_SHADER_PATH,
 			pipelineConfig);
 	}
 
 
     EngineDevice& engineDevice;
     std::unique_ptr<EnginePipeline> enginePipeline;
-    VkPipelineLayout pipelineLayout;
+    VkPipelineLayout pipelineLayout;   // owned by the layout cache
+
+    EngineDescriptorSetLayout *billboardSetLayout = nullptr;   // owned by the layout cache
+    EngineDescriptorAllocator &descriptorAllocator;
+    std::vector<std::unique_ptr<EngineBuffer>> billboardBuffers;
+    EngineBindlessTable *bindlessTable;             // replaces the billboard sets when set
+    std::vector<EngineResourceHandle> billboardHandles;   // per frame, bindless only
+
+    // Per frame scratch, kept to avoid reallocating every frame
+    std::vector<std::pair<float, uint32_t>> sortKeys;   // view depth, light index
+    uint32_t billboardCount = 0;
 };
 
 
@@ -105,4 +226,4 @@ private:
 } // namespace
 
 
-#endif
\ No newline at end of file
+#endif
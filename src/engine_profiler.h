@@ -0,0 +1,235 @@
+#ifndef ENGINE_PROFILER_H
+#define ENGINE_PROFILER_H
+
+/*
+ * CPU frame profiler with Chrome trace export
+ *
+ * ENGINE_PROFILE_ZONE("name") times the enclosing scope, ENGINE_PROFILE_COUNTER("name", value)
+ * samples a named value and ENGINE_PROFILE_FRAME() marks the start of a frame. Names must be
+ * string literals (or otherwise outlive the profiler), only the pointer is stored.
+ *
+ * Every thread writes to its own event ring, so recording is a clock read plus a store with no
+ * locks or atomic read-modify-writes. On x86 the clock is the TSC, converted to time
+ * against steady_clock when the trace is written. The profiler keeps the start times of the last
+ * FRAME_HISTORY frames, writeChromeTrace() exports the events of those frames as trace_event JSON
+ * (open it in chrome://tracing or ui.perfetto.dev).
+ *
+ * Without ENGINE_ENABLE_PROFILER the macros expand to nothing and none of this is compiled.
+ */
+
+#ifdef ENGINE_ENABLE_PROFILER
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#define ENGINE_PROFILER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define ENGINE_PROFILER_TSC
+#endif
+
+namespace Engine{
+
+struct EngineProfileEvent{
+	enum Type : uint32_t {Zone, Counter};
+
+	const char *name;
+	uint64_t start;       // ticks, see EngineProfiler::ticks
+	uint64_t end;         // zones only
+	double value;         // counters only
+	Type type;
+};
+
+class EngineProfiler{
+public:
+	static constexpr uint32_t FRAME_HISTORY = 120;
+	static constexpr uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+	static EngineProfiler &get() {
+		static EngineProfiler profiler;
+		return profiler;
+	}
+
+	static uint64_t ticks() {
+#ifdef ENGINE_PROFILER_TSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	void recordZone(const char *name, uint64_t start, uint64_t end) {
+		threadBuffer().push({name, start, end, 0.0, EngineProfileEvent::Zone});
+	}
+
+	void recordCounter(const char *name, double value) {
+		uint64_t time = ticks();
+		threadBuffer().push({name, time, time, value, EngineProfileEvent::Counter});
+	}
+
+	// GPU zone measured in ns relative to anchorTicks, the CPU tick matching GPU time 0 (see EngineGpuProfiler)
+	void recordGpuZone(const char *name, uint64_t anchorTicks, double startNanoseconds, double endNanoseconds) {
+		std::lock_guard<std::mutex> lock{mutex};
+		gpuZones.push_back({name, anchorTicks, startNanoseconds, endNanoseconds});
+		if (gpuZones.size() > MAX_GPU_ZONES) gpuZones.pop_front();
+	}
+
+	void beginFrame() {
+		std::lock_guard<std::mutex> lock{mutex};
+		frameStarts[frameCount % FRAME_HISTORY] = ticks();
+		frameCount++;
+	}
+
+	// Events of the last FRAME_HISTORY frames. Safe while other threads record, an event that is being
+	// overwritten during the copy can come out torn, which only happens once a ring wraps mid-export.
+	bool writeChromeTrace(const std::string &path) {
+		std::vector<std::pair<uint32_t, EngineProfileEvent>> events;
+		std::vector<GpuZone> gpuEvents;
+		uint64_t windowStart = 0;
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			if (frameCount > FRAME_HISTORY) windowStart = frameStarts[frameCount % FRAME_HISTORY];
+			for (auto &buffer : buffers) buffer->copyEvents(windowStart, events);
+			gpuEvents.assign(gpuZones.begin(), gpuZones.end());
+		}
+
+		// Ticks to microseconds, measured over the whole run so far
+		double elapsedMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+		uint64_t currentTicks = ticks();
+		double microsecondsPerTick = currentTicks > epochTicks ? elapsedMicroseconds / double(currentTicks - epochTicks) : 0.0;
+		auto toMicroseconds = [&](uint64_t tick) {return double(tick - epochTicks) * microsecondsPerTick;};
+		double windowStartMicroseconds = windowStart ? toMicroseconds(windowStart) : 0.0;
+
+		std::ofstream out{path, std::ios::trunc};
+		if (!out.is_open()) return false;
+
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (const auto &[threadId, event] : events){
+			if (!first) out << ",\n";
+			first = false;
+			out << "{\"name\":\"" << event.name << "\",\"pid\":0,\"tid\":" << threadId << ",\"ts\":" << toMicroseconds(event.start);
+			if (event.type == EngineProfileEvent::Zone) out << ",\"ph\":\"X\",\"dur\":" << double(event.end - event.start) * microsecondsPerTick << "}";
+			else out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+		}
+
+		// GPU zones on their own track of the same timeline
+		size_t gpuEventCount = 0;
+		for (const auto &zone : gpuEvents){
+			double start = toMicroseconds(zone.anchorTicks) + zone.startNanoseconds / 1000.0;
+			if (start < windowStartMicroseconds) continue;
+			if (!first) out << ",\n";
+			first = false;
+			out << "{\"name\":\"" << zone.name << "\",\"pid\":0,\"tid\":" << GPU_TRACK << ",\"ts\":" << start
+				<< ",\"ph\":\"X\",\"dur\":" << (zone.endNanoseconds - zone.startNanoseconds) / 1000.0 << "}";
+			gpuEventCount++;
+		}
+		if (gpuEventCount > 0){
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_TRACK << ",\"args\":{\"name\":\"GPU\"}}";
+		}
+		out << "\n]}\n";
+
+		std::cout << "Wrote " << events.size() + gpuEventCount << " profiler events to " << path << std::endl;
+		return out.good();
+	}
+
+private:
+
+	// Single producer ring, only the owning thread writes
+	struct ThreadBuffer{
+		uint32_t threadId;
+		std::unique_ptr<EngineProfileEvent[]> events{new EngineProfileEvent[EVENTS_PER_THREAD]};
+		std::atomic<uint64_t> head{0};
+
+		void push(const EngineProfileEvent &event) {
+			uint64_t index = head.load(std::memory_order_relaxed);
+			events[index % EVENTS_PER_THREAD] = event;
+			head.store(index + 1, std::memory_order_release);
+		}
+
+		void copyEvents(uint64_t windowStart, std::vector<std::pair<uint32_t, EngineProfileEvent>> &out) const {
+			uint64_t end = head.load(std::memory_order_acquire);
+			uint64_t begin = end > EVENTS_PER_THREAD ? end - EVENTS_PER_THREAD : 0;
+			for (uint64_t i = begin; i < end; i++){
+				const EngineProfileEvent &event = events[i % EVENTS_PER_THREAD];
+				if (event.start >= windowStart) out.push_back({threadId, event});
+			}
+		}
+	};
+
+	static constexpr uint32_t GPU_TRACK = 1000;
+	static constexpr size_t MAX_GPU_ZONES = FRAME_HISTORY * 16;
+
+	struct GpuZone{
+		const char *name;
+		uint64_t anchorTicks;
+		double startNanoseconds;
+		double endNanoseconds;
+	};
+
+	EngineProfiler() = default;
+
+	ThreadBuffer &threadBuffer() {
+		static thread_local ThreadBuffer *buffer = nullptr;
+		if (!buffer){
+			std::lock_guard<std::mutex> lock{mutex};
+			buffers.push_back(std::make_unique<ThreadBuffer>());
+			buffer = buffers.back().get();
+			buffer->threadId = static_cast<uint32_t>(buffers.size() - 1);
+		}
+		return *buffer;
+	}
+
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	uint64_t epochTicks = ticks();
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;   // never shrinks, threads keep pointers into it
+	std::deque<GpuZone> gpuZones;
+	uint64_t frameStarts[FRAME_HISTORY] = {};
+	uint64_t frameCount = 0;
+};
+
+class EngineProfileZone{
+public:
+	explicit EngineProfileZone(const char *name) : name{name}, start{EngineProfiler::ticks()} {}
+	~EngineProfileZone() {EngineProfiler::get().recordZone(name, start, EngineProfiler::ticks());}
+
+	EngineProfileZone(const EngineProfileZone &) = delete;
+	EngineProfileZone &operator=(const EngineProfileZone &) = delete;
+
+private:
+	const char *name;
+	uint64_t start;
+};
+} // namespace
+
+#define ENGINE_PROFILE_CONCAT_INNER(a, b) a##b
+#define ENGINE_PROFILE_CONCAT(a, b) ENGINE_PROFILE_CONCAT_INNER(a, b)
+#define ENGINE_PROFILE_ZONE(name) ::Engine::EngineProfileZone ENGINE_PROFILE_CONCAT(profileZone, __LINE__){name}
+#define ENGINE_PROFILE_COUNTER(name, value) ::Engine::EngineProfiler::get().recordCounter(name, static_cast<double>(value))
+#define ENGINE_PROFILE_FRAME() ::Engine::EngineProfiler::get().beginFrame()
+#define ENGINE_PROFILE_DUMP(path) ::Engine::EngineProfiler::get().writeChromeTrace(path)
+
+#else
+
+#define ENGINE_PROFILE_ZONE(name)
+#define ENGINE_PROFILE_COUNTER(name, value) ((void)0)
+#define ENGINE_PROFILE_FRAME() ((void)0)
+#define ENGINE_PROFILE_DUMP(path) ((void)0)
+
+#endif
+
+#endif
@@ -11,17 +11,30 @@
 #include "engine_game_object.h"
 #include "engine_camera.h"
 #include "engine_frame_info.h"
+#include "engine_buffer.h"
+#include "engine_descriptor.h"
+#include "engine_layout_cache.h"
+#include "engine_bindless.h"
+#include "engine_swap_chain.h"
+#include "engine_culling.h"
+#include "engine_command_recorder.h"
+#include "engine_profiler.h"
 
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
 #include <stdexcept>
 #include <array>
+#include <algorithm>
+#include <functional>
 
 namespace Engine{
 
-struct SimplePushConstantData{
+// Per instance data read by shader.vert from the instance storage buffer (set 1) via gl_InstanceIndex,
+// shader_bindless.vert finds the buffer through a pushed bindless handle instead
+struct InstanceData{
 	glm::mat4 meshMatrix{1.0f};
 	glm::mat4 normalMatrix{1.0f};
 };
@@ -29,77 +42,289 @@ struct SimplePushConstantData{
 class RenderSystem{
 public:
 
-	RenderSystem(EngineDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : engineDevice{device} 
+	static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+	static constexpr uint32_t CULLING_GRAIN_SIZE = 4096;   // objects per culling job
+
+	static constexpr const char *VERT_SHADER_PATH = ENGINE_SHADER_DIR "shader.vert.spv";
+	static constexpr const char *FRAG_SHADER_PATH = ENGINE_SHADER_DIR "shader.frag.spv";
+	static constexpr const char *BINDLESS_VERT_SHADER_PATH = ENGINE_SHADER_DIR "shader_bindless.vert.spv";
+
+	// Set 0 is the shared global set, the instance set and the rest of the layout come from the shaders,
+	// instance sets are allocated every frame. With a bindless table set 1 is the table's set and the
+	// instance buffers are registered in it.
+	RenderSystem(
+		EngineDevice& device,
+		VkRenderPass renderPass,
+		VkDescriptorSetLayout globalSetLayout,
+		EngineLayoutCache &layoutCache,
+		EngineDescriptorAllocator &descriptorAllocator,
+		EngineBindlessTable *bindlessTable = nullptr)
+	: engineDevice{device}, descriptorAllocator{descriptorAllocator}, bindlessTable{bindlessTable}
 	{
-		createPipelineLayout(globalSetLayout);
+		EngineShaderReflection reflection = EnginePipeline::reflect({getVertShaderPath(), FRAG_SHADER_PATH});
+		if (bindlessTable){
+			if (reflection.getPushConstantSize() != sizeof(uint32_t)) throw std::runtime_error("shader_bindless.vert should push one buffer handle");
+			pipelineLayout = layoutCache.getPipelineLayout(reflection, {globalSetLayout, bindlessTable->getSetLayout()});
+		}
+		else{
+			instanceSetLayout = &layoutCache.getSetLayout(reflection, 1);
+			pipelineLayout = layoutCache.getPipelineLayout(reflection, {globalSetLayout});
+		}
+		createInstanceBuffers();
 		createPipeline(renderPass);
 	}
 
-
-	~RenderSystem() {vkDestroyPipelineLayout(engineDevice.device(), pipelineLayout, nullptr);};
+	~RenderSystem(){
+		for (auto handle : instanceHandles) bindlessTable->releaseBuffer(handle);
+	}
 	
 	RenderSystem(const RenderSystem &) = delete;
 	RenderSystem &operator=(const RenderSystem &) = delete;	
 
 
-	void renderGameObjects(FrameInfo &frameInfo, std::vector<EngineGameObject>& gameObjects)
+	// Objects outside the camera frustum are culled, the rest are drawn with one instanced draw per mesh
+	// and their matrices go to this frame's instance buffer
+	void renderGameObjects(FrameInfo &frameInfo, std::vector<EngineGameObject>& gameObjects, const EngineTransformStore &transforms)
 	{
-		enginePipeline->bind(frameInfo.commandBuffer);
+		ENGINE_PROFILE_ZONE("renderGameObjects");
+		prepareBatches(frameInfo, gameObjects, transforms, nullptr);
+		writeInstances(frameInfo, transforms, 0, visibleCount);
+		instanceBuffers[frameInfo.frameIndex]->flush();
+		recordBatches(frameInfo, frameInfo.commandBuffer, 0, static_cast<uint32_t>(batches.size()));
+	}
+
+	// Same as above, with culling on the recorder's job system and the instance writes and draws split across
+	// its slots. Each slot records its share of the mesh batches into its own secondary command buffer.
+	void renderGameObjects(FrameInfo &frameInfo, std::vector<EngineGameObject>& gameObjects, const EngineTransformStore &transforms, EngineCommandRecorder &recorder)
+	{
+		ENGINE_PROFILE_ZONE("renderGameObjects");
+		prepareBatches(frameInfo, gameObjects, transforms, &recorder.getJobSystem());
+
+		uint32_t slotCount = recorder.getSlotCount();
+		uint32_t batchCount = static_cast<uint32_t>(batches.size());
+		recorder.record([&](uint32_t slot, VkCommandBuffer commandBuffer) {
+			ENGINE_PROFILE_ZONE("record slot");
+			writeInstances(frameInfo, transforms, visibleCount * slot / slotCount, visibleCount * (slot + 1) / slotCount);
+			recordBatches(frameInfo, commandBuffer, batchCount * slot / slotCount, batchCount * (slot + 1) / slotCount);
+		});
+		instanceBuffers[frameInfo.frameIndex]->flush();
+	}
+
+	// GPU culled path, one indirect draw per mesh reading drawBuffer[i] and the compacted instances (see GpuCullingSystem)
+	void renderIndirect(
+		FrameInfo &frameInfo,
+		const std::vector<std::shared_ptr<EngineMesh>> &meshes,
+		VkBuffer drawBuffer,
+		VkDescriptorSet instanceDescriptorSet)
+	{
+		bindPipeline(frameInfo, frameInfo.commandBuffer, instanceDescriptorSet, {});
+		recordIndirect(frameInfo, meshes, drawBuffer);
+	}
+
+	// Same as above for a bindless render system, the instances are read through their handle
+	void renderIndirect(
+		FrameInfo &frameInfo,
+		const std::vector<std::shared_ptr<EngineMesh>> &meshes,
+		VkBuffer drawBuffer,
+		EngineResourceHandle instanceBuffer)
+	{
+		bindPipeline(frameInfo, frameInfo.commandBuffer, VK_NULL_HANDLE, instanceBuffer);
+		recordIndirect(frameInfo, meshes, drawBuffer);
+	}
+
+	bool isBindless() const {return bindlessTable != nullptr;}
+
+	// Draw calls and CPU submitted instances recorded by the last render call
+	uint32_t getDrawCallCount() const {return drawCallCount;}
+	uint32_t getInstanceCount() const {return instanceCount;}
+	uint32_t getCulledCount() const {return culledCount;}
+	uint64_t getTriangleCount() const {return triangleCount;}
+
+
+private:
+
+	struct MeshBatch{
+		EngineMesh *mesh;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	const char *getVertShaderPath() const {return bindlessTable ? BINDLESS_VERT_SHADER_PATH : VERT_SHADER_PATH;}
 
+	// Binds the pipeline, the global set and either the instance set or the bindless table with the instance buffer's handle
+	void bindPipeline(FrameInfo &frameInfo, VkCommandBuffer commandBuffer, VkDescriptorSet instanceDescriptorSet, EngineResourceHandle instanceBuffer) {
+		enginePipeline->bind(commandBuffer);
+
+		VkDescriptorSet descriptorSets[] = {frameInfo.globalDescriptorSet, bindlessTable ? bindlessTable->getDescriptorSet() : instanceDescriptorSet};
 		vkCmdBindDescriptorSets(
-			frameInfo.commandBuffer,
+			commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
 			0, 
-			1, 
-			&frameInfo.globalDescriptorSet,
+			2, 
+			descriptorSets,
 			0, 
 			nullptr);
 
-		// Render game objects
-		for (auto& obj : gameObjects){
-
-			SimplePushConstantData push{};
-			push.meshMatrix = obj.transform.mat4();
-			push.normalMatrix = obj.transform.normalMatrix();
-
-			vkCmdPushConstants(
-				frameInfo.commandBuffer, 
-				pipelineLayout, 
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
-				0, 
-				sizeof(SimplePushConstantData), 
-				&push);
-			obj.mesh->bind(frameInfo.commandBuffer);
-			obj.mesh->draw(frameInfo.commandBuffer);
+		if (bindlessTable){
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &instanceBuffer.index);
 		}
 	}
 
+	void recordIndirect(FrameInfo &frameInfo, const std::vector<std::shared_ptr<EngineMesh>> &meshes, VkBuffer drawBuffer) {
+		drawCallCount = 0;
+		for (size_t i = 0; i < meshes.size(); i++){
+			meshes[i]->bind(frameInfo.commandBuffer);
+			vkCmdDrawIndexedIndirect(
+				frameInfo.commandBuffer,
+				drawBuffer,
+				i * sizeof(VkDrawIndexedIndirectCommand),
+				1,
+				sizeof(VkDrawIndexedIndirectCommand));
+			drawCallCount++;
+		}
+		instanceCount = 0; // only known on the GPU
+		culledCount = 0;
+		triangleCount = 0;
+	}
 
-private:
+	// Culls the drawable objects, groups the visible ones by mesh and assigns every one its instance slot.
+	// World matrices come from the transform store, sphere transforms and tests run as parallelFor ranges when a job system is given.
+	void prepareBatches(FrameInfo &frameInfo, std::vector<EngineGameObject>& gameObjects, const EngineTransformStore &transforms, EngineJobSystem *jobSystem) {
+		ENGINE_PROFILE_ZONE("prepareBatches");
+		auto forRanges = [&](size_t count, const std::function<void(size_t, size_t)> &function) {
+			if (jobSystem) jobSystem->parallelFor(count, CULLING_GRAIN_SIZE, function);
+			else function(0, count);
+		};
+
+		candidates.clear();
+		for (uint32_t i = 0; i < gameObjects.size(); i++){
+			EngineMesh *mesh = gameObjects[i].mesh.get();
+			if (mesh && mesh->isReady()) candidates.push_back(i);
+		}
+		uint32_t candidateCount = static_cast<uint32_t>(candidates.size());
+
+		// World space bounding spheres of every drawable object, tested in batches by cullSpheres
+		candidateTransforms.resize(candidateCount);
+		spheres.resize(candidateCount);
+		forRanges(candidateCount, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++){
+				EngineGameObject &gameObject = gameObjects[candidates[c]];
+				candidateTransforms[c] = transforms.getIndex(gameObject.transform);
+				spheres.set(c, transformSphere(transforms.getWorldMatrices()[candidateTransforms[c]], gameObject.mesh->getBoundingSphere()));
+			}
+		});
+
+		// Every range writes its survivors from its own begin, then the ranges are compacted in order
+		Frustum frustum = extractFrustum(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+		uint32_t rangeCount = (candidateCount + CULLING_GRAIN_SIZE - 1) / CULLING_GRAIN_SIZE;
+		visible.resize(candidateCount);
+		rangeVisibleCounts.assign(rangeCount, 0);
+		forRanges(rangeCount, [&](size_t begin, size_t end) {
+			for (size_t range = begin; range < end; range++){
+				uint32_t first = static_cast<uint32_t>(range) * CULLING_GRAIN_SIZE;
+				uint32_t last = std::min(candidateCount, first + CULLING_GRAIN_SIZE);
+				rangeVisibleCounts[range] = cullSpheres(frustum, spheres, first, last, visible.data() + first);
+			}
+		});
+		visibleCount = 0;
+		for (uint32_t range = 0; range < rangeCount; range++){
+			uint32_t first = range * CULLING_GRAIN_SIZE;
+			if (first != visibleCount) std::copy_n(visible.begin() + first, rangeVisibleCounts[range], visible.begin() + visibleCount);
+			visibleCount += rangeVisibleCounts[range];
+		}
+		culledCount = candidateCount - visibleCount;
+
+		// Group by mesh, objectSlot first holds each visible object's group and then its instance index
+		batches.clear();
+		batchLookup.clear();
+		objectSlot.resize(visibleCount);
+		for (uint32_t v = 0; v < visibleCount; v++){
+			EngineMesh *mesh = gameObjects[candidates[visible[v]]].mesh.get();
+			auto result = batchLookup.try_emplace(mesh, static_cast<uint32_t>(batches.size()));
+			if (result.second) batches.push_back({mesh, 0, 0});
+			objectSlot[v] = result.first->second;
+			batches[objectSlot[v]].instanceCount++;
+		}
+
+		uint32_t totalInstances = 0;
+		triangleCount = 0;
+		for (auto &batch : batches){
+			batch.firstInstance = totalInstances;
+			totalInstances += batch.instanceCount;
+			triangleCount += uint64_t(batch.mesh->getTriangleCount()) * batch.instanceCount;
+		}
+		reserveInstances(frameInfo.frameIndex, totalInstances);
+		if (!bindlessTable){
+			auto bufferInfo = instanceBuffers[frameInfo.frameIndex]->descriptorInfo();
+			frameInstanceSet = EngineDescriptorWriter(*instanceSetLayout)
+			.writeBuffer(0, &bufferInfo)
+			.build(descriptorAllocator, frameInfo.frameIndex);
+		}
 
-	void createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+		batchCursors.resize(batches.size());
+		for (size_t i = 0; i < batches.size(); i++) batchCursors[i] = batches[i].firstInstance;
+		for (uint32_t v = 0; v < visibleCount; v++) objectSlot[v] = batchCursors[objectSlot[v]]++;
 
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
+		drawCallCount = static_cast<uint32_t>(batches.size());
+		instanceCount = totalInstances;
+		ENGINE_PROFILE_COUNTER("visible objects", visibleCount);
+		ENGINE_PROFILE_COUNTER("draw calls", drawCallCount);
+	}
 
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+	// Writes visible objects [begin, end), ranges written by different threads never overlap
+	void writeInstances(FrameInfo &frameInfo, const EngineTransformStore &transforms, uint32_t begin, uint32_t end) {
+		InstanceData *instances = static_cast<InstanceData *>(instanceBuffers[frameInfo.frameIndex]->getMappedMemory());
+		const glm::mat4 *worldMatrices = transforms.getWorldMatrices();
+		const glm::mat4 *normalMatrices = transforms.getNormalMatrices();
+		for (uint32_t v = begin; v < end; v++){
+			InstanceData &instance = instances[objectSlot[v]];
+			uint32_t transform = candidateTransforms[visible[v]];
+			instance.meshMatrix = worldMatrices[transform];
+			instance.normalMatrix = normalMatrices[transform];
+		}
+	}
 
+	void recordBatches(FrameInfo &frameInfo, VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) {
+		if (begin == end) return;
+		if (bindlessTable) bindPipeline(frameInfo, commandBuffer, VK_NULL_HANDLE, instanceHandles[frameInfo.frameIndex]);
+		else bindPipeline(frameInfo, commandBuffer, frameInstanceSet, {});
 
+		for (uint32_t i = begin; i < end; i++){
+			batches[i].mesh->bind(commandBuffer);
+			batches[i].mesh->draw(commandBuffer, batches[i].instanceCount, batches[i].firstInstance);
+		}
+	}
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-		if (vkCreatePipelineLayout(engineDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS){
-			throw std::runtime_error("failed to create pipeline layout!");
+	void createInstanceBuffers() {
+		instanceBuffers.resize(EngineSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (int i = 0; i < EngineSwapChain::MAX_FRAMES_IN_FLIGHT; i++){
+			createInstanceBuffer(i, INITIAL_INSTANCE_CAPACITY);
+			if (bindlessTable) instanceHandles.push_back(bindlessTable->registerBuffer(*instanceBuffers[i]));
 		}
 	}
 
+	void createInstanceBuffer(int frameIndex, uint32_t capacity) {
+		instanceBuffers[frameIndex] = std::make_unique<EngineBuffer>(
+			engineDevice,
+			sizeof(InstanceData),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		instanceBuffers[frameIndex]->map();
+	}
+
+	// The frame's previous submission has finished by the time it is recorded again, so its buffer can be replaced.
+	// Instance sets are written every frame, only bindless handles need to follow the new buffer.
+	void reserveInstances(int frameIndex, uint32_t count) {
+		uint32_t capacity = instanceBuffers[frameIndex]->getInstanceCount();
+		if (count <= capacity) return;
+
+		while (capacity < count) capacity *= 2;
+		createInstanceBuffer(frameIndex, capacity);
+		if (bindlessTable) bindlessTable->updateBuffer(instanceHandles[frameIndex], instanceBuffers[frameIndex]->descriptorInfo());
+	}
+
 	void createPipeline(VkRenderPass renderPass) {
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout!");
 
@@ -109,15 +334,39 @@ private:
 		pipelineConfig.pipelineLayout = pipelineLayout;
 		enginePipeline = std::make_unique<EnginePipeline>(
 			engineDevice, 
-			"../shaders/shader.vert.spv", 
-			"../shaders/shader.frag.spv", 
+			getVertShaderPath(), 
+			FRAG_SHADER_PATH, 
 			pipelineConfig);
 	}
 
 
     EngineDevice& engineDevice;
     std::unique_ptr<EnginePipeline> enginePipeline;
-    VkPipelineLayout pipelineLayout;
+    VkPipelineLayout pipelineLayout;   // owned by the layout cache
+
+    EngineDescriptorSetLayout *instanceSetLayout = nullptr;   // owned by the layout cache
+    EngineDescriptorAllocator &descriptorAllocator;
+    std::vector<std::unique_ptr<EngineBuffer>> instanceBuffers;
+    VkDescriptorSet frameInstanceSet = VK_NULL_HANDLE;   // this frame's, from the descriptor allocator
+    EngineBindlessTable *bindlessTable;             // replaces the instance sets when set
+    std::vector<EngineResourceHandle> instanceHandles;   // per frame, bindless only
+
+    // Per frame scratch, kept to avoid reallocating every frame
+    std::vector<uint32_t> candidates;      // drawable object indices
+    std::vector<uint32_t> candidateTransforms;   // dense transform store index per candidate
+    CullingSpheres spheres;                // per candidate
+    std::vector<uint32_t> visible;         // candidate indices that passed culling
+    std::vector<uint32_t> rangeVisibleCounts;
+    std::vector<MeshBatch> batches;
+    std::unordered_map<EngineMesh *, uint32_t> batchLookup;
+    std::vector<uint32_t> objectSlot;      // per visible object
+    std::vector<uint32_t> batchCursors;
+
+    uint32_t visibleCount = 0;
+    uint32_t drawCallCount = 0;
+    uint32_t instanceCount = 0;
+    uint32_t culledCount = 0;
+    uint64_t triangleCount = 0;
 };
 
 
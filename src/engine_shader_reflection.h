@@ -0,0 +1,420 @@
+#ifndef ENGINE_SHADER_REFLECTION_H
+#define ENGINE_SHADER_REFLECTION_H
+
+/*
+ * SPIR-V reflection
+ *
+ * Walks the instruction stream of a compiled shader module and collects what the pipeline layout
+ * and vertex input state need: descriptor bindings (set, binding, type, array size, stage, block
+ * size), the push constant range and the vertex shader's input locations. Reflections of the
+ * stages of one pipeline are merged, so a binding used by both stages gets both stage bits.
+ *
+ * Only the instructions that describe interface variables are read, everything else is skipped
+ * by its word count. Runtime arrays of descriptors reflect with a count of 0.
+ */
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+namespace Engine{
+
+struct EngineShaderBinding{
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	uint32_t count = 1;        // array size, 0 for a runtime array
+	VkShaderStageFlags stages = 0;
+	uint32_t blockSize = 0;    // uniform and storage blocks, without the trailing runtime array
+	std::string name;          // block type name for buffers, variable name otherwise
+};
+
+struct EngineShaderInput{
+	uint32_t location = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	std::string name;
+};
+
+class EngineShaderReflection{
+public:
+	EngineShaderReflection() = default;
+
+	explicit EngineShaderReflection(const std::vector<char> &code, const std::string &name = "shader"){
+		if (code.size() % 4 != 0 || code.size() < 20) throw std::runtime_error("not a SPIR-V module: " + name);
+		words.resize(code.size() / 4);
+		std::copy(code.begin(), code.end(), reinterpret_cast<char *>(words.data()));
+		if (words[0] != SPIRV_MAGIC) throw std::runtime_error("not a SPIR-V module: " + name);
+		parse(name);
+		words.clear();
+		ids.clear();
+	}
+
+	// Adds another stage of the same pipeline, the same binding must have the same type in both
+	void merge(const EngineShaderReflection &other){
+		stages |= other.stages;
+		for (const auto &binding : other.bindings){
+			EngineShaderBinding *existing = findBinding(binding.set, binding.binding);
+			if (!existing){
+				bindings.push_back(binding);
+				continue;
+			}
+			if (existing->type != binding.type || existing->count != binding.count){
+				throw std::runtime_error("shader stages disagree on set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding));
+			}
+			existing->stages |= binding.stages;
+			existing->blockSize = std::max(existing->blockSize, binding.blockSize);
+		}
+		std::sort(bindings.begin(), bindings.end(), [](const auto &a, const auto &b) {
+			return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+		});
+
+		for (const auto &range : other.pushConstantRanges){
+			if (pushConstantRanges.empty()){
+				pushConstantRanges.push_back(range);
+				continue;
+			}
+			// one range for all stages, push constants are then written with the merged stage flags
+			VkPushConstantRange &merged = pushConstantRanges[0];
+			uint32_t end = std::max(merged.offset + merged.size, range.offset + range.size);
+			merged.offset = std::min(merged.offset, range.offset);
+			merged.size = end - merged.offset;
+			merged.stageFlags |= range.stageFlags;
+		}
+
+		if (other.stages & VK_SHADER_STAGE_VERTEX_BIT) vertexInputs = other.vertexInputs;
+	}
+
+	VkShaderStageFlags getStages() const {return stages;}
+	const std::vector<EngineShaderBinding> &getBindings() const {return bindings;}
+	const std::vector<VkPushConstantRange> &getPushConstantRanges() const {return pushConstantRanges;}
+	const std::vector<EngineShaderInput> &getVertexInputs() const {return vertexInputs;}
+
+	// Highest used set + 1, sets in between may be empty
+	uint32_t getSetCount() const {return bindings.empty() ? 0 : bindings.back().set + 1;}
+
+	std::vector<VkDescriptorSetLayoutBinding> getSetBindings(uint32_t set) const {
+		std::vector<VkDescriptorSetLayoutBinding> setBindings;
+		for (const auto &binding : bindings){
+			if (binding.set != set) continue;
+			VkDescriptorSetLayoutBinding layoutBinding{};
+			layoutBinding.binding = binding.binding;
+			layoutBinding.descriptorType = binding.type;
+			layoutBinding.descriptorCount = binding.count;
+			layoutBinding.stageFlags = binding.stages;
+			setBindings.push_back(layoutBinding);
+		}
+		return setBindings;
+	}
+
+	const EngineShaderBinding *findBinding(uint32_t set, uint32_t binding) const {
+		for (const auto &b : bindings) if (b.set == set && b.binding == binding) return &b;
+		return nullptr;
+	}
+
+	uint32_t getPushConstantSize() const {return pushConstantRanges.empty() ? 0 : pushConstantRanges[0].offset + pushConstantRanges[0].size;}
+
+private:
+	static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+	static constexpr uint32_t HEADER_WORDS = 5;
+
+	enum Op : uint32_t {
+		OpName = 5, OpEntryPoint = 15, OpTypeBool = 20, OpTypeInt = 21, OpTypeFloat = 22, OpTypeVector = 23, OpTypeMatrix = 24,
+		OpTypeImage = 25, OpTypeSampler = 26, OpTypeSampledImage = 27, OpTypeArray = 28, OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30, OpTypePointer = 32, OpConstant = 43, OpVariable = 59, OpDecorate = 71, OpMemberDecorate = 72,
+		OpTypeAccelerationStructure = 5341
+	};
+	enum Decoration : uint32_t {
+		Block = 2, BufferBlock = 3, ArrayStride = 6, MatrixStride = 7, BuiltIn = 11, Location = 30, Binding = 33,
+		DescriptorSet = 34, Offset = 35
+	};
+	enum StorageClass : uint32_t {UniformConstant = 0, Input = 1, Uniform = 2, PushConstant = 9, StorageBuffer = 12};
+
+	// What the parser keeps per result id
+	struct Id{
+		uint32_t opcode = 0;
+		uint32_t storageClass = 0;   // pointers and variables
+		uint32_t type = 0;           // pointee, element, component or variable type
+		uint32_t count = 0;          // vector and matrix size, image dim, constant value
+		uint32_t width = 0;          // scalar width, sampled flag of images
+		bool isSigned = false;
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+		std::string name;
+		uint32_t set = UINT32_MAX, binding = UINT32_MAX, location = UINT32_MAX;
+		uint32_t arrayStride = 0;
+		bool block = false, bufferBlock = false, builtIn = false;
+	};
+
+	void parse(const std::string &moduleName){
+		ids.resize(words[3]);
+		std::vector<uint32_t> variables;
+
+		for (size_t i = HEADER_WORDS; i < words.size();){
+			uint32_t wordCount = words[i] >> 16;
+			uint32_t opcode = words[i] & 0xffff;
+			if (wordCount == 0 || i + wordCount > words.size()) throw std::runtime_error("truncated SPIR-V module: " + moduleName);
+			const uint32_t *operands = &words[i + 1];
+
+			switch (opcode){
+			case OpName:
+				ids.at(operands[0]).name = readString(operands + 1, wordCount - 2);
+				break;
+			case OpEntryPoint:
+				stages |= executionModelStage(operands[0]);
+				break;
+			case OpDecorate:
+				decorate(ids.at(operands[0]), operands[1], wordCount > 3 ? operands[2] : 0);
+				break;
+			case OpMemberDecorate:{
+				Id &id = ids.at(operands[0]);
+				uint32_t member = operands[1];
+				if (operands[2] == Offset) setMember(id.memberOffsets, member, operands[3]);
+				else if (operands[2] == MatrixStride) setMember(id.memberMatrixStrides, member, operands[3]);
+				break;
+			}
+			case OpTypeBool:
+				define(operands[0], opcode).width = 32;
+				break;
+			case OpTypeInt:{
+				Id &id = define(operands[0], opcode);
+				id.width = operands[1];
+				id.isSigned = operands[2] != 0;
+				break;
+			}
+			case OpTypeFloat:
+				define(operands[0], opcode).width = operands[1];
+				break;
+			case OpTypeVector:
+			case OpTypeMatrix:{
+				Id &id = define(operands[0], opcode);
+				id.type = operands[1];
+				id.count = operands[2];
+				break;
+			}
+			case OpTypeImage:{
+				Id &id = define(operands[0], opcode);
+				id.count = operands[2];   // dim
+				id.width = operands[6];   // sampled, 2 for storage images
+				break;
+			}
+			case OpTypeSampler:
+			case OpTypeAccelerationStructure:
+				define(operands[0], opcode);
+				break;
+			case OpTypeSampledImage:
+			case OpTypeRuntimeArray:
+				define(operands[0], opcode).type = operands[1];
+				break;
+			case OpTypeArray:{
+				Id &id = define(operands[0], opcode);
+				id.type = operands[1];
+				id.count = ids.at(operands[2]).count;   // length is a constant id
+				break;
+			}
+			case OpTypeStruct:
+				define(operands[0], opcode).members.assign(operands + 1, operands + wordCount - 1);
+				break;
+			case OpTypePointer:{
+				Id &id = define(operands[0], opcode);
+				id.storageClass = operands[1];
+				id.type = operands[2];
+				break;
+			}
+			case OpConstant:
+				// array lengths, only the low word matters
+				define(operands[1], opcode).count = operands[2];
+				break;
+			case OpVariable:{
+				Id &id = define(operands[1], opcode);
+				id.type = operands[0];
+				id.storageClass = operands[2];
+				variables.push_back(operands[1]);
+				break;
+			}
+			default:
+				break;
+			}
+			i += wordCount;
+		}
+
+		for (uint32_t variable : variables) reflectVariable(ids[variable]);
+		std::sort(bindings.begin(), bindings.end(), [](const auto &a, const auto &b) {
+			return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+		});
+		std::sort(vertexInputs.begin(), vertexInputs.end(), [](const auto &a, const auto &b) {return a.location < b.location;});
+	}
+
+	Id &define(uint32_t id, uint32_t opcode){
+		Id &result = ids.at(id);
+		result.opcode = opcode;
+		return result;
+	}
+
+	static void setMember(std::vector<uint32_t> &values, uint32_t member, uint32_t value){
+		if (values.size() <= member) values.resize(member + 1, 0);
+		values[member] = value;
+	}
+
+	static void decorate(Id &id, uint32_t decoration, uint32_t value){
+		switch (decoration){
+		case Block: id.block = true; break;
+		case BufferBlock: id.bufferBlock = true; break;
+		case ArrayStride: id.arrayStride = value; break;
+		case BuiltIn: id.builtIn = true; break;
+		case Location: id.location = value; break;
+		case Binding: id.binding = value; break;
+		case DescriptorSet: id.set = value; break;
+		default: break;
+		}
+	}
+
+	static std::string readString(const uint32_t *operands, uint32_t wordCount){
+		const char *characters = reinterpret_cast<const char *>(operands);
+		size_t length = 0;
+		while (length < wordCount * 4 && characters[length] != '\0') length++;
+		return std::string{characters, length};
+	}
+
+	static VkShaderStageFlags executionModelStage(uint32_t model){
+		switch (model){
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default: return 0;
+		}
+	}
+
+	void reflectVariable(const Id &variable){
+		const Id &pointer = ids[variable.type];
+		uint32_t typeId = pointer.type;
+
+		if (variable.storageClass == PushConstant){
+			uint32_t offset = UINT32_MAX;
+			for (uint32_t offsetValue : ids[typeId].memberOffsets) offset = std::min(offset, offsetValue);
+			if (offset == UINT32_MAX) offset = 0;
+			uint32_t size = typeSize(typeId);
+			pushConstantRanges.push_back({stages, offset, size - offset});
+			return;
+		}
+
+		if (variable.storageClass == Input){
+			if (!(stages & VK_SHADER_STAGE_VERTEX_BIT) || variable.builtIn || variable.location == UINT32_MAX) return;
+			vertexInputs.push_back({variable.location, vertexFormat(typeId), variable.name});
+			return;
+		}
+
+		if (variable.storageClass != UniformConstant && variable.storageClass != Uniform && variable.storageClass != StorageBuffer) return;
+		if (variable.set == UINT32_MAX || variable.binding == UINT32_MAX) return;
+
+		EngineShaderBinding binding{};
+		binding.set = variable.set;
+		binding.binding = variable.binding;
+		binding.stages = stages;
+
+		// arrays of descriptors
+		while (ids[typeId].opcode == OpTypeArray || ids[typeId].opcode == OpTypeRuntimeArray){
+			binding.count *= ids[typeId].opcode == OpTypeArray ? ids[typeId].count : 0;
+			typeId = ids[typeId].type;
+		}
+
+		const Id &type = ids[typeId];
+		binding.name = variable.name.empty() ? type.name : variable.name;
+		if (variable.storageClass == StorageBuffer || (variable.storageClass == Uniform && type.bufferBlock)){
+			binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			binding.blockSize = typeSize(typeId);
+			binding.name = type.name;
+		}
+		else if (variable.storageClass == Uniform){
+			binding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			binding.blockSize = typeSize(typeId);
+			binding.name = type.name;
+		}
+		else binding.type = resourceType(type);
+
+		if (binding.type == VK_DESCRIPTOR_TYPE_MAX_ENUM) return;
+		bindings.push_back(binding);
+	}
+
+	VkDescriptorType resourceType(const Id &type) const {
+		constexpr uint32_t DimBuffer = 5, DimSubpassData = 6;
+		switch (type.opcode){
+		case OpTypeSampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case OpTypeSampledImage: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case OpTypeImage:
+			if (type.count == DimBuffer) return type.width == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			if (type.count == DimSubpassData) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			return type.width == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		default: return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+		}
+	}
+
+	// Size in bytes as laid out by the Offset, ArrayStride and MatrixStride decorations, runtime arrays count as 0
+	uint32_t typeSize(uint32_t typeId, uint32_t matrixStride = 0) const {
+		const Id &type = ids[typeId];
+		switch (type.opcode){
+		case OpTypeBool:
+		case OpTypeInt:
+		case OpTypeFloat:
+			return type.width / 8;
+		case OpTypeVector:
+			return type.count * typeSize(type.type);
+		case OpTypeMatrix:
+			return type.count * (matrixStride ? matrixStride : typeSize(type.type));
+		case OpTypeArray:
+			return type.count * (type.arrayStride ? type.arrayStride : typeSize(type.type));
+		case OpTypeStruct:{
+			uint32_t size = 0;
+			for (size_t m = 0; m < type.members.size(); m++){
+				uint32_t offset = m < type.memberOffsets.size() ? type.memberOffsets[m] : size;
+				uint32_t stride = m < type.memberMatrixStrides.size() ? type.memberMatrixStrides[m] : 0;
+				size = std::max(size, offset + typeSize(type.members[m], stride));
+			}
+			return size;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	VkFormat vertexFormat(uint32_t typeId) const {
+		const Id &type = ids[typeId];
+		uint32_t components = type.opcode == OpTypeVector ? type.count : 1;
+		const Id &scalar = type.opcode == OpTypeVector ? ids[type.type] : type;
+		if (scalar.width != 32) return VK_FORMAT_UNDEFINED;
+
+		static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+		static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+		static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+		if (components < 1 || components > 4) return VK_FORMAT_UNDEFINED;
+		if (scalar.opcode == OpTypeFloat) return floatFormats[components - 1];
+		if (scalar.opcode == OpTypeInt) return scalar.isSigned ? intFormats[components - 1] : uintFormats[components - 1];
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	EngineShaderBinding *findBinding(uint32_t set, uint32_t binding){
+		for (auto &b : bindings) if (b.set == set && b.binding == binding) return &b;
+		return nullptr;
+	}
+
+	VkShaderStageFlags stages = 0;
+	std::vector<EngineShaderBinding> bindings;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	std::vector<EngineShaderInput> vertexInputs;
+
+	// parse state
+	std::vector<uint32_t> words;
+	std::vector<Id> ids;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef ENGINE_STAGING_RING_H
+#define ENGINE_STAGING_RING_H
+
+/*
+ * Persistently mapped ring buffer for host to device staging
+ *
+ * allocate() hands out aligned regions from the head of the ring. submit(fence) tags every region
+ * handed out since the previous submit with the fence of the submission that reads them, and
+ * reclaim() moves the tail past regions whose fences have signalled. Regions never wrap, a region
+ * that does not fit before the end of the ring starts again at offset 0.
+ *
+ * Fences must not be reset before reclaim() has seen them signalled.
+ */
+
+#include "engine_device.h"
+#include "engine_buffer.h"
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+namespace Engine{
+
+struct EngineStagingRegion{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void *mapped = nullptr;
+};
+
+struct EngineStagingRingStats{
+	VkDeviceSize capacity = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize peakUsedBytes = 0;
+	uint32_t allocationCount = 0;
+	uint32_t wrapCount = 0;
+	uint32_t stallCount = 0;     // times the host waited on a fence for space
+};
+
+class EngineStagingRing{
+public:
+	static constexpr VkDeviceSize DEFAULT_SIZE = 32ull * 1024 * 1024;
+
+	EngineStagingRing(EngineDevice &device, VkDeviceSize size = DEFAULT_SIZE) : engineDevice{device}, capacity{size} {
+		buffer = std::make_unique<EngineBuffer>(
+			engineDevice,
+			capacity,
+			1,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		buffer->map();
+	}
+
+	EngineStagingRing(const EngineStagingRing &) = delete;
+	EngineStagingRing &operator=(const EngineStagingRing &) = delete;
+
+	// Returns false when the ring has no room until an in-flight fence signals
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, EngineStagingRegion &region){
+		if (size > capacity) return false;
+
+		VkDeviceSize position = head % capacity;
+		VkDeviceSize offset = (position + alignment - 1) / alignment * alignment;
+		bool wraps = offset + size > capacity;
+		if (wraps) offset = 0;
+
+		// Bytes consumed including alignment padding or the skipped tail end of the ring
+		VkDeviceSize consumed = wraps ? (capacity - position) + size : (offset - position) + size;
+		if ((head - tail) + consumed > capacity) return false;
+
+		head += consumed;
+		stats.allocationCount++;
+		if (wraps) stats.wrapCount++;
+		stats.peakUsedBytes = std::max(stats.peakUsedBytes, head - tail);
+
+		region.buffer = buffer->getBuffer();
+		region.offset = offset;
+		region.size = size;
+		region.mapped = static_cast<char *>(buffer->getMappedMemory()) + offset;
+		return true;
+	}
+
+	// Regions allocated since the last submit are released once fence signals
+	void submit(VkFence fence){
+		if (head == submittedHead) return;
+		inFlight.push_back({fence, head});
+		submittedHead = head;
+	}
+
+	// True if anything allocated has not been submitted yet
+	bool hasUnsubmitted() const {return head != submittedHead;}
+	bool hasInFlight() const {return !inFlight.empty();}
+
+	void reclaim(){
+		while (!inFlight.empty() && vkGetFenceStatus(engineDevice.device(), inFlight.front().fence) == VK_SUCCESS){
+			tail = inFlight.front().end;
+			inFlight.pop_front();
+		}
+	}
+
+	// Blocks on the oldest in-flight submission, counted as a stall
+	void waitForSpace(){
+		if (inFlight.empty()) return;
+		stats.stallCount++;
+		vkWaitForFences(engineDevice.device(), 1, &inFlight.front().fence, VK_TRUE, UINT64_MAX);
+		reclaim();
+	}
+
+	VkDeviceSize getCapacity() const {return capacity;}
+
+	EngineStagingRingStats getStats() const {
+		EngineStagingRingStats result = stats;
+		result.capacity = capacity;
+		result.usedBytes = head - tail;
+		return result;
+	}
+
+private:
+	struct InFlight{
+		VkFence fence;
+		uint64_t end;    // head position after the last region of the submission
+	};
+
+	EngineDevice &engineDevice;
+	std::unique_ptr<EngineBuffer> buffer;
+	VkDeviceSize capacity;
+
+	// Monotonic byte positions, the ring offset is position % capacity
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	uint64_t submittedHead = 0;
+	std::deque<InFlight> inFlight;
+
+	EngineStagingRingStats stats{};
+};
+} // namespace
+
+#endif
@@ -2,8 +2,15 @@
 #define ENGINE_SWAP_CHAIN_H
 
 #include "engine_device.h"
+#include "engine_buffer.h"
+#include "engine_profiler.h"
 #include <vulkan/vulkan.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
 #include <array>
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -16,9 +23,12 @@
 
 namespace Engine {
 
+// On a headless device the swap chain is a ring of offscreen colour images with the same format,
+// depth attachment and frame pacing; nothing is acquired or presented and writePng() reads an image back.
 class EngineSwapChain {
 public:
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t OFFSCREEN_IMAGE_COUNT = MAX_FRAMES_IN_FLIGHT + 1;
 
     EngineSwapChain(EngineDevice &deviceRef, VkExtent2D extent)
     : device{deviceRef}, windowExtent{extent} {
@@ -40,6 +50,11 @@ public:
             swapChain = nullptr;
         }
 
+        for (size_t i = 0; i < offscreenImageMemorys.size(); i++) {
+            vkDestroyImage(device.device(), swapChainImages[i], nullptr);
+            vkFreeMemory(device.device(), offscreenImageMemorys[i], nullptr);
+        }
+
         for (int i = 0; i < depthImages.size(); i++) {
             vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
             vkDestroyImage(device.device(), depthImages[i], nullptr);
@@ -83,12 +98,22 @@ public:
     }
 
     VkResult acquireNextImage(uint32_t *imageIndex){
-        vkWaitForFences(
-            device.device(),
-            1,
-            &inFlightFences[currentFrame],
-            VK_TRUE,
-            std::numeric_limits<uint64_t>::max());
+        ENGINE_PROFILE_ZONE("acquireNextImage");
+        {
+            ENGINE_PROFILE_ZONE("wait frame fence");
+            vkWaitForFences(
+                device.device(),
+                1,
+                &inFlightFences[currentFrame],
+                VK_TRUE,
+                std::numeric_limits<uint64_t>::max());
+        }
+
+        if (device.isHeadless()) {
+            *imageIndex = nextOffscreenImage;
+            nextOffscreenImage = (nextOffscreenImage + 1) % imageCount();
+            return VK_SUCCESS;
+        }
 
         VkResult result = vkAcquireNextImageKHR(
             device.device(),
@@ -101,8 +126,10 @@ public:
         return result;
     }
     VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex){
+        ENGINE_PROFILE_ZONE("submitCommandBuffers");
 
         if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
+            ENGINE_PROFILE_ZONE("wait image fence");
             vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
         }
         imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
@@ -123,11 +150,22 @@ public:
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
+        // no acquire to wait on and no present to signal
+        if (device.isHeadless()) {
+            submitInfo.waitSemaphoreCount = 0;
+            submitInfo.signalSemaphoreCount = 0;
+        }
+
         vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
         if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
 
+        if (device.isHeadless()) {
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+            return VK_SUCCESS;
+        }
+
         VkPresentInfoKHR presentInfo = {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -140,13 +178,61 @@ public:
 
         presentInfo.pImageIndices = imageIndex;
 
-        auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+        VkResult result;
+        {
+            ENGINE_PROFILE_ZONE("vkQueuePresentKHR");
+            result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+        }
 
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
         return result;
     }
 
+    // Headless only: waits for the graphics queue, copies the image to host memory and writes it as 8-bit RGBA
+    bool writePng(uint32_t imageIndex, const std::string &path){
+        assert(device.isHeadless() && "Only offscreen images can be read back");
+        uint32_t width = swapChainExtent.width;
+        uint32_t height = swapChainExtent.height;
+
+        EngineBuffer readbackBuffer{device, 4, width * height, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT};
+        readbackBuffer.map();
+
+        VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+
+        // the render pass leaves the image in TRANSFER_SRC_OPTIMAL, only the colour writes need to be made visible
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {width, height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.getBuffer(), 1, &region);
+
+        device.endSingleTimeCommands(commandBuffer);
+        readbackBuffer.invalidate();
+
+        std::vector<uint8_t> pixels(static_cast<const uint8_t *>(readbackBuffer.getMappedMemory()),
+            static_cast<const uint8_t *>(readbackBuffer.getMappedMemory()) + size_t(width) * height * 4);
+        if (swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB) {
+            for (size_t i = 0; i < pixels.size(); i += 4) std::swap(pixels[i], pixels[i + 2]);
+        }
+        return stbi_write_png(path.c_str(), int(width), int(height), 4, pixels.data(), int(width) * 4) != 0;
+    }
+
     bool compareSwapFormats(const EngineSwapChain &swapChain) const {
         return 
             swapChain.swapChainDepthFormat == swapChainDepthFormat && 
@@ -156,7 +242,8 @@ public:
 private:
 
     void Init(){
-        createSwapChain();
+        if (device.isHeadless()) createOffscreenImages();
+        else createSwapChain();
         createImageViews();
         createRenderPass();
         createDepthResources();
@@ -225,6 +312,42 @@ private:
         swapChainExtent = extent;
     }
 
+    // Same format the surface path prefers, transfer source for writePng
+    void createOffscreenImages(){
+        swapChainImageFormat = device.findSupportedFormat(
+            {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+        swapChainExtent = windowExtent;
+
+        swapChainImages.resize(OFFSCREEN_IMAGE_COUNT);
+        offscreenImageMemorys.resize(OFFSCREEN_IMAGE_COUNT);
+        for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = swapChainExtent.width;
+            imageInfo.extent.height = swapChainExtent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = swapChainImageFormat;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            device.createImageWithInfo(
+                imageInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                swapChainImages[i],
+                offscreenImageMemorys[i]);
+        }
+        std::cout << "Headless: " << OFFSCREEN_IMAGE_COUNT << " offscreen images, "
+            << swapChainExtent.width << "x" << swapChainExtent.height << std::endl;
+    }
+
     void createImageViews(){
         swapChainImageViews.resize(swapChainImages.size());
         for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -315,7 +438,7 @@ private:
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.finalLayout = device.isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference colorAttachmentRef = {};
         colorAttachmentRef.attachment = 0;
@@ -459,11 +582,13 @@ private:
     std::vector<VkImageView> depthImageViews;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkDeviceMemory> offscreenImageMemorys;   // headless only, the images are owned by the swap chain otherwise
+    uint32_t nextOffscreenImage = 0;
 
     EngineDevice &device;
     VkExtent2D windowExtent;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::shared_ptr<EngineSwapChain> oldSwapChain;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -0,0 +1,338 @@
+#ifndef ENGINE_TRANSFORM_BATCH_H
+#define ENGINE_TRANSFORM_BATCH_H
+
+/*
+ * Batched world and normal matrices for Tait-Bryan (YXZ) transforms
+ *
+ * computeTransformMatrices() fills the world and normal matrix of many transforms from one set of
+ * sine/cosine evaluations per object, where TransformComponent::mat4() and normalMatrix() each
+ * evaluate all six. The trig runs through sinCosBatch(), a Cephes style polynomial with AVX2 (8
+ * lanes), SSE2 or NEON (4 lanes) and a scalar tail that performs the same operations.
+ *
+ * Accuracy: for |x| <= 8192 sinCosBatch stays within 2 ULP of the correctly rounded result where
+ * |result| > 1e-3, and within an absolute error of 2e-10 closer to a root, where the range reduction
+ * error dominates (benchmarkTransformKernel checks both over every sample). Beyond 8192 the range
+ * reduction loses precision. The matrices then match the libm based TransformComponent path to
+ * within 4e-7 * scale per element. Both rely on building without FMA contraction (CMakeLists.txt).
+ */
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define ENGINE_TRANSFORM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define ENGINE_TRANSFORM_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define ENGINE_TRANSFORM_NEON
+#endif
+
+namespace Engine{
+
+namespace SinCosConstants{
+	constexpr float fourOverPi = 1.27323954473516f;
+	// pi/4 split in three, so j * pi/4 is subtracted without rounding away the low bits
+	constexpr float dp1 = -0.78515625f;
+	constexpr float dp2 = -2.4187564849853515625e-4f;
+	constexpr float dp3 = -3.77489497744594108e-8f;
+	constexpr float sin0 = -1.9515295891e-4f, sin1 = 8.3321608736e-3f, sin2 = -1.6666654611e-1f;
+	constexpr float cos0 = 2.443315711809948e-5f, cos1 = -1.388731625493765e-3f, cos2 = 4.166664568298827e-2f;
+}
+
+// Reference for the SIMD lanes, same operations in the same order
+inline void sinCosScalar(float x, float &s, float &c){
+	using namespace SinCosConstants;
+	float ax = std::fabs(x);
+	int32_t j = static_cast<int32_t>(ax * fourOverPi);
+	j = (j + 1) & ~1;   // even octant, the remainder lies in [-pi/4, pi/4]
+	float y = static_cast<float>(j);
+	float r = ((ax + y * dp1) + y * dp2) + y * dp3;
+
+	float z = r * r;
+	float cosPoly = ((cos0 * z + cos1) * z + cos2) * z * z - 0.5f * z + 1.0f;
+	float sinPoly = ((sin0 * z + sin1) * z + sin2) * z * r + r;
+
+	bool swap = (j & 2) != 0;
+	bool negateSin = ((j & 4) != 0) != (x < 0.0f);
+	bool negateCos = ((j - 2) & 4) == 0;
+	float sinValue = swap ? cosPoly : sinPoly;
+	float cosValue = swap ? sinPoly : cosPoly;
+	s = negateSin ? -sinValue : sinValue;
+	c = negateCos ? -cosValue : cosValue;
+}
+
+// s[i], c[i] = sin(x[i]), cos(x[i]) for i in [0, count)
+inline void sinCosBatch(const float *x, float *s, float *c, size_t count){
+	using namespace SinCosConstants;
+	size_t i = 0;
+
+#if defined(ENGINE_TRANSFORM_AVX2)
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2), four = _mm256_set1_epi32(4);
+	for (; i + 8 <= count; i += 8){
+		__m256 value = _mm256_loadu_ps(x + i);
+		__m256 ax = _mm256_andnot_ps(signMask, value);
+		__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(ax, _mm256_set1_ps(fourOverPi)));
+		j = _mm256_andnot_si256(one, _mm256_add_epi32(j, one));
+		__m256 y = _mm256_cvtepi32_ps(j);
+		__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(ax, _mm256_mul_ps(y, _mm256_set1_ps(dp1))),
+			_mm256_mul_ps(y, _mm256_set1_ps(dp2))), _mm256_mul_ps(y, _mm256_set1_ps(dp3)));
+
+		__m256 z = _mm256_mul_ps(r, r);
+		__m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cos0), z), _mm256_set1_ps(cos1)), z), _mm256_set1_ps(cos2));
+		cosPoly = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+		__m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(sin0), z), _mm256_set1_ps(sin1)), z), _mm256_set1_ps(sin2));
+		sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPoly, z), r), r);
+
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, two), two));
+		__m256 sinSign = _mm256_xor_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, four), 29)), _mm256_and_ps(value, signMask));
+		__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, two), four), 29));
+		_mm256_storeu_ps(s + i, _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, swap), sinSign));
+		_mm256_storeu_ps(c + i, _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, swap), cosSign));
+	}
+#elif defined(ENGINE_TRANSFORM_SSE)
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2), four = _mm_set1_epi32(4);
+	for (; i + 4 <= count; i += 4){
+		__m128 value = _mm_loadu_ps(x + i);
+		__m128 ax = _mm_andnot_ps(signMask, value);
+		__m128i j = _mm_cvttps_epi32(_mm_mul_ps(ax, _mm_set1_ps(fourOverPi)));
+		j = _mm_andnot_si128(one, _mm_add_epi32(j, one));
+		__m128 y = _mm_cvtepi32_ps(j);
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(ax, _mm_mul_ps(y, _mm_set1_ps(dp1))),
+			_mm_mul_ps(y, _mm_set1_ps(dp2))), _mm_mul_ps(y, _mm_set1_ps(dp3)));
+
+		__m128 z = _mm_mul_ps(r, r);
+		__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(cos0), z), _mm_set1_ps(cos1)), z), _mm_set1_ps(cos2));
+		cosPoly = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cosPoly, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+		__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(sin0), z), _mm_set1_ps(sin1)), z), _mm_set1_ps(sin2));
+		sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), r), r);
+
+		// SSE2 has no blendv, select with and/andnot
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, two), two));
+		__m128 sinSign = _mm_xor_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29)), _mm_and_ps(value, signMask));
+		__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, two), four), 29));
+		__m128 sinValue = _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly));
+		__m128 cosValue = _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly));
+		_mm_storeu_ps(s + i, _mm_xor_ps(sinValue, sinSign));
+		_mm_storeu_ps(c + i, _mm_xor_ps(cosValue, cosSign));
+	}
+#elif defined(ENGINE_TRANSFORM_NEON)
+	const uint32x4_t signMask = vdupq_n_u32(0x80000000u);
+	const int32x4_t one = vdupq_n_s32(1), two = vdupq_n_s32(2), four = vdupq_n_s32(4);
+	for (; i + 4 <= count; i += 4){
+		float32x4_t value = vld1q_f32(x + i);
+		float32x4_t ax = vabsq_f32(value);
+		int32x4_t j = vcvtq_s32_f32(vmulq_f32(ax, vdupq_n_f32(fourOverPi)));
+		j = vbicq_s32(vaddq_s32(j, one), one);
+		float32x4_t y = vcvtq_f32_s32(j);
+		// separate multiply and add, a fused vmlaq would round differently from the scalar tail
+		float32x4_t r = vaddq_f32(vaddq_f32(vaddq_f32(ax, vmulq_f32(y, vdupq_n_f32(dp1))),
+			vmulq_f32(y, vdupq_n_f32(dp2))), vmulq_f32(y, vdupq_n_f32(dp3)));
+
+		float32x4_t z = vmulq_f32(r, r);
+		float32x4_t cosPoly = vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(vdupq_n_f32(cos0), z), vdupq_n_f32(cos1)), z), vdupq_n_f32(cos2));
+		cosPoly = vaddq_f32(vsubq_f32(vmulq_f32(vmulq_f32(cosPoly, z), z), vmulq_f32(vdupq_n_f32(0.5f), z)), vdupq_n_f32(1.0f));
+		float32x4_t sinPoly = vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(vdupq_n_f32(sin0), z), vdupq_n_f32(sin1)), z), vdupq_n_f32(sin2));
+		sinPoly = vaddq_f32(vmulq_f32(vmulq_f32(sinPoly, z), r), r);
+
+		uint32x4_t swap = vceqq_s32(vandq_s32(j, two), two);
+		uint32x4_t sinSign = veorq_u32(vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(j, four)), 29), vandq_u32(vreinterpretq_u32_f32(value), signMask));
+		uint32x4_t cosSign = vshlq_n_u32(vreinterpretq_u32_s32(vbicq_s32(four, vsubq_s32(j, two))), 29);
+		float32x4_t sinValue = vbslq_f32(swap, cosPoly, sinPoly);
+		float32x4_t cosValue = vbslq_f32(swap, sinPoly, cosPoly);
+		vst1q_f32(s + i, vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(sinValue), sinSign)));
+		vst1q_f32(c + i, vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(cosValue), cosSign)));
+	}
+#endif
+
+	for (; i < count; i++) sinCosScalar(x[i], s[i], c[i]);
+}
+
+inline const char *transformKernelName(){
+#if defined(ENGINE_TRANSFORM_AVX2)
+	return "AVX2";
+#elif defined(ENGINE_TRANSFORM_SSE)
+	return "SSE";
+#elif defined(ENGINE_TRANSFORM_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+constexpr size_t TRANSFORM_BATCH_CHUNK_SIZE = 256;   // objects whose trig is evaluated before their matrices are built
+
+// World and normal matrices (translate * Ry * Rx * Rz * scale and its inverse transpose, as in
+// TransformComponent) for count objects. Element i reads and writes index(i) of the arrays, so a
+// dirty list can be passed without gathering the inputs first.
+template <typename Index>
+inline void computeTransformMatrices(
+	size_t count, Index index,
+	const glm::vec3 *translations, const glm::vec3 *rotations, const glm::vec3 *scales,
+	glm::mat4 *worldMatrices, glm::mat4 *normalMatrices)
+{
+	alignas(32) float angleX[TRANSFORM_BATCH_CHUNK_SIZE], angleY[TRANSFORM_BATCH_CHUNK_SIZE], angleZ[TRANSFORM_BATCH_CHUNK_SIZE];
+	alignas(32) float s1[TRANSFORM_BATCH_CHUNK_SIZE], c1[TRANSFORM_BATCH_CHUNK_SIZE];
+	alignas(32) float s2[TRANSFORM_BATCH_CHUNK_SIZE], c2[TRANSFORM_BATCH_CHUNK_SIZE];
+	alignas(32) float s3[TRANSFORM_BATCH_CHUNK_SIZE], c3[TRANSFORM_BATCH_CHUNK_SIZE];
+
+	for (size_t chunk = 0; chunk < count; chunk += TRANSFORM_BATCH_CHUNK_SIZE){
+		size_t chunkCount = std::min(TRANSFORM_BATCH_CHUNK_SIZE, count - chunk);
+		for (size_t i = 0; i < chunkCount; i++){
+			const glm::vec3 &rotation = rotations[index(chunk + i)];
+			angleX[i] = rotation.x;
+			angleY[i] = rotation.y;
+			angleZ[i] = rotation.z;
+		}
+		sinCosBatch(angleY, s1, c1, chunkCount);
+		sinCosBatch(angleX, s2, c2, chunkCount);
+		sinCosBatch(angleZ, s3, c3, chunkCount);
+
+		for (size_t i = 0; i < chunkCount; i++){
+			size_t object = index(chunk + i);
+			const glm::vec3 &translation = translations[object];
+			const glm::vec3 &scale = scales[object];
+			float r00 = c1[i] * c3[i] + s1[i] * s2[i] * s3[i], r01 = c2[i] * s3[i], r02 = c1[i] * s2[i] * s3[i] - c3[i] * s1[i];
+			float r10 = c3[i] * s1[i] * s2[i] - c1[i] * s3[i], r11 = c2[i] * c3[i], r12 = c1[i] * c3[i] * s2[i] + s1[i] * s3[i];
+			float r20 = c2[i] * s1[i], r21 = -s2[i], r22 = c1[i] * c2[i];
+			float sx = scale.x, sy = scale.y, sz = scale.z;
+			float ix = 1.0f / sx, iy = 1.0f / sy, iz = 1.0f / sz;
+
+			float *w = &worldMatrices[object][0][0];
+			w[0] = sx * r00;  w[1] = sx * r01;  w[2] = sx * r02;  w[3] = 0.0f;
+			w[4] = sy * r10;  w[5] = sy * r11;  w[6] = sy * r12;  w[7] = 0.0f;
+			w[8] = sz * r20;  w[9] = sz * r21;  w[10] = sz * r22; w[11] = 0.0f;
+			w[12] = translation.x; w[13] = translation.y; w[14] = translation.z; w[15] = 1.0f;
+
+			float *n = &normalMatrices[object][0][0];
+			n[0] = ix * r00;  n[1] = ix * r01;  n[2] = ix * r02;  n[3] = 0.0f;
+			n[4] = iy * r10;  n[5] = iy * r11;  n[6] = iy * r12;  n[7] = 0.0f;
+			n[8] = iz * r20;  n[9] = iz * r21;  n[10] = iz * r22; n[11] = 0.0f;
+			n[12] = 0.0f;     n[13] = 0.0f;     n[14] = 0.0f;     n[15] = 1.0f;
+		}
+	}
+}
+
+inline void computeTransformMatrices(
+	size_t count,
+	const glm::vec3 *translations, const glm::vec3 *rotations, const glm::vec3 *scales,
+	glm::mat4 *worldMatrices, glm::mat4 *normalMatrices)
+{
+	computeTransformMatrices(count, [](size_t i) {return i;}, translations, rotations, scales, worldMatrices, normalMatrices);
+}
+
+// Distance in representable floats, the sign bit folded so -0 and +0 are adjacent
+inline uint32_t ulpDistance(float a, float b){
+	int32_t ia, ib;
+	std::memcpy(&ia, &a, sizeof(float));
+	std::memcpy(&ib, &b, sizeof(float));
+	if (ia < 0) ia = INT32_MIN - ia;
+	if (ib < 0) ib = INT32_MIN - ib;
+	return static_cast<uint32_t>(ia > ib ? int64_t(ia) - ib : int64_t(ib) - ia);
+}
+
+// Matrices per second of the batch kernel against the libm based per object loop over 1M random
+// transforms, plus the sinCosBatch error against double precision over [-8192, 8192]
+inline bool benchmarkTransformKernel(uint32_t objectCount = 1000000, int iterations = 10){
+	std::mt19937 random{1234};
+	std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+	std::uniform_real_distribution<float> angle{-3.14159f, 3.14159f};
+	std::uniform_real_distribution<float> size{0.1f, 4.0f};
+	std::vector<glm::vec3> translations(objectCount), rotations(objectCount), scales(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++){
+		translations[i] = {position(random), position(random), position(random)};
+		rotations[i] = {angle(random), angle(random), angle(random)};
+		scales[i] = {size(random), size(random), size(random)};
+	}
+
+	// Worst case error over every sample: half within one turn (small angles dominate real scenes), a
+	// quarter over the whole range and a quarter on the float nearest to a multiple of pi/2
+	const uint32_t trigSamples = 1 << 20;
+	std::vector<float> x(trigSamples), s(trigSamples), c(trigSamples);
+	std::uniform_real_distribution<float> smallAngle{-6.2831853f, 6.2831853f}, largeAngle{-8192.0f, 8192.0f};
+	std::uniform_int_distribution<int> quarterTurn{-5215, 5215};
+	for (uint32_t i = 0; i < trigSamples; i++){
+		if (i % 2) x[i] = smallAngle(random);
+		else if (i % 4 == 0) x[i] = largeAngle(random);
+		else x[i] = static_cast<float>(quarterTurn(random) * 1.5707963267948966);
+	}
+	sinCosBatch(x.data(), s.data(), c.data(), trigSamples);
+	uint32_t maxUlp = 0;
+	double maxRootError = 0.0;
+	auto measureTrig = [&](float value, double expected) {
+		// near a root one ULP of the result is tiny, the absolute error bounds it there
+		if (std::fabs(expected) > 1e-3) maxUlp = std::max(maxUlp, ulpDistance(value, static_cast<float>(expected)));
+		else maxRootError = std::max(maxRootError, std::fabs(double(value) - expected));
+	};
+	for (uint32_t i = 0; i < trigSamples; i++){
+		measureTrig(s[i], std::sin(double(x[i])));
+		measureTrig(c[i], std::cos(double(x[i])));
+	}
+
+	std::vector<glm::mat4> worldMatrices(objectCount), normalMatrices(objectCount);
+	std::vector<glm::mat4> referenceWorld(objectCount), referenceNormal(objectCount);
+	auto measure = [&](auto &&kernel) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; i++) kernel();
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return double(objectCount) * iterations / seconds;
+	};
+	double batchRate = measure([&] {
+		computeTransformMatrices(objectCount, translations.data(), rotations.data(), scales.data(), worldMatrices.data(), normalMatrices.data());
+	});
+	double scalarRate = measure([&] {
+		for (uint32_t i = 0; i < objectCount; i++){
+			float sy = std::sin(rotations[i].y), cy = std::cos(rotations[i].y);
+			float sx = std::sin(rotations[i].x), cx = std::cos(rotations[i].x);
+			float sz = std::sin(rotations[i].z), cz = std::cos(rotations[i].z);
+			glm::vec3 rows[3] = {
+				{cy * cz + sy * sx * sz, cx * sz, cy * sx * sz - cz * sy},
+				{cz * sy * sx - cy * sz, cx * cz, cy * cz * sx + sy * sz},
+				{cx * sy, -sx, cy * cx}};
+			for (int column = 0; column < 3; column++){
+				glm::vec3 r = rows[column];
+				float scale = scales[i][column];
+				referenceWorld[i][column] = {scale * r.x, scale * r.y, scale * r.z, 0.0f};
+				referenceNormal[i][column] = {r.x / scale, r.y / scale, r.z / scale, 0.0f};
+			}
+			referenceWorld[i][3] = {translations[i].x, translations[i].y, translations[i].z, 1.0f};
+			referenceNormal[i][3] = {0.0f, 0.0f, 0.0f, 1.0f};
+		}
+	});
+
+	// relative to each object's largest scale factor, the bound quoted at the top of this file
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < objectCount; i++){
+		float largest = std::max({scales[i].x, scales[i].y, scales[i].z, 1.0f / scales[i].x, 1.0f / scales[i].y, 1.0f / scales[i].z});
+		for (int column = 0; column < 4; column++){
+			for (int row = 0; row < 4; row++){
+				maxError = std::max(maxError, std::fabs(worldMatrices[i][column][row] - referenceWorld[i][column][row]) / largest);
+				maxError = std::max(maxError, std::fabs(normalMatrices[i][column][row] - referenceNormal[i][column][row]) / largest);
+			}
+		}
+	}
+
+	bool ok = maxUlp <= 2 && maxRootError <= 2e-10 && maxError <= 4e-7f;
+	std::cout << "Transform matrices " << objectCount << ": " << transformKernelName() << " batch " << batchRate / 1e6
+		<< " M matrices/s, libm per object " << scalarRate / 1e6 << " M matrices/s (" << batchRate / scalarRate << "x), sincos max "
+		<< maxUlp << " ULP (" << maxRootError << " absolute near roots), matrix max error " << maxError << " * scale"
+		<< (ok ? "" : " OUT OF BOUNDS") << std::endl;
+	return ok;
+}
+} // namespace
+
+#endif
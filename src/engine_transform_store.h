@@ -0,0 +1,682 @@
+#ifndef ENGINE_TRANSFORM_STORE_H
+#define ENGINE_TRANSFORM_STORE_H
+
+/*
+ * Structure of arrays transform storage
+ *
+ * Translation, rotation, scale and the cached world and normal matrices of every transform live
+ * in separate dense arrays, so the per-frame matrix pass streams exactly the data it needs.
+ * Objects refer to their transform through an EngineTransformHandle, a slot index plus a
+ * generation. Slots map to dense indices; destroy() moves the last element into the hole and bumps
+ * the slot generation, so handles stay valid across removals of other objects and a stale handle
+ * is detected instead of aliasing a new transform.
+ *
+ * Transforms can be parented with setParent(); the world matrix is then the parent's world matrix
+ * times the local one. Every setter marks its transform dirty and updateWorldMatrices() recomputes
+ * only the dirty local matrices and the world matrices of their subtrees, so static objects cost
+ * nothing per frame. Matrices are only as fresh as the last updateWorldMatrices() call, new
+ * transforms have identity matrices until then.
+ */
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "engine_job_system.h"
+#include "engine_transform_batch.h"
+#include "engine_profiler.h"
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+
+namespace Engine{
+
+struct TransformComponent {
+	glm::vec3 translation{};
+	glm::vec3 scale{1.0f, 1.0f, 1.0f};
+	glm::vec3 rotation{};
+
+	// matrix corresponds to translate * Ry * Rx * Rz * scale transformation
+	// Rotation convention uses tait-bryan angles with axes order Y(1), X(2), Z(3)
+	glm::mat4 mat4() const {
+    	const float c3 = glm::cos(rotation.z);
+    	const float s3 = glm::sin(rotation.z);
+    	const float c2 = glm::cos(rotation.x);
+    	const float s2 = glm::sin(rotation.x);
+    	const float c1 = glm::cos(rotation.y);
+    	const float s1 = glm::sin(rotation.y);
+    	return glm::mat4{
+	        {
+	            scale.x * (c1 * c3 + s1 * s2 * s3),
+	            scale.x * (c2 * s3),
+	            scale.x * (c1 * s2 * s3 - c3 * s1),
+	            0.0f,
+	        },
+	        {
+	            scale.y * (c3 * s1 * s2 - c1 * s3),
+	            scale.y * (c2 * c3),
+	            scale.y * (c1 * c3 * s2 + s1 * s3),
+	            0.0f,
+	        },
+	        {
+	            scale.z * (c2 * s1),
+	            scale.z * (-s2),
+	            scale.z * (c1 * c2),
+	            0.0f,
+	        },
+	        {translation.x, translation.y, translation.z, 1.0f}};
+  	}
+
+  	glm::mat3 normalMatrix() const {
+    	const float c3 = glm::cos(rotation.z);
+    	const float s3 = glm::sin(rotation.z);
+    	const float c2 = glm::cos(rotation.x);
+    	const float s2 = glm::sin(rotation.x);
+    	const float c1 = glm::cos(rotation.y);
+    	const float s1 = glm::sin(rotation.y);
+    	const glm::vec3 inverseScale = 1.0f / scale;
+		return glm::mat3{
+	        {
+	            inverseScale.x * (c1 * c3 + s1 * s2 * s3),
+	            inverseScale.x * (c2 * s3),
+	            inverseScale.x * (c1 * s2 * s3 - c3 * s1),
+	        },
+	        {
+	            inverseScale.y * (c3 * s1 * s2 - c1 * s3),
+	            inverseScale.y * (c2 * c3),
+	            inverseScale.y * (c1 * c3 * s2 + s1 * s3),
+	        },
+	        {
+	            inverseScale.z * (c2 * s1),
+	            inverseScale.z * (-s2),
+	            inverseScale.z * (c1 * c2),
+	        }
+	    };
+  	}
+};
+
+struct EngineTransformHandle{
+	static constexpr uint32_t INVALID_INDEX = ~0u;
+
+	uint32_t index = INVALID_INDEX;   // slot, not the dense index
+	uint32_t generation = 0;
+
+	bool operator==(const EngineTransformHandle &other) const {return index == other.index && generation == other.generation;}
+	bool operator!=(const EngineTransformHandle &other) const {return !(*this == other);}
+};
+
+class EngineTransformStore{
+public:
+	static constexpr size_t UPDATE_GRAIN_SIZE = 4096;   // transforms per job in updateWorldMatrices
+
+	EngineTransformStore() = default;
+	EngineTransformStore(const EngineTransformStore &) = delete;
+	EngineTransformStore &operator=(const EngineTransformStore &) = delete;
+
+	uint32_t size() const {return static_cast<uint32_t>(translations.size());}
+
+	void reserve(size_t count){
+		translations.reserve(count);
+		rotations.reserve(count);
+		scales.reserve(count);
+		localMatrices.reserve(count);
+		localNormalMatrices.reserve(count);
+		worldMatrices.reserve(count);
+		normalMatrices.reserve(count);
+		denseToSlot.reserve(count);
+		dirtyFlags.reserve(count);
+		updateMarks.reserve(count);
+		slots.reserve(count);
+	}
+
+	EngineTransformHandle create(const TransformComponent &transform = TransformComponent{}){
+		uint32_t slot;
+		if (!freeSlots.empty()){
+			// Only the generation survives reuse, a stale depth would misorder the propagation seeds
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			uint32_t generation = slots[slot].generation;
+			slots[slot] = Slot{};
+			slots[slot].generation = generation;
+		}
+		else{
+			slot = static_cast<uint32_t>(slots.size());
+			slots.push_back(Slot{});
+		}
+		slots[slot].dense = size();
+
+		translations.push_back(transform.translation);
+		rotations.push_back(transform.rotation);
+		scales.push_back(transform.scale);
+		localMatrices.push_back(glm::mat4{1.0f});
+		localNormalMatrices.push_back(glm::mat4{1.0f});
+		worldMatrices.push_back(glm::mat4{1.0f});
+		normalMatrices.push_back(glm::mat4{1.0f});
+		denseToSlot.push_back(slot);
+		dirtyFlags.push_back(0);
+		updateMarks.push_back(0);
+		markDirty(slots[slot].dense);
+		return {slot, slots[slot].generation};
+	}
+
+	// Swap-remove: the last transform takes the freed dense index, its handle is unaffected.
+	// Children of the destroyed transform become roots and keep their local transforms.
+	void destroy(EngineTransformHandle handle){
+		assert(isValid(handle) && "Destroying a stale transform handle!");
+		while (slots[handle.index].firstChild != INVALID_SLOT) setParentSlot(slots[handle.index].firstChild, INVALID_SLOT);
+		unlink(handle.index);
+
+		uint32_t dense = slots[handle.index].dense;
+		uint32_t last = size() - 1;
+		if (dense != last){
+			translations[dense] = translations[last];
+			rotations[dense] = rotations[last];
+			scales[dense] = scales[last];
+			localMatrices[dense] = localMatrices[last];
+			localNormalMatrices[dense] = localNormalMatrices[last];
+			worldMatrices[dense] = worldMatrices[last];
+			normalMatrices[dense] = normalMatrices[last];
+			denseToSlot[dense] = denseToSlot[last];
+			dirtyFlags[dense] = dirtyFlags[last];
+			updateMarks[dense] = updateMarks[last];
+			slots[denseToSlot[dense]].dense = dense;
+		}
+		translations.pop_back();
+		rotations.pop_back();
+		scales.pop_back();
+		localMatrices.pop_back();
+		localNormalMatrices.pop_back();
+		worldMatrices.pop_back();
+		normalMatrices.pop_back();
+		denseToSlot.pop_back();
+		dirtyFlags.pop_back();
+		updateMarks.pop_back();
+
+		Slot &freed = slots[handle.index];
+		freed.dense = INVALID_DENSE;
+		freed.firstChild = INVALID_SLOT;
+		freed.depth = 0;
+		freed.generation++;
+		freeSlots.push_back(handle.index);
+	}
+
+	bool isValid(EngineTransformHandle handle) const {
+		return handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].dense < size();
+	}
+
+	// Dense index of a live handle, for iterating the arrays directly
+	uint32_t getIndex(EngineTransformHandle handle) const {
+		assert(isValid(handle) && "Stale transform handle!");
+		return slots[handle.index].dense;
+	}
+
+	TransformComponent get(EngineTransformHandle handle) const {
+		uint32_t i = getIndex(handle);
+		return {translations[i], scales[i], rotations[i]};
+	}
+
+	void set(EngineTransformHandle handle, const TransformComponent &transform){
+		uint32_t i = getIndex(handle);
+		translations[i] = transform.translation;
+		rotations[i] = transform.rotation;
+		scales[i] = transform.scale;
+		markDirty(i);
+	}
+
+	glm::vec3 getTranslation(EngineTransformHandle handle) const {return translations[getIndex(handle)];}
+	glm::vec3 getRotation(EngineTransformHandle handle) const {return rotations[getIndex(handle)];}
+	glm::vec3 getScale(EngineTransformHandle handle) const {return scales[getIndex(handle)];}
+	void setTranslation(EngineTransformHandle handle, glm::vec3 translation) {uint32_t i = getIndex(handle); translations[i] = translation; markDirty(i);}
+	void setRotation(EngineTransformHandle handle, glm::vec3 rotation) {uint32_t i = getIndex(handle); rotations[i] = rotation; markDirty(i);}
+	void setScale(EngineTransformHandle handle, glm::vec3 scale) {uint32_t i = getIndex(handle); scales[i] = scale; markDirty(i);}
+
+	// Attaches child below parent, or makes it a root for a default constructed parent handle. The local
+	// transform is kept, so the child moves with its new parent. O(1) unless parent is deeper than child,
+	// then child's subtree is searched for parent; depths are updated over the subtree either way.
+	void setParent(EngineTransformHandle child, EngineTransformHandle parent){
+		assert(isValid(child) && "Stale transform handle!");
+		uint32_t parentSlot = INVALID_SLOT;
+		if (parent != EngineTransformHandle{}){
+			assert(isValid(parent) && "Stale parent transform handle!");
+			parentSlot = parent.index;
+			if (parentSlot == child.index) throw std::runtime_error("a transform can not be its own parent");
+			// descendants are always deeper than their ancestors
+			if (slots[parentSlot].depth > slots[child.index].depth && isInSubtree(child.index, parentSlot)){
+				throw std::runtime_error("setParent would make a transform its own ancestor");
+			}
+		}
+		if (slots[child.index].parent != parentSlot) setParentSlot(child.index, parentSlot);
+	}
+
+	EngineTransformHandle getParent(EngineTransformHandle handle) const {
+		uint32_t parentSlot = slots[handle.index].parent;
+		if (parentSlot == INVALID_SLOT) return {};
+		return {parentSlot, slots[parentSlot].generation};
+	}
+
+	uint32_t getDepth(EngineTransformHandle handle) const {assert(isValid(handle)); return slots[handle.index].depth;}
+
+	void markAllDirty() {for (uint32_t i = 0; i < size(); i++) markDirty(i);}
+	bool isDirty(EngineTransformHandle handle) const {return dirtyFlags[getIndex(handle)] != 0;}
+	uint32_t getDirtyCount() const {return static_cast<uint32_t>(dirtySlots.size());}   // upper bound, may hold destroyed slots
+	uint32_t getRecomputedCount() const {return recomputedCount;}                          // by the last updateWorldMatrices()
+
+	// Parent relative matrix, the world matrix for roots
+	const glm::mat4 &getLocalMatrix(EngineTransformHandle handle) const {
+		return slots[handle.index].parent == INVALID_SLOT ? worldMatrices[getIndex(handle)] : localMatrices[getIndex(handle)];
+	}
+	const glm::mat4 &getWorldMatrix(EngineTransformHandle handle) const {return worldMatrices[getIndex(handle)];}
+	const glm::mat4 &getNormalMatrix(EngineTransformHandle handle) const {return normalMatrices[getIndex(handle)];}
+
+	// Dense arrays, size() elements each
+	const glm::vec3 *getTranslations() const {return translations.data();}
+	const glm::vec3 *getRotations() const {return rotations.data();}
+	const glm::vec3 *getScales() const {return scales.data();}
+	const glm::mat4 *getWorldMatrices() const {return worldMatrices.data();}
+	const glm::mat4 *getNormalMatrices() const {return normalMatrices.data();}
+
+	// Recomputes the matrices of dirty transforms, then the world matrices of their descendants in one
+	// pass over a parent before child list. Disjoint subtrees are updated in parallel.
+	void updateWorldMatrices(EngineJobSystem *jobSystem = nullptr){
+		ENGINE_PROFILE_ZONE("updateWorldMatrices");
+		auto forRanges = [&](size_t count, size_t grainSize, const std::function<void(size_t, size_t)> &function) {
+			if (jobSystem) jobSystem->parallelFor(count, grainSize, function);
+			else function(0, count);
+		};
+
+		dirtyIndices.clear();
+		for (uint32_t slot : dirtySlots){
+			uint32_t dense = slots[slot].dense;
+			if (dense == INVALID_DENSE || !dirtyFlags[dense]) continue;   // destroyed, or listed twice after slot reuse
+			dirtyFlags[dense] = 0;
+			dirtyIndices.push_back(dense);
+		}
+		dirtySlots.clear();
+
+		// A root's local matrix is its world matrix, so roots are written in place and only children keep
+		// separate local matrices. TransformComponent::mat4() and normalMatrix() within the bound in
+		// engine_transform_batch.h.
+		auto firstChild = std::partition(dirtyIndices.begin(), dirtyIndices.end(), [this](uint32_t dense) {
+			return slots[denseToSlot[dense]].parent == INVALID_SLOT;
+		});
+		size_t rootCount = firstChild - dirtyIndices.begin();
+		forRanges(dirtyIndices.size(), UPDATE_GRAIN_SIZE, [this, rootCount](size_t begin, size_t end) {
+			const uint32_t *indices = dirtyIndices.data();
+			auto index = [indices](size_t i) {return indices[i];};
+			size_t split = std::clamp(rootCount, begin, end);
+			computeTransformMatrices(split - begin, [&](size_t i) {return index(begin + i);},
+				translations.data(), rotations.data(), scales.data(), worldMatrices.data(), normalMatrices.data());
+			computeTransformMatrices(end - split, [&](size_t i) {return index(split + i);},
+				translations.data(), rotations.data(), scales.data(), localMatrices.data(), localNormalMatrices.data());
+		});
+
+		// Descendants of dirty roots and dirty children are collected in preorder. Seeds are counting sorted
+		// by depth so every subtree is collected once, from its topmost dirty transform, and whole subtrees
+		// are grouped into batches of at least UPDATE_GRAIN_SIZE transforms.
+		propagationSeeds.clear();
+		uint32_t maxDepth = 0;
+		for (size_t i = 0; i < dirtyIndices.size(); i++){
+			const Slot &node = slots[denseToSlot[dirtyIndices[i]]];
+			if (i < rootCount && node.firstChild == INVALID_SLOT) continue;
+			propagationSeeds.push_back(dirtyIndices[i]);
+			maxDepth = std::max(maxDepth, node.depth);
+		}
+		if (!propagationSeeds.empty()){
+			depthOffsets.assign(maxDepth + 2, 0);
+			for (uint32_t dense : propagationSeeds) depthOffsets[slots[denseToSlot[dense]].depth + 1]++;
+			for (uint32_t depth = 1; depth < depthOffsets.size(); depth++) depthOffsets[depth] += depthOffsets[depth - 1];
+			sortedSeeds.resize(propagationSeeds.size());
+			for (uint32_t dense : propagationSeeds) sortedSeeds[depthOffsets[slots[denseToSlot[dense]].depth]++] = dense;
+		}
+		else sortedSeeds.clear();
+
+		updateList.clear();
+		updateBatches.clear();
+		size_t batchStart = 0;
+		for (uint32_t dense : sortedSeeds){
+			uint32_t slot = denseToSlot[dense];
+			if (slots[slot].parent == INVALID_SLOT){
+				for (uint32_t child = slots[slot].firstChild; child != INVALID_SLOT; child = slots[child].nextSibling) collectSubtree(child);
+			}
+			else if (!updateMarks[dense]) collectSubtree(slot);
+			if (updateList.size() - batchStart >= UPDATE_GRAIN_SIZE){
+				updateBatches.push_back({batchStart, updateList.size()});
+				batchStart = updateList.size();
+			}
+		}
+		if (batchStart < updateList.size()) updateBatches.push_back({batchStart, updateList.size()});
+
+		// every transform in the list has a parent, earlier in the list or already up to date
+		forRanges(updateBatches.size(), 1, [this](size_t begin, size_t end) {
+			for (size_t batch = begin; batch < end; batch++){
+				for (size_t i = updateBatches[batch].first; i < updateBatches[batch].second; i++){
+					uint32_t dense = updateList[i];
+					updateMarks[dense] = 0;
+					uint32_t parentDense = slots[slots[denseToSlot[dense]].parent].dense;
+					// (P L)^-T = P^-T L^-T, normal matrices compose like the world matrices
+					worldMatrices[dense] = worldMatrices[parentDense] * localMatrices[dense];
+					normalMatrices[dense] = normalMatrices[parentDense] * localNormalMatrices[dense];
+				}
+			}
+		});
+
+		recomputedCount = static_cast<uint32_t>(rootCount + updateList.size());
+		ENGINE_PROFILE_COUNTER("matrices recomputed", recomputedCount);
+	}
+
+private:
+	static constexpr uint32_t INVALID_DENSE = ~0u;
+	static constexpr uint32_t INVALID_SLOT = ~0u;
+
+	// Hierarchy links are slots, so swap-remove never has to patch them
+	struct Slot{
+		uint32_t dense = 0;              // index into the arrays while alive
+		uint32_t generation = 0;         // bumped on destroy
+		uint32_t parent = INVALID_SLOT;
+		uint32_t firstChild = INVALID_SLOT;
+		uint32_t nextSibling = INVALID_SLOT;
+		uint32_t previousSibling = INVALID_SLOT;
+		uint32_t depth = 0;              // 0 for roots
+	};
+
+	void markDirty(uint32_t dense){
+		if (dirtyFlags[dense]) return;
+		dirtyFlags[dense] = 1;
+		dirtySlots.push_back(denseToSlot[dense]);   // slots, dense indices move on swap-remove
+	}
+
+	void unlink(uint32_t slot){
+		Slot &node = slots[slot];
+		if (node.parent == INVALID_SLOT) return;
+		if (node.previousSibling != INVALID_SLOT) slots[node.previousSibling].nextSibling = node.nextSibling;
+		else slots[node.parent].firstChild = node.nextSibling;
+		if (node.nextSibling != INVALID_SLOT) slots[node.nextSibling].previousSibling = node.previousSibling;
+		node.parent = node.nextSibling = node.previousSibling = INVALID_SLOT;
+	}
+
+	// Relinks slot below parentSlot, fixes the subtree's depths and dirties slot, which dirties the subtree
+	void setParentSlot(uint32_t slot, uint32_t parentSlot){
+		unlink(slot);
+		Slot &node = slots[slot];
+		node.parent = parentSlot;
+		if (parentSlot != INVALID_SLOT){
+			node.nextSibling = slots[parentSlot].firstChild;
+			if (node.nextSibling != INVALID_SLOT) slots[node.nextSibling].previousSibling = slot;
+			slots[parentSlot].firstChild = slot;
+		}
+
+		uint32_t depthChange = (parentSlot == INVALID_SLOT ? 0 : slots[parentSlot].depth + 1) - node.depth;
+		if (depthChange != 0){
+			traversalStack.assign(1, slot);
+			while (!traversalStack.empty()){
+				uint32_t current = traversalStack.back();
+				traversalStack.pop_back();
+				slots[current].depth += depthChange;   // unsigned wrap-around adds negative changes too
+				for (uint32_t child = slots[current].firstChild; child != INVALID_SLOT; child = slots[child].nextSibling) traversalStack.push_back(child);
+			}
+		}
+		markDirty(node.dense);
+	}
+
+	bool isInSubtree(uint32_t rootSlot, uint32_t slot){
+		traversalStack.assign(1, rootSlot);
+		while (!traversalStack.empty()){
+			uint32_t current = traversalStack.back();
+			traversalStack.pop_back();
+			if (current == slot) return true;
+			for (uint32_t child = slots[current].firstChild; child != INVALID_SLOT; child = slots[child].nextSibling) traversalStack.push_back(child);
+		}
+		return false;
+	}
+
+	// Appends the subtree of slot to updateList in preorder and marks it
+	void collectSubtree(uint32_t slot){
+		traversalStack.assign(1, slot);
+		while (!traversalStack.empty()){
+			uint32_t current = traversalStack.back();
+			traversalStack.pop_back();
+			uint32_t dense = slots[current].dense;
+			updateMarks[dense] = 1;
+			updateList.push_back(dense);
+			for (uint32_t child = slots[current].firstChild; child != INVALID_SLOT; child = slots[child].nextSibling) traversalStack.push_back(child);
+		}
+	}
+
+	std::vector<glm::vec3> translations;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> localNormalMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<glm::mat4> normalMatrices;
+	std::vector<uint32_t> denseToSlot;
+	std::vector<uint8_t> dirtyFlags;
+	std::vector<uint8_t> updateMarks;     // in this update's updateList
+
+	std::vector<uint32_t> dirtySlots;     // marked since the last update, may repeat or be destroyed
+	std::vector<uint32_t> dirtyIndices;   // resolved dense indices, scratch for updateWorldMatrices
+	std::vector<uint32_t> propagationSeeds;   // dirty roots with children and dirty children
+	std::vector<uint32_t> sortedSeeds;
+	std::vector<uint32_t> depthOffsets;
+	std::vector<uint32_t> updateList;     // descendants to propagate to, parents before children
+	std::vector<std::pair<size_t, size_t>> updateBatches;   // ranges of updateList made of whole subtrees
+	std::vector<uint32_t> traversalStack;
+	uint32_t recomputedCount = 0;
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+};
+
+// Single threaded world and normal matrix pass over 10k, 100k and 1M random transforms, the store's
+// SoA loop against TransformComponent::mat4() and normalMatrix() on an array of game object sized
+// structs, then the dirty tracked update with no and 1% moving objects. Also checks swap-remove
+// handle stability, the dirty bookkeeping and that both passes agree.
+inline bool benchmarkTransforms(){
+	// Mirrors the old EngineGameObject layout, mesh pointer and colour next to the transform
+	struct AosObject{
+		std::shared_ptr<void> mesh;
+		glm::vec3 colour;
+		TransformComponent transform;
+		uint32_t id;
+	};
+
+	bool ok = true;
+	std::mt19937 random{1234};
+	std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+	std::uniform_real_distribution<float> angle{-3.14159f, 3.14159f};
+	std::uniform_real_distribution<float> size{0.1f, 4.0f};
+
+	for (uint32_t objectCount : {10000u, 100000u, 1000000u}){
+		std::vector<AosObject> objects(objectCount);
+		EngineTransformStore store;
+		store.reserve(objectCount);
+		std::vector<EngineTransformHandle> handles;
+		for (auto &object : objects){
+			object.transform.translation = {position(random), position(random), position(random)};
+			object.transform.rotation = {angle(random), angle(random), angle(random)};
+			object.transform.scale = {size(random), size(random), size(random)};
+			handles.push_back(store.create(object.transform));
+		}
+
+		std::vector<glm::mat4> meshMatrices(objectCount), normalMatrices(objectCount);
+		int iterations = std::max(3, int(20000000 / objectCount));
+		auto measure = [&](auto &&pass) {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < iterations; i++) pass();
+			return std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / (double(objectCount) * iterations);
+		};
+		double aosTime = measure([&] {
+			for (uint32_t i = 0; i < objectCount; i++){
+				meshMatrices[i] = objects[i].transform.mat4();
+				normalMatrices[i] = glm::mat4{objects[i].transform.normalMatrix()};
+			}
+		});
+		double soaTime = measure([&] {store.markAllDirty(); store.updateWorldMatrices();});
+
+		// dirty tracked updates, nothing moved and 1% moved since the last frame
+		store.updateWorldMatrices();
+		double staticTime = measure([&] {store.updateWorldMatrices();});
+		double movingTime = measure([&] {
+			for (uint32_t i = 0; i < objectCount; i += 100) store.setTranslation(handles[i], objects[i].transform.translation);
+			store.updateWorldMatrices();
+		});
+		if (store.getRecomputedCount() != (objectCount + 99) / 100) ok = false;
+
+		float maxError = 0.0f;
+		for (uint32_t i = 0; i < objectCount; i++){
+			const glm::mat4 &world = store.getWorldMatrix(handles[i]);
+			const glm::mat4 &normal = store.getNormalMatrix(handles[i]);
+			for (int column = 0; column < 4; column++){
+				for (int row = 0; row < 4; row++){
+					maxError = std::max(maxError, std::abs(world[column][row] - meshMatrices[i][column][row]));
+					maxError = std::max(maxError, std::abs(normal[column][row] - normalMatrices[i][column][row]));
+				}
+			}
+		}
+		bool match = maxError <= 1e-4f;
+		ok = ok && match;
+		std::cout << "Transforms " << objectCount << ": TransformComponent " << aosTime << " ns/object, SoA store "
+			<< soaTime << " ns/object (" << aosTime / soaTime << "x), dirty tracked static " << staticTime
+			<< " ns/object, 1% moving " << movingTime << " ns/object, max difference " << maxError
+			<< (match ? "" : " DOES NOT MATCH") << std::endl;
+	}
+
+	// Handles stay valid across swap-remove, stale ones are rejected
+	EngineTransformStore store;
+	std::vector<EngineTransformHandle> handles;
+	for (int i = 0; i < 100; i++) handles.push_back(store.create({glm::vec3{float(i)}, glm::vec3{1.0f}, glm::vec3{0.0f}}));
+	for (int i = 0; i < 100; i += 3) store.destroy(handles[i]);
+	for (int i = 0; i < 100; i++){
+		bool alive = i % 3 != 0;
+		if (store.isValid(handles[i]) != alive || (alive && store.getTranslation(handles[i]).x != float(i))) ok = false;
+	}
+	EngineTransformHandle reused = store.create();
+	if (store.isValid(handles[99]) || !store.isValid(reused) || store.size() != 67) ok = false;
+
+	// every live transform is recomputed once, destroyed and duplicate dirty entries are skipped
+	store.updateWorldMatrices();
+	if (store.getRecomputedCount() != 67 || store.getWorldMatrix(handles[98])[3][0] != 98.0f || store.isDirty(handles[98])) ok = false;
+	store.setRotation(handles[1], glm::vec3{0.5f});
+	store.setScale(handles[1], glm::vec3{2.0f});
+	store.updateWorldMatrices();
+	if (store.getRecomputedCount() != 1) ok = false;
+	std::cout << "Transform handles: " << (ok ? "stable across swap-remove" : "FAILED") << std::endl;
+	return ok;
+}
+
+// World matrix propagation over 100k node hierarchies, deep (10 chains of 10k) and wide (100 roots
+// with 999 children each): a full update, moving one root and reparenting a subtree, single threaded
+// and on the job system. Sampled world matrices are checked against the product of local matrices
+// along their ancestor path.
+inline bool benchmarkHierarchy(EngineJobSystem &jobSystem){
+	bool ok = true;
+	std::mt19937 random{1234};
+	std::uniform_real_distribution<float> offset{-0.1f, 0.1f};
+	std::uniform_real_distribution<float> angle{-0.01f, 0.01f};
+
+	struct Shape {const char *name; uint32_t rootCount; uint32_t nodesPerRoot; bool chain;};
+	for (Shape shape : {Shape{"deep", 10, 10000, true}, Shape{"wide", 100, 1000, false}}){
+		for (EngineJobSystem *jobs : {static_cast<EngineJobSystem *>(nullptr), &jobSystem}){
+			EngineTransformStore store;
+			store.reserve(shape.rootCount * shape.nodesPerRoot);
+			std::vector<EngineTransformHandle> roots, nodes;
+			for (uint32_t r = 0; r < shape.rootCount; r++){
+				EngineTransformHandle root = store.create({glm::vec3{float(r), 0.0f, 0.0f}, glm::vec3{1.0f}, glm::vec3{0.0f}});
+				roots.push_back(root);
+				nodes.push_back(root);
+				EngineTransformHandle parent = root;
+				for (uint32_t i = 1; i < shape.nodesPerRoot; i++){
+					TransformComponent local{};
+					local.translation = {offset(random), offset(random), offset(random)};
+					local.rotation = {angle(random), angle(random), angle(random)};
+					EngineTransformHandle node = store.create(local);
+					store.setParent(node, parent);
+					nodes.push_back(node);
+					if (shape.chain) parent = node;
+				}
+			}
+
+			auto measure = [&](auto &&operation) {
+				auto start = std::chrono::high_resolution_clock::now();
+				operation();
+				return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			};
+			double fullTime = measure([&] {store.updateWorldMatrices(jobs);});
+			double rootTime = measure([&] {
+				for (EngineTransformHandle root : roots) store.setRotation(root, glm::vec3{0.0f, 0.3f, 0.0f});
+				store.updateWorldMatrices(jobs);
+			});
+			uint32_t rootRecomputed = store.getRecomputedCount();
+
+			// second half of the first root's nodes moves under the last root
+			EngineTransformHandle moved = nodes[shape.nodesPerRoot / 2];
+			double reparentTime = measure([&] {store.setParent(moved, roots.back());});
+			double reparentUpdateTime = measure([&] {store.updateWorldMatrices(jobs);});
+			if (store.getParent(moved) != roots.back() || store.getDepth(moved) != 1) ok = false;
+
+			float maxError = 0.0f;
+			for (size_t sample = 0; sample < nodes.size(); sample += nodes.size() / 64 + 1){
+				std::vector<EngineTransformHandle> path;
+				for (EngineTransformHandle node = nodes[sample]; node != EngineTransformHandle{}; node = store.getParent(node)) path.push_back(node);
+				glm::mat4 expected{1.0f};
+				for (auto it = path.rbegin(); it != path.rend(); ++it) expected = expected * store.getLocalMatrix(*it);
+				const glm::mat4 &world = store.getWorldMatrix(nodes[sample]);
+				for (int column = 0; column < 4; column++){
+					for (int row = 0; row < 4; row++){
+						float error = std::abs(world[column][row] - expected[column][row]) / std::max(1.0f, std::abs(expected[column][row]));
+						maxError = std::max(maxError, error);
+					}
+				}
+			}
+			bool match = maxError <= 1e-5f;
+			ok = ok && match;
+			std::cout << "Hierarchy " << shape.name << " " << store.size() << " nodes, " << (jobs ? "job system" : "single thread") << ": full update "
+				<< fullTime << " ms, roots moved " << rootTime << " ms (" << rootRecomputed << " recomputed), reparent "
+				<< reparentTime * 1000.0 << " us + update " << reparentUpdateTime << " ms (" << store.getRecomputedCount() << " recomputed)"
+				<< (match ? "" : ", WORLD MATRICES DO NOT MATCH") << std::endl;
+		}
+	}
+
+	// cycles are rejected
+	EngineTransformStore store;
+	EngineTransformHandle a = store.create(), b = store.create();
+	store.setParent(b, a);
+	bool rejected = false;
+	try {store.setParent(a, b);} catch (const std::runtime_error &) {rejected = true;}
+	if (!rejected || store.getParent(a) != EngineTransformHandle{}) ok = false;
+	store.destroy(a);
+	if (store.getParent(b) != EngineTransformHandle{} || store.getDepth(b) != 0) ok = false;
+
+	// A reused slot starts as a fresh root: destroy a deep node, its slot comes back for a new root whose
+	// child must land at depth 1 and pick up the new root's transform
+	EngineTransformHandle deep = b;
+	for (int i = 0; i < 4; i++){
+		EngineTransformHandle child = store.create();
+		store.setParent(child, deep);
+		deep = child;
+	}
+	uint32_t deepIndex = deep.index;
+	store.destroy(deep);
+	EngineTransformHandle reused = store.create({glm::vec3{5.0f, 0.0f, 0.0f}, glm::vec3{1.0f}, glm::vec3{0.0f}});
+	EngineTransformHandle reusedChild = store.create({glm::vec3{0.0f, 1.0f, 0.0f}, glm::vec3{1.0f}, glm::vec3{0.0f}});
+	store.setParent(reusedChild, reused);
+	store.updateWorldMatrices(nullptr);
+	glm::vec4 reusedPosition = store.getWorldMatrix(reusedChild)[3];
+	if (reused.index != deepIndex || store.getDepth(reused) != 0 || store.getDepth(reusedChild) != 1 ||
+		store.getParent(reused) != EngineTransformHandle{} || reusedPosition.x != 5.0f || reusedPosition.y != 1.0f) ok = false;
+	std::cout << "Hierarchy slot reuse " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok;
+}
+} // namespace
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef ENGINE_UPLOAD_MANAGER_H
+#define ENGINE_UPLOAD_MANAGER_H
+
+/*
+ * Asynchronous host to device buffer uploads
+ *
+ * Copies are recorded into an open batch on the transfer queue (a dedicated transfer family when
+ * the device has one, the graphics queue otherwise). A batch is submitted with a fence once it
+ * uses half of the staging ring or on the next submit()/update(), so loading many meshes costs a
+ * handful of submits instead of one blocking round trip per buffer. Every upload returns a ticket,
+ * check it with isComplete() before reading the destination buffer on the GPU.
+ *
+ * Source data is staged through an EngineStagingRing, uploads larger than a quarter of the ring are
+ * split into chunks so the ring can keep more than one batch in flight.
+ *
+ * Submits go to a queue the renderer may also use, call it from the render thread.
+ */
+
+#include "engine_device.h"
+#include "engine_buffer.h"
+#include "engine_staging_ring.h"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace Engine{
+
+struct EngineUploadTicket{
+	uint64_t batch = 0; // 0 never waits
+};
+
+class EngineUploadManager{
+public:
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	EngineUploadManager(EngineDevice &device, VkDeviceSize stagingRingSize = EngineStagingRing::DEFAULT_SIZE)
+	: engineDevice{device}, stagingRing{device, stagingRingSize} {
+		QueueFamilyIndices queueFamilyIndices = engineDevice.findPhysicalQueueFamilies();
+
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(engineDevice.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+	}
+
+	~EngineUploadManager(){
+		waitIdle();
+		for (auto &batch : freeBatches) destroyBatch(*batch);
+		if (openBatch) destroyBatch(*openBatch);
+		vkDestroyCommandPool(engineDevice.device(), commandPool, nullptr);
+	}
+
+	EngineUploadManager(const EngineUploadManager &) = delete;
+	EngineUploadManager &operator=(const EngineUploadManager &) = delete;
+
+	// Queues a copy of size bytes from data into dst at dstOffset, data can be released on return
+	EngineUploadTicket uploadBuffer(EngineBuffer &dst, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0){
+		std::lock_guard<std::mutex> lock{mutex};
+
+		const char *source = static_cast<const char *>(data);
+		VkDeviceSize chunkSize = stagingRing.getCapacity() / 4;
+		EngineUploadTicket ticket{};
+
+		for (VkDeviceSize copied = 0; copied < size;){
+			VkDeviceSize chunk = std::min(chunkSize, size - copied);
+			EngineStagingRegion region = acquireStaging(chunk);
+			std::memcpy(region.mapped, source + copied, chunk);
+
+			Batch &batch = beginBatch();
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = region.offset;
+			copyRegion.dstOffset = dstOffset + copied;
+			copyRegion.size = chunk;
+			vkCmdCopyBuffer(batch.commandBuffer, region.buffer, dst.getBuffer(), 1, &copyRegion);
+
+			batch.bytes += chunk;
+			ticket.batch = batch.id;
+			copied += chunk;
+
+			if (batch.bytes >= stagingRing.getCapacity() / 2) submitOpenBatch();
+		}
+
+		copyCount++;
+		return ticket;
+	}
+
+	// Submits the open batch, if any
+	void submit(){
+		std::lock_guard<std::mutex> lock{mutex};
+		submitOpenBatch();
+	}
+
+	// Submits pending copies and retires finished batches, call once per frame
+	void update(){
+		std::lock_guard<std::mutex> lock{mutex};
+		submitOpenBatch();
+		retireBatches(false);
+	}
+
+	void waitIdle(){
+		std::lock_guard<std::mutex> lock{mutex};
+		submitOpenBatch();
+		retireBatches(true);
+	}
+
+	bool isComplete(EngineUploadTicket ticket) const {return ticket.batch <= completedBatch;}
+
+	uint32_t getSubmitCount() const {return submitCount;}
+	uint32_t getCopyCount() const {return copyCount;}
+	EngineStagingRingStats getStagingStats() const {return stagingRing.getStats();}
+
+private:
+	struct Batch{
+		uint64_t id = 0;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkDeviceSize bytes = 0;
+	};
+
+	// Space in the ring only comes back through submitted work, so flush the open batch before waiting
+	EngineStagingRegion acquireStaging(VkDeviceSize size){
+		EngineStagingRegion region{};
+		while (!stagingRing.allocate(size, STAGING_ALIGNMENT, region)){
+			if (stagingRing.hasUnsubmitted()) submitOpenBatch();
+			stagingRing.reclaim();
+			if (stagingRing.allocate(size, STAGING_ALIGNMENT, region)) break;
+
+			if (!stagingRing.hasInFlight()) throw std::runtime_error("staging ring too small for upload chunk!");
+			stagingRing.waitForSpace();
+			retireBatches(false);
+		}
+		return region;
+	}
+
+	Batch &beginBatch(){
+		if (openBatch) return *openBatch;
+
+		if (!freeBatches.empty()){
+			openBatch = std::move(freeBatches.back());
+			freeBatches.pop_back();
+			vkResetFences(engineDevice.device(), 1, &openBatch->fence);
+			vkResetCommandBuffer(openBatch->commandBuffer, 0);
+		}
+		else {
+			openBatch = std::make_unique<Batch>();
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = commandPool;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(engineDevice.device(), &allocInfo, &openBatch->commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate upload command buffer!");
+			}
+
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(engineDevice.device(), &fenceInfo, nullptr, &openBatch->fence) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create upload fence!");
+			}
+		}
+
+		openBatch->id = ++lastBatch;
+		openBatch->bytes = 0;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(openBatch->commandBuffer, &beginInfo);
+		return *openBatch;
+	}
+
+	void submitOpenBatch(){
+		if (!openBatch) return;
+		vkEndCommandBuffer(openBatch->commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &openBatch->commandBuffer;
+
+		if (vkQueueSubmit(engineDevice.transferQueue(), 1, &submitInfo, openBatch->fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit upload batch!");
+		}
+		stagingRing.submit(openBatch->fence);
+		submitCount++;
+		pendingBatches.push_back(std::move(openBatch));
+	}
+
+	// Batches retire in submission order, so completedBatch only ever moves forward
+	void retireBatches(bool wait){
+		while (!pendingBatches.empty()){
+			Batch &batch = *pendingBatches.front();
+			if (wait) vkWaitForFences(engineDevice.device(), 1, &batch.fence, VK_TRUE, UINT64_MAX);
+			else if (vkGetFenceStatus(engineDevice.device(), batch.fence) != VK_SUCCESS) break;
+
+			// The ring has to see the fence signalled before the batch can be reused and reset it
+			stagingRing.reclaim();
+			completedBatch = batch.id;
+			freeBatches.push_back(std::move(pendingBatches.front()));
+			pendingBatches.pop_front();
+		}
+	}
+
+	void destroyBatch(Batch &batch){
+		vkDestroyFence(engineDevice.device(), batch.fence, nullptr);
+		vkFreeCommandBuffers(engineDevice.device(), commandPool, 1, &batch.commandBuffer);
+	}
+
+	EngineDevice &engineDevice;
+	VkCommandPool commandPool;
+	EngineStagingRing stagingRing;
+
+	std::unique_ptr<Batch> openBatch;
+	std::deque<std::unique_ptr<Batch>> pendingBatches;
+	std::vector<std::unique_ptr<Batch>> freeBatches;
+
+	uint64_t lastBatch = 0;
+	std::atomic<uint64_t> completedBatch{0};
+	uint32_t submitCount = 0;
+	uint32_t copyCount = 0;
+	std::mutex mutex;
+};
+} // namespace
+
+#endif
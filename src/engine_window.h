@@ -7,16 +7,18 @@
 #include <string>
 #include <iostream>
 
+// A headless window never initialises GLFW, it only carries the extent of the offscreen target
 class EngineWindow {
 
 public:
     // Constructor
-    EngineWindow(int _width, int _height, std::string _windowName) 
-    : width(_width), height(_height), windowName(_windowName) 
-    { Init(); }
+    EngineWindow(int _width, int _height, std::string _windowName, bool _headless = false) 
+    : width(_width), height(_height), headless(_headless), windowName(_windowName) 
+    { if (!headless) Init(); }
 
     // Destructor
     ~EngineWindow() {
+        if (headless) return;
         glfwDestroyWindow(window);
         glfwTerminate();
     }
@@ -24,7 +26,8 @@ public:
 	EngineWindow(const EngineWindow &) = delete;
 	EngineWindow &operator = (const EngineWindow &) = delete;
 
-    bool shouldClose() {return glfwWindowShouldClose(window);}
+    bool shouldClose() {return !headless && glfwWindowShouldClose(window);}
+    bool isHeadless() const {return headless;}
 
     void createWindowSurface(VkInstance instance, VkSurfaceKHR *surface){
 		if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS){
@@ -62,9 +65,10 @@ private:
 	int width;
 	int height;
 	bool framebufferResized = false;
+	bool headless;
 
 	std::string windowName;
-	GLFWwindow *window;
+	GLFWwindow *window = nullptr;
 };
 
 #endif
\ No newline at end of file
@@ -1,8 +1,84 @@
 #include "app.h"
 
-int main() {
-    
-    Engine::Application app{};
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+
+int main(int argc, char **argv) {
+
+    Engine::AppOptions options{};
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--stress") == 0) options.stressScene = true;
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            std::string scene = argv[++i];
+            if (scene != "car" && scene != "stress") {
+                std::cerr << "unknown scene " << scene << ", expected car or stress" << std::endl;
+                return 1;
+            }
+            options.stressScene = scene == "stress";
+        }
+        else if (std::strcmp(argv[i], "--benchmark") == 0) options.benchmark = true;
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) options.warmupFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--measure") == 0 && i + 1 < argc) options.measuredFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--benchmark-output") == 0 && i + 1 < argc) options.benchmarkOutput = argv[++i];
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc) options.cameraPath = argv[++i];
+        else if (std::strcmp(argv[i], "--record-path") == 0 && i + 1 < argc) options.recordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--gpu-culling") == 0) options.gpuCulling = true;
+        else if (std::strcmp(argv[i], "--validate-culling") == 0) options.gpuCulling = options.validateCulling = true;
+        else if (std::strcmp(argv[i], "--gpu-profile") == 0) options.gpuProfiler = true;
+        else if (std::strcmp(argv[i], "--bindless") == 0) options.bindless = true;
+        else if (std::strcmp(argv[i], "--headless") == 0) options.headless = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) options.frameLimit = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            options.headless = true;
+            options.capturePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc) options.lightCount = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) options.workerThreads = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--allocator-test") == 0) return Engine::testMemoryAllocator() ? 0 : 1;
+        else if (std::strcmp(argv[i], "--job-bench") == 0) return Engine::benchmarkJobSystem(options.workerThreads) ? 0 : 1;
+        else if (std::strcmp(argv[i], "--obj-bench") == 0) {
+            // Optional size cap in MB, the default runs 10MB, 100MB and 1GB files
+            size_t maxMegabytes = i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])) ? std::strtoul(argv[++i], nullptr, 10) : 1024;
+            Engine::EngineJobSystem jobSystem{options.workerThreads};
+            return Engine::benchmarkObjParser(&jobSystem, maxMegabytes) ? 0 : 1;
+        }
+        else if (std::strcmp(argv[i], "--mesh-import-bench") == 0) {
+            Engine::EngineJobSystem jobSystem{options.workerThreads};
+            return Engine::benchmarkMeshImport(&jobSystem) ? 0 : 1;
+        }
+        else if (std::strcmp(argv[i], "--mesh-cache-bench") == 0) {
+            Engine::EngineJobSystem jobSystem{options.workerThreads};
+            return Engine::benchmarkMeshCache(&jobSystem) ? 0 : 1;
+        }
+        else if (std::strcmp(argv[i], "--transform-bench") == 0) {
+            Engine::EngineJobSystem jobSystem{options.workerThreads};
+            bool ok = Engine::benchmarkTransformKernel();
+            ok = Engine::benchmarkTransforms() && ok;
+            return Engine::benchmarkHierarchy(jobSystem) && ok ? 0 : 1;
+        }
+        else if (std::strcmp(argv[i], "--cull-bench") == 0) {
+            // CPU culling kernel microbenchmark, needs no window or device
+            Engine::Camera camera{};
+            camera.setPerspectiveProjection(static_cast<float>(Engine::Application::width) / Engine::Application::height);
+            camera.setView();
+            return Engine::benchmarkCulling(camera.getProjection() * camera.getView()) ? 0 : 1;
+        }
+        else if (std::strcmp(argv[i], "--cluster-test") == 0) {
+            // CPU reference of the light binning pass, needs no window or device
+            Engine::Camera camera{};
+            camera.setPerspectiveProjection(static_cast<float>(Engine::Application::width) / Engine::Application::height);
+            camera.setView();
+            return Engine::testClusteredLighting(camera.getProjection(), camera.getView()) ? 0 : 1;
+        }
+    }
+
+    // a headless run has no window to close, benchmarks stop by themselves
+    if (options.headless && options.frameLimit == 0 && !options.benchmark) options.frameLimit = 300;
+
+    Engine::Application app{options};
     app.run();
 
     return 0;
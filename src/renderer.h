@@ -5,8 +5,10 @@
 #include "engine_swap_chain.h"
 #include "engine_device.h"
 #include "engine_mesh.h"
+#include "engine_profiler.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
@@ -31,6 +33,12 @@ public:
 
 	VkRenderPass getSwapChainRenderPass() const {return engineSwapChain->getRenderPass();}
 	float getAspectRatio() const {return engineSwapChain->extentAspectRatio();}
+	VkExtent2D getSwapChainExtent() const {return engineSwapChain->getSwapChainExtent();}
+
+	VkFramebuffer getCurrentFramebuffer() const {
+		assert(isFrameStarted && "Cannot get framebuffer when frame is not in progress!");
+		return engineSwapChain->getFrameBuffer(currentImageIndex);
+	}
 
 	bool isFrameInProgress() const {return isFrameStarted;}
 
@@ -45,6 +53,7 @@ public:
 	}
 
 	VkCommandBuffer beginFrame(){
+		ENGINE_PROFILE_ZONE("Renderer::beginFrame");
 		assert(!isFrameStarted && "Can't call beginFrame while already in progress!");
 
 		auto result = engineSwapChain->acquireNextImage(&currentImageIndex);
@@ -71,6 +80,7 @@ public:
 	}
 
 	void endFrame(){
+		ENGINE_PROFILE_ZONE("Renderer::endFrame");
 		assert(isFrameStarted && "Can't call end frame while frame is not in progress!");
 		auto commandBuffer = getCurrentCommandBuffer();
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
@@ -89,7 +99,8 @@ public:
 		currentFrameIndex = (currentFrameIndex + 1) % EngineSwapChain::MAX_FRAMES_IN_FLIGHT;
 	}
 
-	void beginSwapChainRenderPass(VkCommandBuffer commandBuffer){
+	// With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the pass may only execute secondary buffers, which set their own viewport
+	void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE){
 		assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress!");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame!");
 		
@@ -110,7 +121,8 @@ public:
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);	
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+		if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) return;
 		
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -129,6 +141,12 @@ public:
 		vkCmdEndRenderPass(commandBuffer);
 	}
 
+	// Headless only, writes the image of the last frame passed to endFrame as a PNG
+	bool captureFrame(const std::string &path){
+		assert(!isFrameStarted && "Can't capture while a frame is in progress!");
+		return engineSwapChain->writePng(currentImageIndex, path);
+	}
+
 
 private:
 